@@ -0,0 +1,42 @@
+/*
+ * C API around aedat_decoder.h, loaded by aedat_fast.py through ctypes.
+ *
+ * Linux: g++ -std=c++11 -O3 -march=native -shared -fPIC -o libaedat_decoder.so aedat_decoder.cpp -lpthread
+ * Mac os X: g++ -std=c++11 -O3 -march=native -shared -fPIC -o libaedat_decoder.dylib aedat_decoder.cpp
+ */
+
+#include "aedat_decoder.h"
+
+extern "C" {
+
+void *aedat_open(const char *path) {
+	AedatFile *file = new AedatFile();
+	if (!file->open(path)) {
+		delete file;
+		return nullptr;
+	}
+	return file;
+}
+
+uint64_t aedat_spike_count(void *handle) {
+	return static_cast<AedatFile *>(handle)->spikeCount();
+}
+
+uint64_t aedat_special_count(void *handle) {
+	return static_cast<AedatFile *>(handle)->specialCount();
+}
+
+// Arrays must hold aedat_spike_count() / aedat_special_count() elements.
+// Pass NULL timestamps to skip either event type.
+void aedat_decode(void *handle, uint8_t *coreId, uint8_t *chipId, uint32_t *neuronId, int64_t *spikeTs,
+                  uint8_t *specialType, uint32_t *specialData, int64_t *specialTs, unsigned threads) {
+	AedatSpikeColumns spikes = { coreId, chipId, neuronId, spikeTs };
+	AedatSpecialColumns specials = { specialType, specialData, specialTs };
+	static_cast<AedatFile *>(handle)->decode(spikes, specials, threads);
+}
+
+void aedat_close(void *handle) {
+	delete static_cast<AedatFile *>(handle);
+}
+
+}
@@ -0,0 +1,297 @@
+/*
+ * Fast AEDAT 3.1 reader for dynap-se recordings.
+ *
+ * The file is mmap'd, the 28-byte packet headers are walked once to build a
+ * packet index, then packets are decoded in parallel (one contiguous packet
+ * range per thread) straight into caller-provided columnar arrays. Spike
+ * (type 12) and special (type 0) event words are split with AVX2 when the
+ * compiler targets it, with a scalar fallback otherwise.
+ *
+ * Header only, no libcaer dependency. See aedat_decoder.cpp for the C API
+ * used by the Python binding (aedat_fast.py).
+ */
+
+#ifndef AEDAT_DECODER_H_
+#define AEDAT_DECODER_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#define AEDAT_SPECIAL_EVENT 0
+#define AEDAT_SPIKE_EVENT 12
+#define AEDAT_PACKET_HEADER_SIZE 28
+
+#pragma pack(push, 1)
+struct AedatPacketHeader {
+    int16_t eventType;
+    int16_t eventSource;
+    int32_t eventSize;
+    int32_t eventTSOffset;
+    int32_t eventTSOverflow;
+    int32_t eventCapacity;
+    int32_t eventNumber;
+    int32_t eventValid;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(AedatPacketHeader) == AEDAT_PACKET_HEADER_SIZE, "AEDAT packet header is 28 bytes");
+
+struct AedatPacketInfo {
+    uint64_t offset;     // file offset of the packet header
+    int16_t eventType;
+    int16_t eventSource;
+    int32_t eventSize;
+    int32_t tsOverflow;
+    int32_t eventNumber;
+    uint64_t firstIndex; // index of the first event in the output columns
+};
+
+struct AedatSpikeColumns {
+    uint8_t *coreId;
+    uint8_t *chipId;
+    uint32_t *neuronId;
+    int64_t *timestamp;
+};
+
+struct AedatSpecialColumns {
+    uint8_t *type;
+    uint32_t *data;
+    int64_t *timestamp;
+};
+
+class AedatFile {
+public:
+    ~AedatFile() { close(); }
+
+    bool open(const std::string &path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            perror(path.c_str());
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) < 0 || st.st_size == 0) {
+            fprintf(stderr, "Empty or unreadable file: %s\n", path.c_str());
+            ::close(fd);
+            return false;
+        }
+        size = static_cast<size_t>(st.st_size);
+        void *mem = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mem == MAP_FAILED) {
+            perror("mmap");
+            return false;
+        }
+        base = static_cast<const uint8_t *>(mem);
+        madvise(mem, size, MADV_SEQUENTIAL);
+
+        buildIndex(skipHeader());
+        return true;
+    }
+
+    void close() {
+        if (base != nullptr) {
+            munmap(const_cast<uint8_t *>(base), size);
+            base = nullptr;
+        }
+        packetIndex.clear();
+        spikes = specials = 0;
+    }
+
+    uint64_t spikeCount() const { return spikes; }
+    uint64_t specialCount() const { return specials; }
+    const std::vector<AedatPacketInfo> &packets() const { return packetIndex; }
+
+    // Raw packet bytes (header followed by events), valid while the file is open.
+    const uint8_t *packetData(const AedatPacketInfo &packet) const { return base + packet.offset; }
+
+    // Fill the columns (sized spikeCount() / specialCount()). Null columns are skipped.
+    void decode(const AedatSpikeColumns &spikeOut, const AedatSpecialColumns &specialOut, unsigned threads = 0) const {
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        threads = static_cast<unsigned>(std::min<size_t>(threads, std::max<size_t>(1, packetIndex.size() / 16)));
+
+        // Split by event count rather than packet count, packets vary a lot in size.
+        uint64_t total = spikes + specials, perThread = total / threads + 1;
+        std::vector<size_t> bounds(1, 0);
+        uint64_t acc = 0;
+        for (size_t i = 0; i < packetIndex.size(); i++) {
+            acc += static_cast<uint64_t>(packetIndex[i].eventNumber);
+            if (acc >= perThread * bounds.size() && bounds.size() < threads) {
+                bounds.push_back(i + 1);
+            }
+        }
+        bounds.push_back(packetIndex.size());
+
+        std::vector<std::thread> workers;
+        for (size_t t = 1; t + 1 < bounds.size(); t++) {
+            workers.emplace_back(&AedatFile::decodeRange, this, bounds[t], bounds[t + 1], spikeOut, specialOut);
+        }
+        decodeRange(bounds[0], bounds[1], spikeOut, specialOut);
+        for (auto &worker : workers) {
+            worker.join();
+        }
+    }
+
+private:
+    const uint8_t *base = nullptr;
+    size_t size = 0;
+    std::vector<AedatPacketInfo> packetIndex;
+    uint64_t spikes = 0, specials = 0;
+
+    // Skip the "#..." text header, up to and including "#!END-HEADER\r\n".
+    size_t skipHeader() const {
+        size_t pos = 0;
+        while (pos < size && base[pos] == '#') {
+            const uint8_t *eol = static_cast<const uint8_t *>(memchr(base + pos, '\n', size - pos));
+            size_t next = (eol == nullptr) ? size : static_cast<size_t>(eol - base) + 1;
+            bool end = (next - pos >= 12) && memcmp(base + pos, "#!END-HEADER", 12) == 0;
+            pos = next;
+            if (end) {
+                break;
+            }
+        }
+        return pos;
+    }
+
+    void buildIndex(size_t pos) {
+        while (pos + AEDAT_PACKET_HEADER_SIZE <= size) {
+            AedatPacketHeader header;
+            memcpy(&header, base + pos, sizeof(header));
+            uint64_t dataSize = static_cast<uint64_t>(header.eventCapacity) * static_cast<uint64_t>(header.eventSize);
+            if (header.eventSize <= 0 || header.eventCapacity < 0 || pos + AEDAT_PACKET_HEADER_SIZE + dataSize > size) {
+                break; // truncated or corrupt tail, keep what we have
+            }
+
+            int32_t number = std::min(header.eventNumber, header.eventCapacity);
+            bool spike = header.eventType == AEDAT_SPIKE_EVENT && header.eventSize == 8;
+            bool special = header.eventType == AEDAT_SPECIAL_EVENT && header.eventSize == 8;
+            if ((spike || special) && number > 0) {
+                AedatPacketInfo info;
+                info.offset = pos;
+                info.eventType = header.eventType;
+                info.eventSource = header.eventSource;
+                info.eventSize = header.eventSize;
+                info.tsOverflow = header.eventTSOverflow;
+                info.eventNumber = number;
+                info.firstIndex = spike ? spikes : specials;
+                (spike ? spikes : specials) += static_cast<uint64_t>(number);
+                packetIndex.push_back(info);
+            }
+
+            pos += AEDAT_PACKET_HEADER_SIZE + dataSize;
+        }
+    }
+
+    void decodeRange(size_t first, size_t last, AedatSpikeColumns spikeOut, AedatSpecialColumns specialOut) const {
+        for (size_t p = first; p < last; p++) {
+            const AedatPacketInfo &packet = packetIndex[p];
+            const uint8_t *events = base + packet.offset + AEDAT_PACKET_HEADER_SIZE;
+            int64_t tsBase = static_cast<int64_t>(packet.tsOverflow) << 31;
+            size_t n = static_cast<size_t>(packet.eventNumber), i0 = packet.firstIndex;
+
+            if (packet.eventType == AEDAT_SPIKE_EVENT && spikeOut.timestamp != nullptr) {
+                decodeSpikes(events, n, tsBase, spikeOut.coreId + i0, spikeOut.chipId + i0, spikeOut.neuronId + i0,
+                             spikeOut.timestamp + i0);
+            }
+            else if (packet.eventType == AEDAT_SPECIAL_EVENT && specialOut.timestamp != nullptr) {
+                decodeSpecials(events, n, tsBase, specialOut.type + i0, specialOut.data + i0, specialOut.timestamp + i0);
+            }
+        }
+    }
+
+#if defined(__AVX2__)
+    // Load 8 events (64 bytes) and split them into 8 data words and 8 timestamps.
+    static inline void load8(const uint8_t *events, __m256i &data, __m256i &ts) {
+        const __m256i split = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+        __m256i a = _mm256_permutevar8x32_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(events)), split);
+        __m256i b = _mm256_permutevar8x32_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(events + 32)), split);
+        data = _mm256_permute2x128_si256(a, b, 0x20);
+        ts = _mm256_permute2x128_si256(a, b, 0x31);
+    }
+
+    // Low byte of each 32-bit lane → 8 consecutive bytes.
+    static inline void store8Bytes(uint8_t *out, __m256i v) {
+        const __m256i pick = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                              0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        __m256i packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(v, pick), _mm256_setr_epi32(0, 4, 1, 1, 1, 1, 1, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(out), _mm256_castsi256_si128(packed));
+    }
+
+    static inline void storeTimestamps(int64_t *out, __m256i ts, int64_t tsBase) {
+        __m256i offset = _mm256_set1_epi64x(tsBase);
+        __m256i lo = _mm256_add_epi64(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(ts)), offset);
+        __m256i hi = _mm256_add_epi64(_mm256_cvtepi32_epi64(_mm256_extracti128_si256(ts, 1)), offset);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), lo);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 4), hi);
+    }
+#endif
+
+    static void decodeSpikes(const uint8_t *events, size_t n, int64_t tsBase, uint8_t *core, uint8_t *chip,
+                             uint32_t *neuron, int64_t *ts) {
+        size_t i = 0;
+#if defined(__AVX2__)
+        const __m256i mask5 = _mm256_set1_epi32(0x1F), mask6 = _mm256_set1_epi32(0x3F);
+        for (; i + 8 <= n; i += 8) {
+            __m256i data, time;
+            load8(events + i * 8, data, time);
+            store8Bytes(core + i, _mm256_and_si256(_mm256_srli_epi32(data, 1), mask5));
+            store8Bytes(chip + i, _mm256_and_si256(_mm256_srli_epi32(data, 6), mask6));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(neuron + i), _mm256_srli_epi32(data, 12));
+            storeTimestamps(ts + i, time, tsBase);
+        }
+#endif
+        for (; i < n; i++) {
+            uint32_t w;
+            int32_t t;
+            memcpy(&w, events + i * 8, 4);
+            memcpy(&t, events + i * 8 + 4, 4);
+            core[i] = static_cast<uint8_t>((w >> 1) & 0x1F);
+            chip[i] = static_cast<uint8_t>((w >> 6) & 0x3F);
+            neuron[i] = w >> 12;
+            ts[i] = tsBase + t;
+        }
+    }
+
+    static void decodeSpecials(const uint8_t *events, size_t n, int64_t tsBase, uint8_t *type, uint32_t *data,
+                               int64_t *ts) {
+        size_t i = 0;
+#if defined(__AVX2__)
+        const __m256i mask7 = _mm256_set1_epi32(0x7F);
+        for (; i + 8 <= n; i += 8) {
+            __m256i word, time;
+            load8(events + i * 8, word, time);
+            store8Bytes(type + i, _mm256_and_si256(_mm256_srli_epi32(word, 1), mask7));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(data + i), _mm256_srli_epi32(word, 8));
+            storeTimestamps(ts + i, time, tsBase);
+        }
+#endif
+        for (; i < n; i++) {
+            uint32_t w;
+            int32_t t;
+            memcpy(&w, events + i * 8, 4);
+            memcpy(&t, events + i * 8 + 4, 4);
+            type[i] = static_cast<uint8_t>((w >> 1) & 0x7F);
+            data[i] = w >> 8;
+            ts[i] = tsBase + t;
+        }
+    }
+};
+
+#endif /* AEDAT_DECODER_H_ */
@@ -0,0 +1,79 @@
+#!/usr/bin/env python
+
+
+######################################
+# NumPy binding for the C++ AEDAT 3.1
+# decoder (aedat_decoder.h)
+#
+# build the library first:
+#   g++ -std=c++11 -O3 -march=native -shared -fPIC \
+#       -o libaedat_decoder.so aedat_decoder.cpp -lpthread
+######################################
+
+
+import ctypes
+import os
+import sys
+import numpy as np
+
+
+def _load_library():
+    ''' Look for libaedat_decoder next to this file '''
+    here = os.path.dirname(os.path.abspath(__file__))
+    suffix = '.dylib' if sys.platform == 'darwin' else '.so'
+    path = os.path.join(here, 'libaedat_decoder' + suffix)
+    lib = ctypes.CDLL(path)
+
+    lib.aedat_open.restype = ctypes.c_void_p
+    lib.aedat_open.argtypes = [ctypes.c_char_p]
+    lib.aedat_spike_count.restype = ctypes.c_uint64
+    lib.aedat_spike_count.argtypes = [ctypes.c_void_p]
+    lib.aedat_special_count.restype = ctypes.c_uint64
+    lib.aedat_special_count.argtypes = [ctypes.c_void_p]
+    lib.aedat_decode.restype = None
+    lib.aedat_decode.argtypes = [ctypes.c_void_p] + [ctypes.c_void_p] * 7 + [ctypes.c_uint]
+    lib.aedat_close.restype = None
+    lib.aedat_close.argtypes = [ctypes.c_void_p]
+    return lib
+
+
+_lib = _load_library()
+
+
+def _ptr(array):
+    return array.ctypes.data_as(ctypes.c_void_p)
+
+
+def read_aedat(filename, threads=0):
+    """ Decode a dynap-se AEDAT 3.1 file into NumPy columns.
+
+    Returns a dict with the spike columns core_id, chip_id, neuron_id, ts and
+    the special event columns spec_type, spec_data, spec_ts. Timestamps are
+    64-bit microseconds (overflow already applied). threads=0 uses all cores.
+    """
+    handle = _lib.aedat_open(filename.encode('utf-8'))
+    if not handle:
+        raise IOError('cannot open ' + filename)
+
+    try:
+        n_spikes = _lib.aedat_spike_count(handle)
+        n_special = _lib.aedat_special_count(handle)
+
+        out = {
+            'core_id': np.empty(n_spikes, dtype=np.uint8),
+            'chip_id': np.empty(n_spikes, dtype=np.uint8),
+            'neuron_id': np.empty(n_spikes, dtype=np.uint32),
+            'ts': np.empty(n_spikes, dtype=np.int64),
+            'spec_type': np.empty(n_special, dtype=np.uint8),
+            'spec_data': np.empty(n_special, dtype=np.uint32),
+            'spec_ts': np.empty(n_special, dtype=np.int64),
+        }
+
+        _lib.aedat_decode(handle,
+                          _ptr(out['core_id']), _ptr(out['chip_id']), _ptr(out['neuron_id']), _ptr(out['ts']),
+                          _ptr(out['spec_type']), _ptr(out['spec_data']), _ptr(out['spec_ts']),
+                          threads)
+    finally:
+        _lib.aedat_close(handle)
+
+    return out
@@ -0,0 +1,353 @@
+/*
+ * AEDAT 3.1 recorder.
+ *
+ * Packet containers are handed over by the sender thread and written on a
+ * dedicated I/O thread. Packets go to disk as they are in memory: a copy of
+ * the 28-byte caer_event_packet_header (with eventCapacity trimmed to
+ * eventNumber, so readers such as aedat_dynapse.py see no empty slots)
+ * followed by the event array, gathered into one writev() per batch of
+ * containers. Nothing is decoded or re-encoded per event.
+ *
+ * Files are rotated after maxBytes or maxSeconds (0 disables either limit)
+ * and named <prefix>-YYYY_MM_DD_HH_MM_SS-<n>.aedat.
+ *
+ * RECORD_START and RECORD_STOP take effect on the I/O thread in stream
+ * order: every container carries the control generation it was submitted
+ * under, and the requests are queued and applied one generation at a time,
+ * so what was submitted before a stop or a new start is still written to the
+ * file it belongs to.
+ */
+
+#ifndef DYNAPSE_AEDAT_RECORDER_H_
+#define DYNAPSE_AEDAT_RECORDER_H_
+
+#include "spike_ring.h"
+
+#include <libcaer/libcaer.h>
+#include <libcaer/devices/dynapse.h>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define AEDAT_RECORDER_RING_CAPACITY 4096 // containers, must be a power of two
+#define AEDAT_RECORDER_MAX_IOV 512        // below IOV_MAX (1024) on Linux
+
+struct RecordedContainer {
+    caerEventPacketContainer container;
+    uint64_t generation; // control generation at submit()
+};
+
+// A RECORD_START (record set) or RECORD_STOP, waiting for the I/O thread.
+struct RecorderControl {
+    uint64_t generation;
+    bool record;
+    std::string prefix;
+    uint64_t maxBytes;
+    uint32_t maxSeconds;
+};
+
+class AedatRecorder {
+public:
+    std::atomic<uint64_t> bytesWritten{0};
+    std::atomic<uint64_t> containersWritten{0};
+    std::atomic<uint64_t> containersDropped{0};
+    std::atomic<uint64_t> filesWritten{0};
+
+    AedatRecorder() : ring(AEDAT_RECORDER_RING_CAPACITY) {}
+    ~AedatRecorder() { stopThread(); }
+
+    void startThread() {
+        ioStop.store(false);
+        ioThread = std::thread(&AedatRecorder::run, this);
+    }
+
+    // Flushes everything already submitted, then closes the current file.
+    void stopThread() {
+        if (ioThread.joinable()) {
+            ioStop.store(true);
+            ioThread.join();
+        }
+    }
+
+    // Any thread. Begins a new recording (closing a running one).
+    void start(const std::string &prefix, uint64_t maxBytes, uint32_t maxSeconds) {
+        std::lock_guard<std::mutex> lock(controlMutex);
+        controlGeneration++;
+        controls.push_back({controlGeneration, true, prefix, maxBytes, maxSeconds});
+        submitGeneration.store(controlGeneration, std::memory_order_release);
+        active.store(true);
+    }
+
+    // Any thread.
+    void stop() {
+        std::lock_guard<std::mutex> lock(controlMutex);
+        controlGeneration++;
+        controls.push_back({controlGeneration, false, "", 0, 0});
+        submitGeneration.store(controlGeneration, std::memory_order_release);
+        active.store(false);
+    }
+
+    bool recording() const { return active.load(std::memory_order_relaxed); }
+
+    // Sender thread. Takes ownership of the container in all cases.
+    void submit(caerEventPacketContainer packetContainer) {
+        if (!recording()
+            || !ring.tryPush({packetContainer, submitGeneration.load(std::memory_order_acquire)})) {
+            if (recording()) {
+                containersDropped.fetch_add(1, std::memory_order_relaxed);
+            }
+            caerEventPacketContainerFree(packetContainer);
+        }
+    }
+
+    void printStats() const {
+        std::lock_guard<std::mutex> lock(controlMutex);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - sessionStart).count();
+        printf("Recorder: %s, %llu files, %llu containers / %.1f MB written (%.1f MB/s), %llu containers dropped.\n",
+               fileName.empty() ? "idle" : fileName.c_str(), (unsigned long long) filesWritten.load(),
+               (unsigned long long) containersWritten.load(), bytesWritten.load() / 1e6,
+               (recording() && seconds > 0) ? sessionBytes.load() / 1e6 / seconds : 0.0,
+               (unsigned long long) containersDropped.load());
+    }
+
+private:
+    SpscRing<RecordedContainer> ring;
+    std::thread ioThread;
+    std::atomic_bool ioStop{false};
+    std::atomic_bool active{false};
+
+    // Control requests, applied by the I/O thread.
+    mutable std::mutex controlMutex;
+    uint64_t controlGeneration = 0;
+    std::atomic<uint64_t> submitGeneration{0}; // controlGeneration, for submit()
+    std::deque<RecorderControl> controls; // by generation
+
+    // I/O thread state.
+    uint64_t appliedGeneration = 0;
+    int fd = -1;
+    std::string prefix, fileName;
+    uint64_t maxBytes = 0, fileBytes = 0;
+    uint32_t maxSeconds = 0, fileIndex = 0;
+    std::chrono::steady_clock::time_point fileStart, sessionStart;
+    std::atomic<uint64_t> sessionBytes{0};
+
+    void run() {
+        std::vector<caerEventPacketContainer> batch;
+        std::vector<caer_event_packet_header> headers;
+        std::vector<iovec> iov;
+        batch.reserve(64);
+        // iov points into headers: flushIov() runs before this could reallocate.
+        headers.reserve(AEDAT_RECORDER_MAX_IOV / 2);
+        iov.reserve(AEDAT_RECORDER_MAX_IOV);
+
+        RecordedContainer item;
+        bool holding = false; // item is from a newer generation than the open file
+        bool idle = false;
+        for (;;) {
+            bool stopping = ioStop.load();
+            while (batch.size() < 64 && (holding || ring.tryPop(item))) {
+                holding = item.generation > appliedGeneration;
+                if (holding) {
+                    break;
+                }
+                batch.push_back(item.container);
+            }
+
+            if (batch.empty()) {
+                // The next control request applies at the first container submitted after
+                // it, or once the ring stayed empty for a round (nothing in flight).
+                if (holding || (idle && controlPending())) {
+                    applyControl();
+                    idle = false;
+                    continue;
+                }
+                if (stopping) {
+                    break;
+                }
+                idle = true;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            idle = false;
+
+            rotateIfNeeded(); // only when there is data for the next file
+            writeBatch(batch, headers, iov);
+            for (caerEventPacketContainer c : batch) {
+                caerEventPacketContainerFree(c);
+            }
+            batch.clear();
+        }
+
+        closeFile();
+    }
+
+    bool controlPending() const {
+        std::lock_guard<std::mutex> lock(controlMutex);
+        return !controls.empty();
+    }
+
+    // Applies the oldest pending request only: the containers of its generation
+    // are written before the next one closes the file.
+    void applyControl() {
+        std::lock_guard<std::mutex> lock(controlMutex);
+        if (controls.empty()) {
+            return;
+        }
+        RecorderControl control = controls.front();
+        controls.pop_front();
+        appliedGeneration = control.generation;
+        closeFileLocked();
+        if (control.record) {
+            prefix = control.prefix;
+            maxBytes = control.maxBytes;
+            maxSeconds = control.maxSeconds;
+            fileIndex = 0;
+            sessionStart = std::chrono::steady_clock::now();
+            sessionBytes.store(0);
+            openFileLocked();
+        }
+    }
+
+    void rotateIfNeeded() {
+        if (fd == -1) {
+            return;
+        }
+        bool sizeLimit = maxBytes != 0 && fileBytes >= maxBytes;
+        bool timeLimit = maxSeconds != 0 && std::chrono::steady_clock::now() - fileStart >= std::chrono::seconds(maxSeconds);
+        if (sizeLimit || timeLimit) {
+            std::lock_guard<std::mutex> lock(controlMutex);
+            closeFileLocked();
+            openFileLocked();
+        }
+    }
+
+    void openFileLocked() {
+        time_t now = time(nullptr);
+        struct tm local;
+        localtime_r(&now, &local);
+        char stamp[32], zone[8];
+        strftime(stamp, sizeof(stamp), "%Y_%m_%d_%H_%M_%S", &local);
+        strftime(zone, sizeof(zone), "%z", &local);
+
+        fileName = prefix + "-" + stamp + "-" + std::to_string(fileIndex++) + ".aedat";
+        fd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1) {
+            perror(fileName.c_str());
+            fileName.clear();
+            if (controls.empty()) {
+                active.store(false); // unless a later request replaced this one
+            }
+            return;
+        }
+
+        char startTime[32];
+        strftime(startTime, sizeof(startTime), "%Y-%m-%d %H:%M:%S", &local);
+        std::string header = "#!AER-DAT3.1\r\n"
+                             "#Format: RAW\r\n"
+                             "#Source 1: Dynap-se\r\n"
+                             "#Start-Time: " + std::string(startTime) + " (TZ" + zone + ")\r\n"
+                             "#!END-HEADER\r\n";
+        iovec hv{const_cast<char *>(header.data()), header.size()};
+        writevAll(&hv, 1);
+        fileBytes = header.size();
+        fileStart = std::chrono::steady_clock::now();
+        filesWritten.fetch_add(1, std::memory_order_relaxed);
+        printf("Recording to %s.\n", fileName.c_str());
+    }
+
+    void closeFileLocked() {
+        if (fd == -1) {
+            return;
+        }
+        close(fd);
+        fd = -1;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - fileStart).count();
+        printf("Closed %s: %.1f MB in %.1f s (%.1f MB/s).\n", fileName.c_str(), fileBytes / 1e6, seconds,
+               seconds > 0 ? fileBytes / 1e6 / seconds : 0.0);
+        fileName.clear();
+    }
+
+    void closeFile() {
+        std::lock_guard<std::mutex> lock(controlMutex);
+        closeFileLocked();
+    }
+
+    void writeBatch(const std::vector<caerEventPacketContainer> &batch, std::vector<caer_event_packet_header> &headers,
+                    std::vector<iovec> &iov) {
+        if (fd == -1) {
+            return;
+        }
+
+        headers.clear();
+        iov.clear();
+        for (caerEventPacketContainer packetContainer : batch) {
+            int32_t packetNum = caerEventPacketContainerGetEventPacketsNumber(packetContainer);
+            for (int32_t i = 0; i < packetNum; i++) {
+                caerEventPacketHeader packetHeader = caerEventPacketContainerGetEventPacket(packetContainer, i);
+                if (packetHeader == NULL || caerEventPacketHeaderGetEventNumber(packetHeader) <= 0) {
+                    continue;
+                }
+
+                if (iov.size() + 2 > AEDAT_RECORDER_MAX_IOV) {
+                    flushIov(headers, iov);
+                }
+
+                // Header copy with capacity == number; the event array is used in place.
+                headers.push_back(*packetHeader);
+                headers.back().eventCapacity = headers.back().eventNumber;
+                iov.push_back({&headers.back(), sizeof(caer_event_packet_header)});
+                iov.push_back({reinterpret_cast<uint8_t *>(packetHeader) + sizeof(caer_event_packet_header),
+                               static_cast<size_t>(caerEventPacketHeaderGetEventNumber(packetHeader))
+                                   * static_cast<size_t>(caerEventPacketHeaderGetEventSize(packetHeader))});
+            }
+            containersWritten.fetch_add(1, std::memory_order_relaxed);
+        }
+        flushIov(headers, iov);
+    }
+
+    void flushIov(std::vector<caer_event_packet_header> &headers, std::vector<iovec> &iov) {
+        if (!iov.empty()) {
+            writevAll(iov.data(), static_cast<int>(iov.size()));
+        }
+        headers.clear();
+        iov.clear();
+    }
+
+    void writevAll(iovec *vec, int count) {
+        while (count > 0) {
+            ssize_t written = writev(fd, vec, count);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                perror("AEDAT write");
+                return;
+            }
+            fileBytes += static_cast<uint64_t>(written);
+            bytesWritten.fetch_add(static_cast<uint64_t>(written), std::memory_order_relaxed);
+            sessionBytes.fetch_add(static_cast<uint64_t>(written), std::memory_order_relaxed);
+
+            size_t left = static_cast<size_t>(written);
+            while (count > 0 && left >= vec->iov_len) {
+                left -= vec->iov_len;
+                vec++;
+                count--;
+            }
+            if (count > 0) {
+                vec->iov_base = static_cast<uint8_t *>(vec->iov_base) + left;
+                vec->iov_len -= left;
+            }
+        }
+    }
+};
+
+#endif /* DYNAPSE_AEDAT_RECORDER_H_ */
@@ -0,0 +1,221 @@
+/*
+ * Precompiled bias images.
+ *
+ * A bias file (RAW: one CHIP_CONTENT word per line, or NAMED: "NAME coarse
+ * fine" per line) is parsed and run through caerBiasDynapseGenerate() once.
+ * The result is a BiasImage: the ready-to-send 32-bit CHIP_CONTENT words. SAVE
+ * does not need the names: it decodes what the device shadow holds.
+ *
+ * Images are cached by the FNV-1a hash of the file content, in memory and as
+ * <BIAS_IMAGE_CACHE_DIR>/<hash>.bin. Loading the same file again, for another
+ * chip or after a restart, costs a stat() or a read + hash, never a parse.
+ * BiasImageCache::get() re-hashes the file only when its size or mtime has
+ * changed, so a live LOAD of an edited file still picks up the edit.
+ */
+
+#ifndef DYNAPSE_BIAS_IMAGE_H_
+#define DYNAPSE_BIAS_IMAGE_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define BIAS_IMAGE_CACHE_DIR "data/.bias_cache"
+#define BIAS_IMAGE_MAGIC 0x49425944 // "DYBI" on disk
+#define BIAS_IMAGE_VERSION 2 // bump when the NAMED -> word generation or the layout changes
+
+// Maps one NAMED line to its CHIP_CONTENT word. Returns false for unknown names.
+typedef bool (*BiasWordGenerator)(const std::string &biasName, int coarse, int fine, uint32_t *word);
+
+struct BiasImage {
+    uint64_t contentHash = 0;
+    bool named = false;
+    std::vector<uint32_t> words;
+};
+
+typedef std::shared_ptr<const BiasImage> BiasImagePtr;
+
+static inline uint64_t fnv1a64(const char *data, size_t len) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+class BiasImageCache {
+public:
+    explicit BiasImageCache(BiasWordGenerator generator) : generator(generator) {}
+
+    uint64_t hits = 0, diskHits = 0, compiles = 0;
+
+    void printStats() const {
+        printf("Bias images: %zu cached, %llu compiled, %llu loaded from disk, %llu memory hits.\n", byHash.size(),
+               (unsigned long long) compiles, (unsigned long long) diskHits, (unsigned long long) hits);
+    }
+
+    // Returns NULL if the file cannot be read or holds no biases.
+    BiasImagePtr get(const std::string &biasFile) {
+        struct stat st;
+        if (stat(biasFile.c_str(), &st) != 0) {
+            std::cerr << "Error opening bias file: " << biasFile << std::endl;
+            return nullptr;
+        }
+
+        auto known = byPath.find(biasFile);
+        if (known != byPath.end() && known->second.size == st.st_size && known->second.mtime == st.st_mtime) {
+            hits++;
+            return known->second.image;
+        }
+
+        std::ifstream input(biasFile, std::ios::binary);
+        std::string content((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+        if (!input.good() && !input.eof()) {
+            std::cerr << "Error opening bias file: " << biasFile << std::endl;
+            return nullptr;
+        }
+
+        uint64_t hash = fnv1a64(content.data(), content.size());
+        BiasImagePtr image;
+        auto cached = byHash.find(hash);
+        if (cached != byHash.end()) {
+            hits++;
+            image = cached->second;
+        }
+        else if ((image = readDisk(hash))) {
+            diskHits++;
+        }
+        else {
+            image = compile(biasFile, content, hash);
+            if (!image) {
+                return nullptr;
+            }
+            compiles++;
+            writeDisk(*image);
+        }
+
+        byHash[hash] = image;
+        byPath[biasFile] = {st.st_size, st.st_mtime, image};
+        return image;
+    }
+
+private:
+    struct PathEntry {
+        off_t size;
+        time_t mtime;
+        BiasImagePtr image;
+    };
+
+    BiasWordGenerator generator;
+    std::map<std::string, PathEntry> byPath;
+    std::map<uint64_t, BiasImagePtr> byHash;
+
+    // Same format detection as the text loader: a number on the first line means RAW.
+    BiasImagePtr compile(const std::string &biasFile, const std::string &content, uint64_t hash) const {
+        std::istringstream input(content);
+        std::string firstLine;
+        if (!std::getline(input, firstLine)) {
+            std::cerr << "Empty bias file: " << biasFile << std::endl;
+            return nullptr;
+        }
+        input.clear();
+        input.seekg(0, std::ios::beg);
+
+        std::shared_ptr<BiasImage> image = std::make_shared<BiasImage>();
+        image->contentHash = hash;
+        std::istringstream issTest(firstLine);
+        int testInt;
+        image->named = !(issTest >> testInt);
+
+        for (std::string line; std::getline(input, line);) {
+            std::istringstream issLine(line);
+            if (!image->named) {
+                uint32_t rawValue;
+                if (!(issLine >> rawValue)) {
+                    std::cerr << "Invalid RAW bias line: " << line << std::endl;
+                    continue;
+                }
+                image->words.push_back(rawValue);
+                continue;
+            }
+
+            std::string biasName;
+            int coarse, fine;
+            if (!(issLine >> biasName >> coarse >> fine)) {
+                std::cerr << "Invalid NAMED bias line: " << line << std::endl;
+                continue;
+            }
+            uint32_t word;
+            if (!generator(biasName, coarse, fine, &word)) {
+                std::cerr << "Unknown bias name: " << biasName << " → skipping." << std::endl;
+                continue;
+            }
+            image->words.push_back(word);
+        }
+
+        printf("Compiled %s: %zu bias words (%016llx).\n", biasFile.c_str(), image->words.size(),
+               (unsigned long long) hash);
+        return image;
+    }
+
+    static std::string diskPath(uint64_t hash) {
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long) hash);
+        return BIAS_IMAGE_CACHE_DIR + std::string(name);
+    }
+
+    // Layout: magic, version, named, word count, hash, words.
+    static void writeDisk(const BiasImage &image) {
+        mkdir(BIAS_IMAGE_CACHE_DIR, 0755); // the cache is optional, errors only lose it
+        std::string path = diskPath(image.contentHash), tmpPath = path + ".tmp";
+        FILE *file = fopen(tmpPath.c_str(), "wb");
+        if (file == NULL) {
+            return;
+        }
+        uint32_t header[4] = {BIAS_IMAGE_MAGIC, BIAS_IMAGE_VERSION, image.named,
+                              static_cast<uint32_t>(image.words.size())};
+        fwrite(header, sizeof(header), 1, file);
+        fwrite(&image.contentHash, sizeof(image.contentHash), 1, file);
+        fwrite(image.words.data(), sizeof(uint32_t), image.words.size(), file);
+        // Readers never see a half-written image.
+        if (fclose(file) == 0) {
+            rename(tmpPath.c_str(), path.c_str());
+        }
+        else {
+            remove(tmpPath.c_str());
+        }
+    }
+
+    static BiasImagePtr readDisk(uint64_t hash) {
+        FILE *file = fopen(diskPath(hash).c_str(), "rb");
+        if (file == NULL) {
+            return nullptr;
+        }
+        std::shared_ptr<BiasImage> image = std::make_shared<BiasImage>();
+        uint32_t header[4];
+        bool ok = fread(header, sizeof(header), 1, file) == 1 && header[0] == BIAS_IMAGE_MAGIC
+            && header[1] == BIAS_IMAGE_VERSION && fread(&image->contentHash, sizeof(uint64_t), 1, file) == 1
+            && image->contentHash == hash;
+        if (ok) {
+            image->named = header[2] != 0;
+            image->words.resize(header[3]);
+            ok = fread(image->words.data(), sizeof(uint32_t), header[3], file) == header[3];
+        }
+        fclose(file);
+        return ok ? image : nullptr;
+    }
+};
+
+#endif /* DYNAPSE_BIAS_IMAGE_H_ */
@@ -0,0 +1,506 @@
+/*
+ * Unattended bias sweeps and calibration.
+ *
+ * A sweep steps one per-core bias ("IF_DC_P") of one chip through a set of
+ * (coarse, fine) points, on every selected core at once. Each point is applied
+ * as a CHIP_CONTENT word from biasWord() (caerBiasDynapseGenerate(), as SET
+ * does), left to settle, and then the spikes of the chip are counted for the
+ * measurement time. The sender thread feeds every spike packet in (add(), one
+ * atomic increment per spike, nothing while no window is open).
+ *
+ * Two modes:
+ *   GRID   - every coarse in a range x every fine in a range (with a step)
+ *   TARGET - bisection on fine, at one coarse, per core, towards a target
+ *            mean rate; the best point found is applied at the end
+ * A grid restores the bias words the shadow held before the sweep.
+ *
+ * The engine is a state machine driven by the config thread (step()), so its
+ * writes never race the config client for the chip selection, and it keeps
+ * running while no client is connected. When a window closes, the next point
+ * is applied first; the rates of the closed window are reduced and written
+ * while the next point settles.
+ *
+ * Results file: SweepFileHeader, then one SweepRecord per core and point,
+ * appended as measured (so an interrupted sweep keeps what it measured). A
+ * TARGET sweep ends with one SWEEP_RECORD_BEST record per core. Rates are in
+ * 0.1 Hz, saturating.
+ */
+
+#ifndef DYNAPSE_BIAS_SWEEP_H_
+#define DYNAPSE_BIAS_SWEEP_H_
+
+#include "bias_tables.h"
+#include "device_shadow.h"
+
+#include <libcaer/libcaer.h>
+#include <libcaer/devices/dynapse.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#define SWEEP_FILE_MAGIC 0x57535944 // "DYSW" on disk
+#define SWEEP_FILE_VERSION 1
+#define SWEEP_CORES 4
+#define SWEEP_NEURONS 256 // per core
+#define SWEEP_DEFAULT_SETTLE_MS 50
+#define SWEEP_DEFAULT_MEASURE_MS 200
+#define SWEEP_DEFAULT_FILE "bias_sweep.bin"
+#define SWEEP_RECORD_BEST 0x01 // SweepRecord flag: best point of a TARGET sweep
+
+enum SweepMode : uint8_t {
+    SWEEP_GRID = 0,
+    SWEEP_TARGET = 1,
+};
+
+#pragma pack(push, 1)
+struct SweepFileHeader {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t mode;     // SweepMode
+    uint8_t chipId;
+    uint8_t coreMask; // bit per core
+    char bias[BIAS_NAME_MAX]; // per-core name, NUL padded
+    uint32_t settleMs;
+    uint32_t measureMs;
+    float targetHz;   // TARGET only
+    uint32_t reserved;
+};
+
+struct SweepRecord {
+    uint32_t point;     // step of the sweep, from 0
+    uint8_t core;
+    uint8_t coarse;
+    uint8_t fine;
+    uint8_t flags;
+    uint32_t measureUs; // actual window length
+    float meanHz;
+    float stdHz;
+    uint16_t active;    // neurons with at least one spike
+    uint16_t maxRate;   // 0.1 Hz
+    uint16_t rates[SWEEP_NEURONS]; // 0.1 Hz, by neuron
+};
+#pragma pack(pop)
+
+static_assert(sizeof(SweepFileHeader) == 56, "SweepFileHeader layout");
+static_assert(sizeof(SweepRecord) == 536, "SweepRecord layout");
+
+struct SweepSettings {
+    uint8_t mode = SWEEP_GRID;
+    uint32_t chipId = DYNAPSE_CONFIG_DYNAPSE_U0;
+    uint8_t coreMask = 0x0F;
+    std::string bias;
+    int coarseLo = 0, coarseHi = 0;
+    int fineLo = 0, fineHi = 255, fineStep = 1;
+    float targetHz = 0;
+    uint32_t settleMs = SWEEP_DEFAULT_SETTLE_MS;
+    uint32_t measureMs = SWEEP_DEFAULT_MEASURE_MS;
+    std::string path;
+};
+
+// "ALL", "2" or "0,1,3" → bit per core, 0 if invalid.
+static inline uint8_t parseSweepCores(const std::string &text) {
+    if (text == "ALL") {
+        return 0x0F;
+    }
+    uint8_t mask = 0;
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] >= '0' && text[i] < '0' + SWEEP_CORES && (i + 1 == text.size() || text[i + 1] == ',')) {
+            mask |= static_cast<uint8_t>(1 << (text[i] - '0'));
+            i++;
+        }
+        else {
+            return 0;
+        }
+    }
+    return mask;
+}
+
+// "<lo>", "<lo>-<hi>" or "<lo>-<hi>/<step>" within [0, max].
+static inline bool parseSweepRange(const std::string &text, int max, int &lo, int &hi, int *step = NULL) {
+    const char *cursor = text.c_str();
+    char *end;
+    lo = static_cast<int>(strtol(cursor, &end, 10));
+    if (end == cursor) return false;
+    hi = lo;
+    if (*end == '-') {
+        cursor = end + 1;
+        hi = static_cast<int>(strtol(cursor, &end, 10));
+        if (end == cursor) return false;
+    }
+    if (step != NULL) {
+        *step = 1;
+        if (*end == '/') {
+            cursor = end + 1;
+            *step = static_cast<int>(strtol(cursor, &end, 10));
+            if (end == cursor || *step < 1) return false;
+        }
+    }
+    return *end == '\0' && lo >= 0 && lo <= hi && hi <= max;
+}
+
+class BiasSweep {
+public:
+    std::atomic<uint64_t> sweeps{0};
+    std::atomic<uint64_t> pointsMeasured{0};
+    std::atomic<uint64_t> spikesCounted{0};
+    std::atomic<uint64_t> writesFailed{0};
+
+    BiasSweep() {
+        for (auto &count : counts) count.store(0, std::memory_order_relaxed);
+    }
+
+    bool active() const { return state != IDLE; }
+
+    // Config thread. Applies the first point; a running sweep must be stopped first.
+    bool start(ShadowDynapseDevice *shadow, const SweepSettings &next, const char **error) {
+        if (active()) {
+            *error = "a sweep is already running (SWEEP_STOP first)";
+            return false;
+        }
+        if (shadowChipSlot(next.chipId) < 0 || next.coreMask == 0 || next.coreMask > 0x0F) {
+            *error = "invalid chip or cores";
+            return false;
+        }
+        for (int core = 0; core < SWEEP_CORES; core++) {
+            biasIds[core] = -1;
+            if (next.coreMask & (1 << core)) {
+                int kind = lookupCoreBiasKind(next.bias.c_str(), next.bias.size());
+                if (kind < 0) {
+                    *error = "not a per-core bias name (e.g. IF_DC_P)";
+                    return false;
+                }
+                biasIds[core] = coreBiasId(core, kind);
+            }
+        }
+        file = fopen(next.path.c_str(), "wb");
+        if (file == NULL) {
+            *error = "cannot create the results file";
+            return false;
+        }
+
+        settings = next;
+        SweepFileHeader header = {};
+        header.magic = SWEEP_FILE_MAGIC;
+        header.version = SWEEP_FILE_VERSION;
+        header.mode = settings.mode;
+        header.chipId = static_cast<uint8_t>(settings.chipId);
+        header.coreMask = settings.coreMask;
+        snprintf(header.bias, sizeof(header.bias), "%s", settings.bias.c_str());
+        header.settleMs = settings.settleMs;
+        header.measureMs = settings.measureMs;
+        header.targetHz = settings.targetHz;
+        fwrite(&header, sizeof(header), 1, file);
+
+        // What to go back to: the words the shadow knows for this chip.
+        const ChipShadow *chip = shadow->chipShadow(settings.chipId);
+        for (int core = 0; core < SWEEP_CORES; core++) {
+            hasOriginal[core] = false;
+            if (biasIds[core] >= 0 && chip != NULL) {
+                uint8_t address = biasWordAddress(biasWord(biasIds[core], 0, 0));
+                hasOriginal[core] = chip->biases.known[address] != 0;
+                original[core] = chip->biases.words[address];
+            }
+            searches[core] = Search();
+            searches[core].lo = settings.fineLo;
+            searches[core].hi = settings.fineHi;
+        }
+        fineCount = (settings.fineHi - settings.fineLo) / settings.fineStep + 1;
+        pointsTotal = (settings.mode == SWEEP_GRID)
+                          ? static_cast<uint32_t>((settings.coarseHi - settings.coarseLo + 1) * fineCount)
+                          : 2 + static_cast<uint32_t>(std::ceil(std::log2(std::max(2, settings.fineHi - settings.fineLo))));
+        point = 0;
+        recordsWritten = 0;
+        sweepStart = std::chrono::steady_clock::now();
+        sweeps.fetch_add(1, std::memory_order_relaxed);
+
+        printf("Sweep: %s on chip %u cores 0x%X, %s, up to %u points, settle %u ms, measure %u ms → %s\n",
+               settings.bias.c_str(), settings.chipId, settings.coreMask,
+               (settings.mode == SWEEP_GRID) ? "grid" : "target", pointsTotal, settings.settleMs,
+               settings.measureMs, settings.path.c_str());
+
+        nextPoint(current);
+        apply(shadow, current, std::chrono::steady_clock::now());
+        return true;
+    }
+
+    // Config thread: ends a running sweep and puts the original bias words back.
+    void stop(ShadowDynapseDevice *shadow) {
+        if (!active()) {
+            return;
+        }
+        measuringChip.store(-1, std::memory_order_release);
+        restore(shadow, false);
+        finish("stopped");
+    }
+
+    // Milliseconds until step() has work, for the config thread's poll timeout.
+    int msUntilDue(std::chrono::steady_clock::time_point now) const {
+        if (!active()) {
+            return 1000;
+        }
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(due - now).count();
+        return static_cast<int>(std::max<long long>(0, left));
+    }
+
+    // Config thread: opens the window after the settle time, and when it
+    // closes applies the next point before recording the closed one.
+    void step(ShadowDynapseDevice *shadow, std::chrono::steady_clock::time_point now) {
+        if (!active() || now < due) {
+            return;
+        }
+        if (state == SETTLING) {
+            for (auto &count : counts) count.store(0, std::memory_order_relaxed);
+            windowStart = now;
+            due = now + std::chrono::milliseconds(settings.measureMs);
+            state = MEASURING;
+            measuringChip.store(static_cast<int>(settings.chipId), std::memory_order_release);
+            return;
+        }
+
+        measuringChip.store(-1, std::memory_order_release);
+        uint32_t measureUs = static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(now - windowStart).count());
+        uint32_t snapshot[SWEEP_CORES * SWEEP_NEURONS];
+        for (size_t i = 0; i < SWEEP_CORES * SWEEP_NEURONS; i++) {
+            snapshot[i] = counts[i].load(std::memory_order_relaxed);
+        }
+        Point measured = current;
+        SweepRecord records[SWEEP_CORES];
+        for (int core = 0; core < SWEEP_CORES; core++) {
+            if (measured.valid[core]) {
+                reduce(core, measured, snapshot + core * SWEEP_NEURONS, measureUs, records[core]);
+                if (settings.mode == SWEEP_TARGET) {
+                    searches[core].observe(measured.fine[core], records[core], settings.targetHz);
+                }
+            }
+        }
+        pointsMeasured.fetch_add(1, std::memory_order_relaxed);
+        point++;
+
+        bool more = nextPoint(current);
+        if (more) {
+            apply(shadow, current, now);
+        }
+        for (int core = 0; core < SWEEP_CORES; core++) {
+            if (measured.valid[core]) {
+                fwrite(&records[core], sizeof(SweepRecord), 1, file);
+                recordsWritten++;
+            }
+        }
+        fflush(file);
+        if (!more) {
+            restore(shadow, settings.mode == SWEEP_TARGET);
+            finish("done");
+        }
+    }
+
+    // Sender thread: counts the spikes of the swept chip while a window is open.
+    void add(caerSpikeEventPacket packet) {
+        int chipId = measuringChip.load(std::memory_order_acquire);
+        if (chipId < 0) {
+            return;
+        }
+        uint64_t added = 0;
+        CAER_SPIKE_ITERATOR_VALID_START(packet)
+            uint32_t neuron = caerSpikeEventGetNeuronID(caerSpikeIteratorElement);
+            uint8_t core = caerSpikeEventGetSourceCoreID(caerSpikeIteratorElement);
+            if (caerSpikeEventGetChipID(caerSpikeIteratorElement) == chipId && core < SWEEP_CORES
+                && neuron < SWEEP_NEURONS) {
+                counts[core * SWEEP_NEURONS + neuron].fetch_add(1, std::memory_order_relaxed);
+                added++;
+            }
+        CAER_SPIKE_ITERATOR_VALID_END
+        spikesCounted.fetch_add(added, std::memory_order_relaxed);
+    }
+
+    void printStats() const {
+        printf("Bias sweep: %llu sweeps, %llu points measured, %llu spikes counted, %llu write failures.\n",
+               (unsigned long long) sweeps.load(), (unsigned long long) pointsMeasured.load(),
+               (unsigned long long) spikesCounted.load(), (unsigned long long) writesFailed.load());
+        if (active()) {
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - sweepStart).count();
+            double left = (point > 0 && pointsTotal > point) ? elapsed / point * (pointsTotal - point) : 0;
+            printf("  running: %s point %u of up to %u, %.0f s elapsed, ~%.0f s left, %s\n", settings.bias.c_str(),
+                   point + 1, pointsTotal, elapsed, left, settings.path.c_str());
+        }
+    }
+
+private:
+    enum State { IDLE, SETTLING, MEASURING };
+
+    // One (coarse, fine) per core; cores not in the sweep, or done searching, are not valid.
+    struct Point {
+        bool valid[SWEEP_CORES];
+        uint8_t coarse[SWEEP_CORES];
+        uint8_t fine[SWEEP_CORES];
+    };
+
+    // Per-core bisection on fine. The first two points measure the ends of
+    // the range, which also tells whether the rate rises or falls with fine.
+    struct Search {
+        int lo = 0, hi = 255;
+        int stage = 0; // 0: measure lo, 1: measure hi, 2: bisect
+        bool rising = true;
+        bool done = false;
+        float loHz = 0;
+        float bestError = -1;
+        SweepRecord best;
+
+        int nextFine() const { return (stage == 0) ? lo : (stage == 1) ? hi : (lo + hi) / 2; }
+
+        void observe(int fine, const SweepRecord &record, float targetHz) {
+            float error = std::fabs(record.meanHz - targetHz);
+            if (bestError < 0 || error < bestError) {
+                bestError = error;
+                best = record;
+            }
+            if (stage == 0) {
+                loHz = record.meanHz;
+                stage = 1;
+                done = (lo == hi);
+            }
+            else if (stage == 1) {
+                rising = record.meanHz >= loHz;
+                float low = std::min(loHz, record.meanHz), high = std::max(loHz, record.meanHz);
+                stage = 2;
+                done = targetHz <= low || targetHz >= high || hi - lo <= 1;
+            }
+            else {
+                if ((record.meanHz < targetHz) == rising) lo = fine;
+                else hi = fine;
+                done = hi - lo <= 1;
+            }
+        }
+    };
+
+    bool nextPoint(Point &next) {
+        bool any = false;
+        for (int core = 0; core < SWEEP_CORES; core++) {
+            next.valid[core] = false;
+            if (biasIds[core] < 0) continue;
+            if (settings.mode == SWEEP_GRID) {
+                if (point >= pointsTotal) continue;
+                next.coarse[core] = static_cast<uint8_t>(settings.coarseLo + static_cast<int>(point) / fineCount);
+                next.fine[core] =
+                    static_cast<uint8_t>(settings.fineLo + (static_cast<int>(point) % fineCount) * settings.fineStep);
+            }
+            else {
+                if (searches[core].done) continue;
+                next.coarse[core] = static_cast<uint8_t>(settings.coarseLo);
+                next.fine[core] = static_cast<uint8_t>(searches[core].nextFine());
+            }
+            next.valid[core] = true;
+            any = true;
+        }
+        return any;
+    }
+
+    // One chip switch, one word per core, then the config client's chip again.
+    void apply(ShadowDynapseDevice *shadow, const Point &next, std::chrono::steady_clock::time_point now) {
+        int selectedChip = shadow->selectedChip();
+        bool ok = shadow->configSet(DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, settings.chipId);
+        for (int core = 0; ok && core < SWEEP_CORES; core++) {
+            if (next.valid[core]) {
+                ok = shadow->configSet(DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_CONTENT,
+                                       biasWord(biasIds[core], next.coarse[core], next.fine[core]));
+            }
+        }
+        if (selectedChip >= 0 && selectedChip != static_cast<int>(settings.chipId)) {
+            shadow->configSet(DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, selectedChip);
+        }
+        if (!ok) {
+            writesFailed.fetch_add(1, std::memory_order_relaxed);
+            fprintf(stderr, "Sweep: bias write failed at point %u.\n", point);
+        }
+        state = SETTLING;
+        due = now + std::chrono::milliseconds(settings.settleMs);
+    }
+
+    void reduce(int core, const Point &measured, const uint32_t *coreCounts, uint32_t measureUs,
+                SweepRecord &record) const {
+        double seconds = std::max<uint32_t>(1, measureUs) / 1e6, sum = 0, sumSquares = 0;
+        record.point = point;
+        record.core = static_cast<uint8_t>(core);
+        record.coarse = measured.coarse[core];
+        record.fine = measured.fine[core];
+        record.flags = 0;
+        record.measureUs = measureUs;
+        record.active = 0;
+        record.maxRate = 0;
+        for (int neuron = 0; neuron < SWEEP_NEURONS; neuron++) {
+            double rate = coreCounts[neuron] / seconds;
+            sum += rate;
+            sumSquares += rate * rate;
+            record.rates[neuron] = static_cast<uint16_t>(std::min(65535.0, std::floor(rate * 10 + 0.5)));
+            record.maxRate = std::max(record.maxRate, record.rates[neuron]);
+            if (coreCounts[neuron] > 0) record.active++;
+        }
+        double mean = sum / SWEEP_NEURONS;
+        record.meanHz = static_cast<float>(mean);
+        record.stdHz = static_cast<float>(std::sqrt(std::max(0.0, sumSquares / SWEEP_NEURONS - mean * mean)));
+    }
+
+    // TARGET: the best point per core; otherwise the words from before the sweep.
+    void restore(ShadowDynapseDevice *shadow, bool best) {
+        int selectedChip = shadow->selectedChip();
+        bool ok = shadow->configSet(DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, settings.chipId);
+        for (int core = 0; ok && core < SWEEP_CORES; core++) {
+            if (biasIds[core] < 0) continue;
+            if (best && searches[core].bestError >= 0) {
+                SweepRecord record = searches[core].best;
+                record.flags = SWEEP_RECORD_BEST;
+                ok = shadow->configSet(DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_CONTENT,
+                                       biasWord(biasIds[core], record.coarse, record.fine));
+                fwrite(&record, sizeof(record), 1, file);
+                recordsWritten++;
+                printf("Sweep: core %d best coarse %u fine %u, %.2f Hz (target %.2f Hz)\n", core, record.coarse,
+                       record.fine, record.meanHz, settings.targetHz);
+            }
+            else if (hasOriginal[core]) {
+                ok = shadow->configSet(DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_CONTENT, original[core]);
+            }
+        }
+        if (selectedChip >= 0 && selectedChip != static_cast<int>(settings.chipId)) {
+            shadow->configSet(DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, selectedChip);
+        }
+        if (!ok) {
+            writesFailed.fetch_add(1, std::memory_order_relaxed);
+            fprintf(stderr, "Sweep: restoring the biases failed.\n");
+        }
+    }
+
+    void finish(const char *how) {
+        fclose(file);
+        file = NULL;
+        state = IDLE;
+        printf("Sweep %s: %u points, %zu records in %.1f s → %s\n", how, point, recordsWritten,
+               std::chrono::duration<double>(std::chrono::steady_clock::now() - sweepStart).count(),
+               settings.path.c_str());
+    }
+
+    // Touched by the sender thread.
+    std::atomic<int> measuringChip{-1};
+    std::atomic<uint32_t> counts[SWEEP_CORES * SWEEP_NEURONS];
+
+    // Config thread only.
+    State state = IDLE;
+    SweepSettings settings;
+    int biasIds[SWEEP_CORES];
+    uint32_t original[SWEEP_CORES];
+    bool hasOriginal[SWEEP_CORES];
+    Search searches[SWEEP_CORES];
+    Point current;
+    int fineCount = 1;
+    uint32_t point = 0, pointsTotal = 0;
+    size_t recordsWritten = 0;
+    FILE *file = NULL;
+    std::chrono::steady_clock::time_point due, windowStart, sweepStart;
+};
+
+#endif /* DYNAPSE_BIAS_SWEEP_H_ */
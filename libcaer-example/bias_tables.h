@@ -0,0 +1,217 @@
+/*
+ * Bias and parameter tables for the config command path.
+ *
+ * Every bias has a dense id: core biases are core * BIAS_CORE_KINDS + kind
+ * (C0..C3), followed by the six global U/D biases. Parameters, flags and names
+ * are indexed by that id in static arrays, and names are resolved through a
+ * switch on a compile-time FNV-1a hash. The compiler rejects duplicate case
+ * labels, so the hash is perfect for the known names, and a final compare
+ * rejects unknown strings that happen to collide. Nothing on the SET or
+ * PARAM_SET path allocates or walks a tree.
+ *
+ * The tables come from the X-macro lists below; add a bias or parameter there.
+ */
+
+#ifndef DYNAPSE_BIAS_TABLES_H_
+#define DYNAPSE_BIAS_TABLES_H_
+
+#include <libcaer/libcaer.h>
+#include <libcaer/devices/dynapse.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+// X(name, sexN): same flags on every core. typeNormal and biasHigh are always true.
+#define DYNAPSE_CORE_BIASES(X) \
+    X(PULSE_PWLK_P, false)      \
+    X(PS_WEIGHT_INH_S_N, true)  \
+    X(PS_WEIGHT_INH_F_N, true)  \
+    X(PS_WEIGHT_EXC_S_N, true)  \
+    X(PS_WEIGHT_EXC_F_N, true)  \
+    X(IF_RFR_N, true)           \
+    X(IF_TAU1_N, false)         \
+    X(IF_AHTAU_N, true)         \
+    X(IF_CASC_N, true)          \
+    X(IF_TAU2_N, true)          \
+    X(IF_BUF_P, false)          \
+    X(IF_AHTHR_N, true)         \
+    X(IF_THR_N, true)           \
+    X(NPDPIE_THR_S_P, false)    \
+    X(NPDPIE_THR_F_P, false)    \
+    X(NPDPII_THR_F_P, false)    \
+    X(NPDPII_THR_S_P, false)    \
+    X(IF_NMDA_N, true)          \
+    X(IF_DC_P, false)           \
+    X(IF_AHW_P, false)          \
+    X(NPDPII_TAU_S_P, false)    \
+    X(NPDPII_TAU_F_P, false)    \
+    X(NPDPIE_TAU_F_P, false)    \
+    X(NPDPIE_TAU_S_P, false)    \
+    X(R2R_P, false)
+
+#define DYNAPSE_GLOBAL_BIASES(X) \
+    X(U_BUFFER, false)           \
+    X(U_SSP, false)              \
+    X(U_SSN, true)               \
+    X(D_BUFFER, false)           \
+    X(D_SSP, false)              \
+    X(D_SSN, true)
+
+// Parameters accepted by PARAM_SET, as DYNAPSE_CONFIG_<name>.
+#define DYNAPSE_PARAMETERS(X)     \
+    X(CHIP_RUN)                   \
+    X(CHIP_ID)                    \
+    X(CHIP_REQ_DELAY)             \
+    X(CHIP_REQ_EXTENSION)         \
+    X(MUX_RUN)                    \
+    X(MUX_TIMESTAMP_RUN)          \
+    X(MUX_FORCE_CHIP_BIAS_ENABLE) \
+    X(AER_RUN)                    \
+    X(AER_ACK_DELAY)              \
+    X(AER_ACK_EXTENSION)          \
+    X(AER_WAIT_ON_TRANSFER_STALL)
+
+#define BIAS_KIND_ENUM(name, sexN) BIAS_KIND_##name,
+enum BiasKind { DYNAPSE_CORE_BIASES(BIAS_KIND_ENUM) BIAS_CORE_KINDS };
+enum GlobalBias { DYNAPSE_GLOBAL_BIASES(BIAS_KIND_ENUM) BIAS_GLOBAL_KINDS };
+#undef BIAS_KIND_ENUM
+
+#define BIAS_CORES 4
+#define BIAS_COUNT (BIAS_CORES * BIAS_CORE_KINDS + BIAS_GLOBAL_KINDS)
+#define BIAS_NAME_MAX 32
+
+#define BIAS_NAME(name, sexN) #name,
+#define BIAS_SEXN(name, sexN) sexN,
+static const char *const coreBiasNames[BIAS_CORE_KINDS] = {DYNAPSE_CORE_BIASES(BIAS_NAME)};
+static const char *const globalBiasNames[BIAS_GLOBAL_KINDS] = {DYNAPSE_GLOBAL_BIASES(BIAS_NAME)};
+static const bool coreBiasSexN[BIAS_CORE_KINDS] = {DYNAPSE_CORE_BIASES(BIAS_SEXN)};
+static const bool globalBiasSexN[BIAS_GLOBAL_KINDS] = {DYNAPSE_GLOBAL_BIASES(BIAS_SEXN)};
+#undef BIAS_NAME
+#undef BIAS_SEXN
+
+#define BIAS_PARAM_C0(name, sexN) DYNAPSE_CONFIG_BIAS_C0_##name,
+#define BIAS_PARAM_C1(name, sexN) DYNAPSE_CONFIG_BIAS_C1_##name,
+#define BIAS_PARAM_C2(name, sexN) DYNAPSE_CONFIG_BIAS_C2_##name,
+#define BIAS_PARAM_C3(name, sexN) DYNAPSE_CONFIG_BIAS_C3_##name,
+#define BIAS_PARAM_GLOBAL(name, sexN) DYNAPSE_CONFIG_BIAS_##name,
+static const uint8_t biasParams[BIAS_COUNT] = {
+    DYNAPSE_CORE_BIASES(BIAS_PARAM_C0) DYNAPSE_CORE_BIASES(BIAS_PARAM_C1) DYNAPSE_CORE_BIASES(BIAS_PARAM_C2)
+    DYNAPSE_CORE_BIASES(BIAS_PARAM_C3) DYNAPSE_GLOBAL_BIASES(BIAS_PARAM_GLOBAL)};
+#undef BIAS_PARAM_C0
+#undef BIAS_PARAM_C1
+#undef BIAS_PARAM_C2
+#undef BIAS_PARAM_C3
+#undef BIAS_PARAM_GLOBAL
+
+// FNV-1a, usable in case labels.
+constexpr uint32_t tableHash(const char *s, size_t len, uint32_t hash = 2166136261u) {
+    return (len == 0) ? hash : tableHash(s + 1, len - 1, (hash ^ static_cast<uint8_t>(*s)) * 16777619u);
+}
+#define TABLE_HASH(literal) tableHash(literal, sizeof(literal) - 1)
+
+static inline bool tableNameIs(const char *name, size_t len, const char *expected) {
+    return strlen(expected) == len && memcmp(name, expected, len) == 0;
+}
+
+// "IF_DC_P" → BIAS_KIND_IF_DC_P, -1 if unknown.
+static inline int lookupCoreBiasKind(const char *name, size_t len) {
+    int kind = -1;
+    switch (tableHash(name, len)) {
+#define BIAS_CASE(name, sexN) \
+    case TABLE_HASH(#name): kind = BIAS_KIND_##name; break;
+        DYNAPSE_CORE_BIASES(BIAS_CASE)
+#undef BIAS_CASE
+        default: return -1;
+    }
+    return tableNameIs(name, len, coreBiasNames[kind]) ? kind : -1;
+}
+
+static inline int lookupGlobalBias(const char *name, size_t len) {
+    int global = -1;
+    switch (tableHash(name, len)) {
+#define BIAS_CASE(name, sexN) \
+    case TABLE_HASH(#name): global = BIAS_KIND_##name; break;
+        DYNAPSE_GLOBAL_BIASES(BIAS_CASE)
+#undef BIAS_CASE
+        default: return -1;
+    }
+    return tableNameIs(name, len, globalBiasNames[global]) ? global : -1;
+}
+
+static inline int coreBiasId(int core, int kind) { return core * BIAS_CORE_KINDS + kind; }
+static inline int globalBiasId(int global) { return BIAS_CORES * BIAS_CORE_KINDS + global; }
+
+// Full name ("C2_IF_DC_P", "U_SSP") → bias id, -1 if unknown.
+static inline int lookupBias(const char *name, size_t len) {
+    if (len > 3 && name[0] == 'C' && name[1] >= '0' && name[1] < '0' + BIAS_CORES && name[2] == '_') {
+        int kind = lookupCoreBiasKind(name + 3, len - 3);
+        return (kind < 0) ? -1 : coreBiasId(name[1] - '0', kind);
+    }
+    int global = lookupGlobalBias(name, len);
+    return (global < 0) ? -1 : globalBiasId(global);
+}
+
+// SET semantics: a per-core name ("IF_DC_P") is taken on the given core,
+// full names and U/D biases as they are.
+static inline int lookupBiasOnCore(int core, const char *name, size_t len) {
+    if (core >= 0 && core < BIAS_CORES) {
+        int kind = lookupCoreBiasKind(name, len);
+        if (kind >= 0) {
+            return coreBiasId(core, kind);
+        }
+    }
+    return lookupBias(name, len);
+}
+
+static inline bool isGlobalBias(int biasId) { return biasId >= BIAS_CORES * BIAS_CORE_KINDS; }
+
+static inline uint8_t biasParam(int biasId) { return biasParams[biasId]; }
+
+static inline bool biasSexN(int biasId) {
+    return isGlobalBias(biasId) ? globalBiasSexN[biasId - BIAS_CORES * BIAS_CORE_KINDS]
+                                : coreBiasSexN[biasId % BIAS_CORE_KINDS];
+}
+
+// Writes the full name into buf (at least BIAS_NAME_MAX bytes).
+static inline const char *biasName(int biasId, char *buf) {
+    if (isGlobalBias(biasId)) {
+        snprintf(buf, BIAS_NAME_MAX, "%s", globalBiasNames[biasId - BIAS_CORES * BIAS_CORE_KINDS]);
+    }
+    else {
+        snprintf(buf, BIAS_NAME_MAX, "C%d_%s", biasId / BIAS_CORE_KINDS, coreBiasNames[biasId % BIAS_CORE_KINDS]);
+    }
+    return buf;
+}
+
+// CHIP_CONTENT word for a bias id, as the former biasFlagMap entries produced it.
+static inline uint32_t biasWord(int biasId, int coarse, int fine) {
+    struct caer_bias_dynapse biasStruct;
+    biasStruct.biasAddress = biasParam(biasId);
+    biasStruct.coarseValue = static_cast<uint8_t>(coarse);
+    biasStruct.fineValue = static_cast<uint8_t>(fine);
+    biasStruct.enabled = true;
+    biasStruct.sexN = biasSexN(biasId);
+    biasStruct.typeNormal = true;
+    biasStruct.biasHigh = true;
+    return caerBiasDynapseGenerate(biasStruct);
+}
+
+// PARAM_SET name ("CHIP_ID") → DYNAPSE_CONFIG_CHIP_ID, -1 if unknown.
+static inline int lookupParameter(const char *name, size_t len) {
+    const char *expected;
+    int param;
+    switch (tableHash(name, len)) {
+#define PARAM_CASE(name)          \
+    case TABLE_HASH(#name):       \
+        expected = #name;         \
+        param = DYNAPSE_CONFIG_##name; \
+        break;
+        DYNAPSE_PARAMETERS(PARAM_CASE)
+#undef PARAM_CASE
+        default: return -1;
+    }
+    return tableNameIs(name, len, expected) ? param : -1;
+}
+
+#endif /* DYNAPSE_BIAS_TABLES_H_ */
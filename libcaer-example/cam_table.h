@@ -0,0 +1,200 @@
+/*
+ * Bulk CAM programming.
+ *
+ * A CAM table lists one synapse per entry:
+ *
+ *   <chip> <input neuron> <target neuron> <cam id> <synapse type>
+ *
+ * with chip U0-U3 (or its chip id 0/8/4/12), neurons as core * 256 + neuron
+ * (0-1023, as for CAM_SET), cam id 0-63 and synapse type 0-3
+ * (DYNAPSE_CONFIG_CAMTYPE_*). Files hold one entry per line, '#' starts a
+ * comment; inline tables separate entries with ';'.
+ *
+ * Entries are turned into CHIP_CONTENT words with caerDynapseGenerateCamBits(),
+ * grouped by chip, and each chip's words go out in one multi-word USB
+ * transfer after a single CHIP_ID switch, instead of one control transfer
+ * per synapse. CAMs the shadow already holds are not sent again.
+ */
+
+#ifndef DYNAPSE_CAM_TABLE_H_
+#define DYNAPSE_CAM_TABLE_H_
+
+#include "device_shadow.h"
+#include "dynapse_device.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define CAM_NEURONS 1024
+#define CAM_LINE_MAX 256
+
+struct CamEntry {
+    uint8_t chipId;
+    uint16_t inputNeuron;
+    uint16_t neuronAddr;
+    uint8_t camId;
+    uint8_t synapseType;
+};
+
+struct CamProgramReport {
+    size_t entries = 0;
+    size_t present = 0; // skipped, the shadow already holds them
+    size_t chips = 0;
+    double us = 0;
+
+    double entriesPerSecond() const { return (us > 0) ? entries * 1e6 / us : 0.0; }
+};
+
+// Index into the shadow's CAM table.
+static inline int camCell(const CamEntry &entry) { return entry.neuronAddr * 64 + entry.camId; }
+
+// "U2" or "4" → DYNAPSE_CONFIG_DYNAPSE_U2. Advances *text past the chip.
+static inline bool parseChipId(const char **text, uint32_t *chipId) {
+    const char *s = *text;
+    while (*s == ' ' || *s == '\t') s++;
+    char *end;
+    if (s[0] == 'U' && s[1] >= '0' && s[1] <= '3') {
+        static const uint32_t chipIds[4] = {DYNAPSE_CONFIG_DYNAPSE_U0, DYNAPSE_CONFIG_DYNAPSE_U1,
+                                            DYNAPSE_CONFIG_DYNAPSE_U2, DYNAPSE_CONFIG_DYNAPSE_U3};
+        *chipId = chipIds[s[1] - '0'];
+        end = const_cast<char *>(s + 2);
+    }
+    else {
+        *chipId = static_cast<uint32_t>(strtoul(s, &end, 10));
+        if (end == s) return false;
+    }
+    *text = end;
+    return shadowChipSlot(*chipId) >= 0;
+}
+
+// Fields: input neuron, target neuron, CAM, synapse type.
+static inline bool makeCamEntry(uint32_t chipId, const long values[4], CamEntry &entry) {
+    if (shadowChipSlot(chipId) < 0 || values[0] < 0 || values[0] >= CAM_NEURONS || values[1] < 0
+        || values[1] >= CAM_NEURONS || values[2] < 0 || values[2] >= DYNAPSE_CONFIG_NUMCAM || values[3] < 0
+        || values[3] > 3) {
+        return false;
+    }
+    entry.chipId = static_cast<uint8_t>(chipId);
+    entry.inputNeuron = static_cast<uint16_t>(values[0]);
+    entry.neuronAddr = static_cast<uint16_t>(values[1]);
+    entry.camId = static_cast<uint8_t>(values[2]);
+    entry.synapseType = static_cast<uint8_t>(values[3]);
+    return true;
+}
+
+// Parses one entry; text may continue after it (';' or a comment).
+static inline bool parseCamEntry(const char *text, CamEntry &entry, const char **rest = NULL) {
+    uint32_t chipId;
+    if (!parseChipId(&text, &chipId)) {
+        return false;
+    }
+    long values[4];
+    for (int i = 0; i < 4; i++) {
+        char *end;
+        values[i] = strtol(text, &end, 10);
+        if (end == text) return false;
+        text = end;
+    }
+    if (!makeCamEntry(chipId, values, entry)) {
+        return false;
+    }
+    if (rest != NULL) *rest = text;
+    return true;
+}
+
+static inline bool isBlank(const char *s) {
+    while (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n') s++;
+    return *s == '\0' || *s == '#';
+}
+
+// Whole file or nothing: a network with missing synapses is worse than the old one.
+static inline bool loadCamFile(const std::string &path, std::vector<CamEntry> &entries) {
+    FILE *file = fopen(path.c_str(), "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening CAM table: %s\n", path.c_str());
+        return false;
+    }
+    char line[CAM_LINE_MAX];
+    int lineNumber = 0, invalid = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        lineNumber++;
+        if (isBlank(line)) continue;
+        CamEntry entry;
+        const char *rest;
+        if (!parseCamEntry(line, entry, &rest) || !isBlank(rest)) {
+            if (invalid++ < 10) fprintf(stderr, "%s:%d: invalid CAM entry: %s", path.c_str(), lineNumber, line);
+            continue;
+        }
+        entries.push_back(entry);
+    }
+    fclose(file);
+    if (invalid > 0) {
+        fprintf(stderr, "%s: %d invalid CAM entries, table not loaded.\n", path.c_str(), invalid);
+        return false;
+    }
+    return true;
+}
+
+// "U0 1 2 3 0; U1 4 5 6 1; ..." Returns false on the first invalid entry.
+static inline bool parseCamTable(const char *text, std::vector<CamEntry> &entries) {
+    while (!isBlank(text)) {
+        CamEntry entry;
+        if (!parseCamEntry(text, entry, &text)) {
+            return false;
+        }
+        entries.push_back(entry);
+        while (*text == ' ' || *text == '\t') text++;
+        if (*text == ';') text++;
+        else if (!isBlank(text)) return false;
+    }
+    return true;
+}
+
+// Leaves the last programmed chip selected. CAMs the shadow already holds are
+// skipped; shadow may be NULL.
+static inline bool programCamTable(DynapseDevice *handle, ShadowDynapseDevice *shadow,
+                                   const std::vector<CamEntry> &entries, CamProgramReport &report) {
+    auto start = std::chrono::steady_clock::now();
+    report = CamProgramReport();
+    std::vector<uint32_t> words[SHADOW_CHIPS];
+    std::vector<const CamEntry *> written[SHADOW_CHIPS];
+    for (const CamEntry &entry : entries) {
+        int slot = shadowChipSlot(entry.chipId);
+        uint32_t word = caerDynapseGenerateCamBits(entry.inputNeuron, entry.neuronAddr, entry.camId, entry.synapseType);
+        report.entries++;
+        if (shadow != NULL && shadow->camPresent(entry.chipId, camCell(entry), word)) {
+            report.present++;
+            continue;
+        }
+        words[slot].push_back(word);
+        written[slot].push_back(&entry);
+    }
+
+    bool ok = true;
+    for (int slot = 0; slot < SHADOW_CHIPS; slot++) {
+        if (words[slot].empty()) continue;
+        bool chipOk = handle->configSet(DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, static_cast<uint32_t>(slot << 2));
+        if (chipOk && !handle->sendDataToUSB(words[slot].data(), words[slot].size())) {
+            for (uint32_t word : words[slot]) {
+                chipOk = handle->configSet(DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_CONTENT, word) && chipOk;
+            }
+        }
+        // Only what surely reached the chip may be skipped next time.
+        for (size_t i = 0; shadow != NULL && i < written[slot].size(); i++) {
+            const CamEntry &entry = *written[slot][i];
+            if (chipOk) shadow->rememberCam(entry.chipId, camCell(entry), words[slot][i]);
+            else shadow->forgetCam(entry.chipId, camCell(entry));
+        }
+        report.chips++;
+        ok = chipOk && ok;
+    }
+    report.us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    return ok;
+}
+
+#endif /* DYNAPSE_CAM_TABLE_H_ */
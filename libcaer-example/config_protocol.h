@@ -0,0 +1,271 @@
+/*
+ * Config port (9002) framing.
+ *
+ * A connection carries a stream of commands in either of two framings, which
+ * may be mixed; the command grammar ("SET 0 IF_DC_P 3 100", ...) is the same.
+ *
+ *   BINARY - ConfigFrameHeader (magic "DYCF", requestId, length) followed by
+ *            length bytes of command text. Every frame is answered with a
+ *            ConfigAckHeader (magic "DYCA", requestId, status 0 = ok,
+ *            elapsedUs, messageLength) followed by the error message, if any.
+ *   TEXT   - newline terminated lines. "#<id> <command>" is answered with
+ *            "OK <id> <elapsedUs>\n" or "ERR <id> <elapsedUs> <message>\n";
+ *            lines without an id get no reply, as before. A legacy client
+ *            that sends one command per write without a newline is still
+ *            served: a trailing unterminated line is run once the socket has
+ *            been idle for CONFIG_LEGACY_IDLE_MS.
+ *
+ * Commands are executed in order and acks are batched per read, so clients
+ * can pipeline thousands of commands without waiting for each reply. Register
+ * writes within one read are merged and prioritised first (config_queue.h).
+ */
+
+#ifndef DYNAPSE_CONFIG_PROTOCOL_H_
+#define DYNAPSE_CONFIG_PROTOCOL_H_
+
+#include "spike_stream.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define CONFIG_FRAME_MAGIC 0x46435944 // "DYCF" on the wire
+#define CONFIG_ACK_MAGIC 0x41435944   // "DYCA" on the wire
+#define CONFIG_MAX_COMMAND (1 << 20) // room for an inline CAM table
+#define CONFIG_LEGACY_IDLE_MS 20
+
+#pragma pack(push, 1)
+struct ConfigFrameHeader {
+    uint32_t magic;
+    uint32_t requestId;
+    uint32_t length; // command bytes following this header
+};
+
+struct ConfigAckHeader {
+    uint32_t magic;
+    uint32_t requestId;
+    int32_t status;         // 0 = ok, -1 = error
+    uint32_t elapsedUs;     // time spent executing the command
+    uint32_t messageLength; // error message bytes following this header
+};
+#pragma pack(pop)
+
+static_assert(sizeof(ConfigFrameHeader) == 12, "ConfigFrameHeader must stay 12 bytes");
+static_assert(sizeof(ConfigAckHeader) == 20, "ConfigAckHeader must stay 20 bytes");
+
+struct ConfigRequest {
+    uint32_t id = 0;
+    bool wantsAck = false;
+    bool binary = false;
+    char *command = nullptr; // NUL terminated, valid until the next next()/receive()
+};
+
+// Outcome of one command. fail() also reports the error on stderr, as the
+// handlers always did.
+struct ConfigResult {
+    bool ok = true;
+    char message[160];
+
+    ConfigResult() { message[0] = '\0'; }
+
+    bool fail(const char *format, ...) {
+        va_list args;
+        va_start(args, format);
+        vsnprintf(message, sizeof(message), format, args);
+        va_end(args);
+        fprintf(stderr, "%s\n", message);
+        ok = false;
+        return false;
+    }
+};
+
+struct ConfigStats {
+    std::atomic<uint64_t> commands{0};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> totalUs{0};
+    std::atomic<uint64_t> maxUs{0};
+
+    void add(bool ok, uint32_t us) {
+        commands.fetch_add(1, std::memory_order_relaxed);
+        if (!ok) errors.fetch_add(1, std::memory_order_relaxed);
+        totalUs.fetch_add(us, std::memory_order_relaxed);
+        uint64_t prevMax = maxUs.load(std::memory_order_relaxed);
+        while (us > prevMax && !maxUs.compare_exchange_weak(prevMax, us, std::memory_order_relaxed)) {
+        }
+    }
+
+    void print() const {
+        uint64_t n = commands.load();
+        printf("Config: %llu commands, %llu errors, mean %.1f us, max %llu us.\n", (unsigned long long) n,
+               (unsigned long long) errors.load(), n ? static_cast<double>(totalUs.load()) / n : 0.0,
+               (unsigned long long) maxUs.load());
+    }
+};
+
+class ConfigConnection {
+public:
+    explicit ConfigConnection(int fd) : fd(fd) {}
+
+    int socket() const { return fd; }
+
+    // Reads what is available. Returns false when the client is gone.
+    bool receive() {
+        compact();
+        char buf[16384];
+        ssize_t len = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (len == 0 || (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            return false;
+        }
+        if (len > 0) {
+            rx.insert(rx.end(), buf, buf + len);
+        }
+        return true;
+    }
+
+    // Next complete command, if any.
+    bool next(ConfigRequest &request) {
+        request = ConfigRequest();
+        size_t avail = rx.size() - rxOffset;
+        char *head = rx.data() + rxOffset;
+
+        uint32_t magic = 0;
+        if (avail >= sizeof(magic)) {
+            memcpy(&magic, head, sizeof(magic));
+        }
+        if (magic == CONFIG_FRAME_MAGIC) {
+            if (avail < sizeof(ConfigFrameHeader)) {
+                return false;
+            }
+            ConfigFrameHeader header;
+            memcpy(&header, head, sizeof(header));
+            if (header.length > CONFIG_MAX_COMMAND) {
+                // Cannot resync inside a corrupt binary stream.
+                fprintf(stderr, "Config frame of %u bytes rejected, dropping buffered input.\n", header.length);
+                rx.clear();
+                rxOffset = 0;
+                return false;
+            }
+            if (avail < sizeof(header) + header.length) {
+                return false;
+            }
+            // Shift the command over the header so it can be NUL terminated in place.
+            memmove(head, head + sizeof(header), header.length);
+            head[header.length] = '\0';
+            rxOffset += sizeof(header) + header.length;
+            request.id = header.requestId;
+            request.wantsAck = true;
+            request.binary = true;
+            request.command = head;
+            return true;
+        }
+
+        char *newline = static_cast<char *>(memchr(head, '\n', avail));
+        if (newline == nullptr) {
+            if (avail > CONFIG_MAX_COMMAND) {
+                fprintf(stderr, "Config line longer than %d bytes, dropped.\n", CONFIG_MAX_COMMAND);
+                rx.clear();
+                rxOffset = 0;
+            }
+            return false;
+        }
+        *newline = '\0';
+        if (newline > head && newline[-1] == '\r') {
+            newline[-1] = '\0';
+        }
+        rxOffset += static_cast<size_t>(newline - head) + 1;
+        parseTextLine(head, request);
+        return true;
+    }
+
+    // Legacy framing: the rest of the buffer as one command, once the client paused.
+    bool takeUnterminated(ConfigRequest &request) {
+        request = ConfigRequest();
+        size_t avail = rx.size() - rxOffset;
+        if (avail == 0 || avail > CONFIG_MAX_COMMAND || startsWithFrameMagic()) {
+            return false;
+        }
+        rx.push_back('\0');
+        char *head = rx.data() + rxOffset;
+        rxOffset = rx.size();
+        parseTextLine(head, request);
+        return true;
+    }
+
+    bool hasPending() const { return rx.size() > rxOffset; }
+
+    void ack(const ConfigRequest &request, const ConfigResult &result, uint32_t elapsedUs) {
+        if (!request.wantsAck) {
+            return;
+        }
+        if (request.binary) {
+            ConfigAckHeader header;
+            header.magic = CONFIG_ACK_MAGIC;
+            header.requestId = request.id;
+            header.status = result.ok ? 0 : -1;
+            header.elapsedUs = elapsedUs;
+            header.messageLength = result.ok ? 0 : static_cast<uint32_t>(strlen(result.message));
+            tx.append(reinterpret_cast<const char *>(&header), sizeof(header));
+            tx.append(result.message, header.messageLength);
+        }
+        else {
+            char line[224];
+            int n = result.ok ? snprintf(line, sizeof(line), "OK %u %u\n", request.id, elapsedUs)
+                              : snprintf(line, sizeof(line), "ERR %u %u %s\n", request.id, elapsedUs, result.message);
+            tx.append(line, static_cast<size_t>(std::min<int>(n, sizeof(line) - 1)));
+        }
+    }
+
+    // Sends the acks collected so far. Returns false when the client is gone.
+    bool flush() {
+        if (tx.empty()) {
+            return true;
+        }
+        bool ok = sendAll(fd, reinterpret_cast<const uint8_t *>(tx.data()), tx.size());
+        tx.clear();
+        return ok;
+    }
+
+private:
+    int fd;
+    std::vector<char> rx;
+    size_t rxOffset = 0;
+    std::string tx;
+
+    void compact() {
+        if (rxOffset > 0) {
+            rx.erase(rx.begin(), rx.begin() + static_cast<std::ptrdiff_t>(rxOffset));
+            rxOffset = 0;
+        }
+    }
+
+    bool startsWithFrameMagic() const {
+        static const char magic[4] = {'D', 'Y', 'C', 'F'};
+        size_t avail = rx.size() - rxOffset;
+        return memcmp(rx.data() + rxOffset, magic, std::min<size_t>(avail, 4)) == 0;
+    }
+
+    static void parseTextLine(char *line, ConfigRequest &request) {
+        if (line[0] == '#') {
+            char *end;
+            request.id = static_cast<uint32_t>(strtoul(line + 1, &end, 10));
+            request.wantsAck = end != line + 1;
+            line = end;
+        }
+        while (*line == ' ' || *line == '\t') {
+            line++;
+        }
+        request.command = line;
+    }
+};
+
+#endif /* DYNAPSE_CONFIG_PROTOCOL_H_ */
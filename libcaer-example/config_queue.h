@@ -0,0 +1,145 @@
+/*
+ * Coalescing queue for the register writes of the config port.
+ *
+ * A GUI slider sends a burst of SETs for one bias, and while the device is
+ * busy with one write the socket fills up with the next ones. The config
+ * thread therefore queues SET, MONITOR_SET and PARAM_SET of the plain value
+ * registers (*_DELAY, *_EXTENSION) instead of running them one by one: a
+ * write to the same (type, chip, address) as a queued one replaces its
+ * value, so only the latest value reaches the device. The slower the device,
+ * the more a read carries and the more gets merged; an idle device sees
+ * every write as before.
+ *
+ * The queue is drained at the end of every read, and before any other
+ * command (LOAD, CAM_LOAD, CHIP_ID, the *_RUN switches, ...), which is
+ * applied in order after it. Draining goes by type, then arrival:
+ *   PARAMETER - FPGA handshake timing registers
+ *   BIAS      - CHIP_CONTENT bias words, what interactive tuning changes
+ *   MONITOR   - neuron monitor selection
+ * Every device write is timed. Each request is acked with the result of the
+ * write that carried it; a superseded request reports 0 us.
+ */
+
+#ifndef DYNAPSE_CONFIG_QUEUE_H_
+#define DYNAPSE_CONFIG_QUEUE_H_
+
+#include "config_protocol.h"
+#include "dynapse_device.h"
+#include "latency_stats.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <unordered_map>
+#include <vector>
+
+enum ConfigWriteType : uint8_t {
+    CONFIG_WRITE_PARAMETER = 0,
+    CONFIG_WRITE_BIAS = 1,
+    CONFIG_WRITE_MONITOR = 2,
+    CONFIG_WRITE_TYPES = 3,
+};
+
+struct ConfigWrite {
+    uint8_t type = CONFIG_WRITE_PARAMETER; // ConfigWriteType, also the drain priority
+    int chipId = -1;                      // selected chip when queued
+    uint16_t address = 0;                 // merge key within type and chip
+    uint8_t module = 0;
+    uint8_t param = 0;
+    uint32_t value = 0;
+    int biasId = -1; // BIAS: for messages
+    int coarse = 0, fine = 0;
+    // Set by drain().
+    bool ok = false;
+    uint32_t us = 0;
+    uint32_t requests = 0; // requests merged into this write
+};
+
+// One request waiting for its write.
+struct QueuedConfigRequest {
+    ConfigRequest request; // command is not kept
+    size_t write;
+    int64_t receivedNs;
+    bool superseded; // a later request of the same read set the value
+};
+
+class ConfigWriteQueue {
+public:
+    std::atomic<uint64_t> requestsQueued{0};
+    std::atomic<uint64_t> writesCoalesced{0};
+    std::atomic<uint64_t> writesApplied{0};
+    std::atomic<uint64_t> writesFailed{0};
+
+    bool empty() const { return requests.empty(); }
+
+    void add(const ConfigRequest &request, const ConfigWrite &write, int64_t receivedNs) {
+        uint64_t key = (static_cast<uint64_t>(write.type) << 40) | (static_cast<uint64_t>(write.chipId & 0xFF) << 32)
+                       | (static_cast<uint64_t>(write.module) << 24) | write.address;
+        auto found = byKey.find(key);
+        size_t slot;
+        if (found == byKey.end()) {
+            slot = writes.size();
+            writes.push_back(write);
+            byKey[key] = slot;
+        }
+        else {
+            slot = found->second;
+            uint32_t merged = writes[slot].requests;
+            writes[slot] = write;
+            writes[slot].requests = merged;
+            requests[lastRequest[slot]].superseded = true;
+            writesCoalesced.fetch_add(1, std::memory_order_relaxed);
+        }
+        writes[slot].requests++;
+        lastRequest.resize(writes.size());
+        lastRequest[slot] = requests.size();
+
+        QueuedConfigRequest queued;
+        queued.request = request;
+        queued.request.command = nullptr;
+        queued.write = slot;
+        queued.receivedNs = receivedNs;
+        queued.superseded = false;
+        requests.push_back(queued);
+        requestsQueued.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Applies the latest value of every queued write, highest priority type first.
+    void drain(DynapseDevice *handle, LatencyHistogram &latency) {
+        for (uint8_t type = 0; type < CONFIG_WRITE_TYPES; type++) {
+            for (ConfigWrite &write : writes) {
+                if (write.type != type) continue;
+                int64_t startNs = latencyNowNs();
+                write.ok = handle->configSet(write.module, write.param, write.value);
+                uint64_t ns = static_cast<uint64_t>(latencyNowNs() - startNs);
+                latency.record(ns);
+                write.us = static_cast<uint32_t>(ns / 1000);
+                (write.ok ? writesApplied : writesFailed).fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    const std::vector<ConfigWrite> &queuedWrites() const { return writes; }
+    const std::vector<QueuedConfigRequest> &queuedRequests() const { return requests; }
+
+    void clear() {
+        writes.clear();
+        requests.clear();
+        lastRequest.clear();
+        byKey.clear();
+    }
+
+    void printStats() const {
+        printf("Config writes: %llu queued, %llu superseded, %llu applied, %llu failed.\n",
+               (unsigned long long) requestsQueued.load(), (unsigned long long) writesCoalesced.load(),
+               (unsigned long long) writesApplied.load(), (unsigned long long) writesFailed.load());
+    }
+
+private:
+    std::vector<ConfigWrite> writes;
+    std::vector<QueuedConfigRequest> requests;
+    std::vector<size_t> lastRequest; // by write: the request whose value it holds
+    std::unordered_map<uint64_t, size_t> byKey;
+};
+
+#endif /* DYNAPSE_CONFIG_QUEUE_H_ */
@@ -0,0 +1,343 @@
+/*
+ * Per-chip shadow of the configuration held by the chips.
+ *
+ * ShadowDynapseDevice wraps another DynapseDevice and follows CHIP_ID writes,
+ * so it knows which chip (U0-U3) every write goes to. It remembers what each
+ * chip holds and drops writes that would not change anything:
+ *   - CHIP_CONTENT bias words, per bias address,
+ *   - CAM entries written with writeCam(), per neuron and CAM,
+ *   - neuron monitors (MONITOR_NEU), per core,
+ *   - the DEFAULT_SRAM section, once per chip.
+ * Loading a preset therefore only costs the words that differ from what the
+ * chip already holds, and a warm start restored from a snapshot
+ * (device_snapshot.h) skips what is still in place.
+ *
+ * Words are filtered in order, so a file that writes the same address twice
+ * still ends in the same state; within one bulk transfer only the last word
+ * per bias address is sent. Until a CHIP_ID is written everything is
+ * passed through. Stopping the chips (CHIP_RUN false, or starting them when
+ * their state is unknown) forgets all chips, since it resets them.
+ *
+ * Routing SRAM and bulk CAM words cannot be told apart reliably inside the
+ * CHIP_CONTENT stream, so the table loaders record them explicitly
+ * (rememberRoute, rememberCam) and ask routePresent()/camPresent() before
+ * writing. FPGA registers (MUX, AER, CHIP_* other than the above) are always
+ * passed through: libcaer changes them itself on data start/stop.
+ */
+
+#ifndef DYNAPSE_DEVICE_SHADOW_H_
+#define DYNAPSE_DEVICE_SHADOW_H_
+
+#include "dynapse_device.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#define SHADOW_CHIPS 4
+#define SHADOW_CORES 4
+#define SHADOW_BIAS_ADDRESSES 128
+#define SHADOW_SRAM_ENTRIES (1024 * 4) // 4 SRAM cells per neuron
+#define SHADOW_CAM_ENTRIES (1024 * 64) // 64 CAMs per neuron
+#define SHADOW_BIAS_WORD_FLAG (1u << 16) // set in every caerBiasDynapseGenerate() word
+#define SHADOW_CAM_WORD_FLAG (1u << 17)  // set in every caerDynapseGenerateCamBits() word, which may also carry bit 16
+
+// Last known word per address of one chip memory.
+struct ShadowTable {
+    std::vector<uint32_t> words;
+    std::vector<uint8_t> known;
+
+    explicit ShadowTable(size_t size) : words(size, 0), known(size, 0) {}
+
+    size_t size() const { return words.size(); }
+
+    bool has(size_t index, uint32_t word) const { return known[index] && words[index] == word; }
+
+    void set(size_t index, uint32_t word) {
+        words[index] = word;
+        known[index] = 1;
+    }
+
+    void forget(size_t index) { known[index] = 0; }
+
+    void clear() {
+        std::fill(words.begin(), words.end(), 0);
+        std::fill(known.begin(), known.end(), 0);
+    }
+};
+
+struct ChipShadow {
+    ShadowTable biases{SHADOW_BIAS_ADDRESSES}; // by bias address
+    ShadowTable routes{SHADOW_SRAM_ENTRIES};   // by neuronId * 4 + sramId
+    ShadowTable cams{SHADOW_CAM_ENTRIES};      // by neuronId * 64 + camId
+    int32_t monitors[SHADOW_CORES];            // monitored neuron per core, -1 if unknown
+    bool defaultSram = false;                  // DEFAULT_SRAM applied since the last reset
+
+    ChipShadow() { clear(); }
+
+    void clear() {
+        biases.clear();
+        routes.clear();
+        cams.clear();
+        for (int32_t &monitor : monitors) {
+            monitor = -1;
+        }
+        defaultSram = false;
+    }
+};
+
+static inline bool isBiasWord(uint32_t word) {
+    return (word & (SHADOW_BIAS_WORD_FLAG | SHADOW_CAM_WORD_FLAG)) == SHADOW_BIAS_WORD_FLAG;
+}
+static inline uint8_t biasWordAddress(uint32_t word) { return static_cast<uint8_t>((word >> 18) & 0x7F); }
+
+// U0 = 0, U2 = 4, U1 = 8, U3 = 12 → slot 0..3; -1 for anything else.
+static inline int shadowChipSlot(uint32_t chipId) {
+    return (chipId <= DYNAPSE_CONFIG_DYNAPSE_U3 && (chipId & 0x03) == 0) ? static_cast<int>(chipId >> 2) : -1;
+}
+
+class ShadowDynapseDevice : public DynapseDevice {
+public:
+    uint64_t wordsWritten = 0, wordsSkipped = 0; // CHIP_CONTENT words
+    uint64_t writesSkipped = 0;                  // CAM, monitor, CHIP_RUN and DEFAULT_SRAM writes
+
+    // Takes ownership of the wrapped device.
+    explicit ShadowDynapseDevice(DynapseDevice *inner) : inner(inner) {}
+    ~ShadowDynapseDevice() override { delete inner; }
+
+    DynapseDevice *wrapped() const { return inner; }
+
+    int selectedChip() const { return selectedChipId; }
+
+    // State of a chip as last written, NULL if the chip id is not U0-U3.
+    const ChipShadow *chipShadow(uint32_t chipId) const {
+        int slot = shadowChipSlot(chipId);
+        return (slot < 0) ? NULL : &chips[slot];
+    }
+
+    // For snapshots: slot 0..3 as in shadowChipSlot().
+    ChipShadow &chipSlot(int slot) { return chips[slot]; }
+    const ChipShadow &chipSlot(int slot) const { return chips[slot]; }
+
+    // The chips are known to be running with the shadowed state (warm start).
+    void assumeRunning() { chipRun = 1; }
+
+    // Forget everything, e.g. after the board was reset behind our back.
+    void invalidate() {
+        for (ChipShadow &chip : chips) {
+            chip.clear();
+        }
+        chipRun = -1;
+    }
+
+    bool routePresent(uint32_t chipId, int cell, uint32_t word) const {
+        int slot = shadowChipSlot(chipId);
+        return slot >= 0 && chips[slot].routes.has(cell, word);
+    }
+    void rememberRoute(uint32_t chipId, int cell, uint32_t word) {
+        int slot = shadowChipSlot(chipId);
+        if (slot >= 0) chips[slot].routes.set(cell, word);
+    }
+    void forgetRoute(uint32_t chipId, int cell) {
+        int slot = shadowChipSlot(chipId);
+        if (slot >= 0) chips[slot].routes.forget(cell);
+    }
+
+    bool camPresent(uint32_t chipId, int cell, uint32_t word) const {
+        int slot = shadowChipSlot(chipId);
+        return slot >= 0 && chips[slot].cams.has(cell, word);
+    }
+    void rememberCam(uint32_t chipId, int cell, uint32_t word) {
+        int slot = shadowChipSlot(chipId);
+        if (slot >= 0) chips[slot].cams.set(cell, word);
+    }
+    void forgetCam(uint32_t chipId, int cell) {
+        int slot = shadowChipSlot(chipId);
+        if (slot >= 0) chips[slot].cams.forget(cell);
+    }
+
+    struct caer_dynapse_info info() override { return inner->info(); }
+
+    bool configSet(int8_t modAddr, uint8_t paramAddr, uint32_t param) override {
+        ChipShadow *chip = selected();
+        if (modAddr == DYNAPSE_CONFIG_CHIP) {
+            if (paramAddr == DYNAPSE_CONFIG_CHIP_ID) {
+                selectedChipId = (shadowChipSlot(param) < 0) ? -1 : static_cast<int>(param);
+            }
+            else if (paramAddr == DYNAPSE_CONFIG_CHIP_RUN) {
+                if (param && chipRun == 1) {
+                    writesSkipped++;
+                    return true;
+                }
+                invalidate();
+                chipRun = param ? 1 : 0;
+            }
+            else if (paramAddr == DYNAPSE_CONFIG_CHIP_CONTENT) {
+                if (!track(param)) {
+                    wordsSkipped++;
+                    return true;
+                }
+                if (!inner->configSet(modAddr, paramAddr, param)) {
+                    // Not on the chip: a retry or a fallback write must not be filtered out.
+                    untrack(param);
+                    return false;
+                }
+                return true;
+            }
+        }
+        else if (modAddr == DYNAPSE_CONFIG_MONITOR_NEU && chip != NULL && paramAddr < SHADOW_CORES) {
+            if (chip->monitors[paramAddr] == static_cast<int32_t>(param)) {
+                writesSkipped++;
+                return true;
+            }
+            chip->monitors[paramAddr] = -1;
+            if (!inner->configSet(modAddr, paramAddr, param)) {
+                return false;
+            }
+            chip->monitors[paramAddr] = static_cast<int32_t>(param);
+            return true;
+        }
+        else if (modAddr == DYNAPSE_CONFIG_DEFAULT_SRAM && shadowChipSlot(paramAddr) >= 0) {
+            // Rewrites the whole routing SRAM of chip paramAddr.
+            ChipShadow &target = chips[shadowChipSlot(paramAddr)];
+            if (target.defaultSram) {
+                writesSkipped++;
+                return true;
+            }
+            target.routes.clear();
+            target.defaultSram = inner->configSet(modAddr, paramAddr, param);
+            return target.defaultSram;
+        }
+        else if (modAddr == DYNAPSE_CONFIG_DEFAULT_SRAM_EMPTY && chip != NULL) {
+            chip->routes.clear();
+            chip->defaultSram = false;
+        }
+        else if (modAddr == DYNAPSE_CONFIG_CLEAR_CAM && chip != NULL) {
+            chip->cams.clear();
+        }
+        return inner->configSet(modAddr, paramAddr, param);
+    }
+
+    bool configGet(int8_t modAddr, uint8_t paramAddr, uint32_t *param) override {
+        return inner->configGet(modAddr, paramAddr, param);
+    }
+
+    bool dataStart() override { return inner->dataStart(); }
+    bool dataStop() override { return inner->dataStop(); }
+    caerEventPacketContainer dataGet() override { return inner->dataGet(); }
+
+    bool writeCam(uint16_t inputNeuronAddr, uint16_t neuronAddr, uint8_t camId, uint8_t synapseType) override {
+        ChipShadow *chip = selected();
+        if (chip == NULL || neuronAddr >= 1024 || camId >= 64) {
+            return inner->writeCam(inputNeuronAddr, neuronAddr, camId, synapseType);
+        }
+        size_t cell = static_cast<size_t>(neuronAddr) * 64 + camId;
+        uint32_t word = caerDynapseGenerateCamBits(inputNeuronAddr, neuronAddr, camId, synapseType);
+        if (chip->cams.has(cell, word)) {
+            writesSkipped++;
+            return true;
+        }
+        chip->cams.forget(cell);
+        if (!inner->writeCam(inputNeuronAddr, neuronAddr, camId, synapseType)) {
+            return false;
+        }
+        chip->cams.set(cell, word);
+        return true;
+    }
+
+    bool sendDataToUSB(const uint32_t *data, size_t numConfig) override {
+        if (selectedChipId < 0) {
+            wordsWritten += numConfig;
+            return inner->sendDataToUSB(data, numConfig);
+        }
+
+        // A bias only keeps its last value, so words overwritten later in the
+        // same transfer are dropped; the rest is filtered in order.
+        int lastWrite[SHADOW_BIAS_ADDRESSES];
+        std::fill(lastWrite, lastWrite + SHADOW_BIAS_ADDRESSES, -1);
+        for (size_t i = 0; i < numConfig; i++) {
+            if (isBiasWord(data[i])) lastWrite[biasWordAddress(data[i])] = static_cast<int>(i);
+        }
+        changed.clear();
+        for (size_t i = 0; i < numConfig; i++) {
+            if (isBiasWord(data[i]) && lastWrite[biasWordAddress(data[i])] != static_cast<int>(i)) {
+                wordsSkipped++;
+            }
+            else if (track(data[i])) {
+                changed.push_back(data[i]);
+            }
+            else {
+                wordsSkipped++;
+            }
+        }
+        if (changed.empty()) {
+            return true;
+        }
+        if (!inner->sendDataToUSB(changed.data(), changed.size())) {
+            // The caller falls back to single writes; make sure they are not filtered out.
+            forget(changed);
+            wordsWritten -= changed.size();
+            return false;
+        }
+        return true;
+    }
+
+    // Spike generator stimuli hold no chip state.
+    bool writeSramWords(const uint16_t *data, uint32_t baseAddr, size_t numWords) override {
+        return inner->writeSramWords(data, baseAddr, numWords);
+    }
+
+    void printStats() override {
+        printf("Shadow: %llu words written, %llu unchanged words and %llu other writes skipped, selected chip %d.\n",
+               (unsigned long long) wordsWritten, (unsigned long long) wordsSkipped,
+               (unsigned long long) writesSkipped, selectedChipId);
+        inner->printStats();
+    }
+
+private:
+    DynapseDevice *inner;
+    ChipShadow chips[SHADOW_CHIPS];
+    int selectedChipId = -1;
+    int chipRun = -1; // last CHIP_RUN written, -1 if unknown
+    std::vector<uint32_t> changed;
+
+    ChipShadow *selected() {
+        return (selectedChipId < 0) ? NULL : &chips[shadowChipSlot(static_cast<uint32_t>(selectedChipId))];
+    }
+
+    // Records a CHIP_CONTENT word; returns false if it is a bias word the chip already holds.
+    bool track(uint32_t word) {
+        if (selectedChipId < 0 || !isBiasWord(word)) {
+            wordsWritten++;
+            return true;
+        }
+        ShadowTable &biases = selected()->biases;
+        uint8_t address = biasWordAddress(word);
+        if (biases.has(address, word)) {
+            return false;
+        }
+        biases.set(address, word);
+        wordsWritten++;
+        return true;
+    }
+
+    // Undoes track() after a failed write.
+    void untrack(uint32_t word) {
+        if (selectedChipId >= 0 && isBiasWord(word)) {
+            selected()->biases.forget(biasWordAddress(word));
+        }
+        wordsWritten--;
+    }
+
+    void forget(const std::vector<uint32_t> &words) {
+        ShadowTable &biases = selected()->biases;
+        for (uint32_t word : words) {
+            if (isBiasWord(word)) {
+                biases.forget(biasWordAddress(word));
+            }
+        }
+    }
+};
+
+#endif /* DYNAPSE_DEVICE_SHADOW_H_ */
@@ -0,0 +1,146 @@
+/*
+ * Device configuration snapshots (--snapshot), for warm starts.
+ *
+ * A snapshot is the content of the shadow (device_shadow.h): per chip the
+ * bias words, routing SRAM cells, CAM words and neuron monitors the server
+ * wrote, and whether DEFAULT_SRAM was applied. It is saved at shutdown and
+ * with SNAPSHOT_SAVE. When the server starts on a board whose chips are still
+ * running, the snapshot is loaded back into the shadow, so the startup
+ * sequence and the first presets only send what differs.
+ *
+ * The snapshot belongs to one board: deviceID, logic version and the device
+ * string (without the serial/bus part libcaer appends) must match, otherwise
+ * it is ignored and the board is configured from scratch.
+ *
+ * Layout (little endian): SnapshotHeader, then per chip: u8 defaultSram,
+ * 4 x i32 monitors, and for biases, routes and cams in that order: u32 count,
+ * count x (u32 index, u32 word).
+ */
+
+#ifndef DYNAPSE_DEVICE_SNAPSHOT_H_
+#define DYNAPSE_DEVICE_SNAPSHOT_H_
+
+#include "device_shadow.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#define SNAPSHOT_MAGIC 0x53535944 // "DYSS" on disk
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_DEFAULT_PATH "data/device_snapshot.bin"
+
+#pragma pack(push, 1)
+struct SnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t deviceId;
+    int32_t logicVersion;
+    uint32_t deviceHash; // FNV-1a of the device string up to " ["
+    uint32_t chips;
+};
+#pragma pack(pop)
+
+static inline uint32_t snapshotDeviceHash(const char *deviceString) {
+    uint32_t hash = 2166136261u;
+    const char *end = (deviceString == NULL) ? NULL : strstr(deviceString, " [");
+    for (const char *c = deviceString; c != NULL && *c != '\0' && c != end; c++) {
+        hash = (hash ^ static_cast<uint8_t>(*c)) * 16777619u;
+    }
+    return hash;
+}
+
+static inline SnapshotHeader snapshotHeader(const struct caer_dynapse_info &info) {
+    SnapshotHeader header = {SNAPSHOT_MAGIC, SNAPSHOT_VERSION, info.deviceID, info.logicVersion,
+                             snapshotDeviceHash(info.deviceString), SHADOW_CHIPS};
+    return header;
+}
+
+static inline void writeSnapshotTable(FILE *file, const ShadowTable &table) {
+    uint32_t count = 0;
+    for (size_t i = 0; i < table.size(); i++) {
+        count += table.known[i];
+    }
+    fwrite(&count, sizeof(count), 1, file);
+    for (size_t i = 0; i < table.size(); i++) {
+        if (!table.known[i]) continue;
+        uint32_t pair[2] = {static_cast<uint32_t>(i), table.words[i]};
+        fwrite(pair, sizeof(pair), 1, file);
+    }
+}
+
+static inline bool readSnapshotTable(FILE *file, ShadowTable &table) {
+    uint32_t count;
+    if (fread(&count, sizeof(count), 1, file) != 1 || count > table.size()) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t pair[2];
+        if (fread(pair, sizeof(pair), 1, file) != 1 || pair[0] >= table.size()) {
+            return false;
+        }
+        table.set(pair[0], pair[1]);
+    }
+    return true;
+}
+
+static inline bool saveDeviceSnapshot(const std::string &path, const struct caer_dynapse_info &info,
+                                      const ShadowDynapseDevice &shadow) {
+    std::string tmpPath = path + ".tmp";
+    FILE *file = fopen(tmpPath.c_str(), "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening snapshot for writing: %s\n", path.c_str());
+        return false;
+    }
+    SnapshotHeader header = snapshotHeader(info);
+    fwrite(&header, sizeof(header), 1, file);
+    for (int slot = 0; slot < SHADOW_CHIPS; slot++) {
+        const ChipShadow &chip = shadow.chipSlot(slot);
+        uint8_t defaultSram = chip.defaultSram ? 1 : 0;
+        fwrite(&defaultSram, 1, 1, file);
+        fwrite(chip.monitors, sizeof(chip.monitors), 1, file);
+        writeSnapshotTable(file, chip.biases);
+        writeSnapshotTable(file, chip.routes);
+        writeSnapshotTable(file, chip.cams);
+    }
+    if (ferror(file) || fclose(file) != 0 || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        remove(tmpPath.c_str());
+        fprintf(stderr, "Error writing snapshot: %s\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Loads into the shadow; on any mismatch or error the shadow is left empty.
+static inline bool loadDeviceSnapshot(const std::string &path, const struct caer_dynapse_info &info,
+                                      ShadowDynapseDevice &shadow) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == NULL) {
+        return false;
+    }
+    SnapshotHeader expected = snapshotHeader(info), header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1;
+    if (ok && memcmp(&header, &expected, sizeof(header)) != 0) {
+        fprintf(stderr, "Snapshot %s is for another board or version, ignored.\n", path.c_str());
+        fclose(file);
+        return false;
+    }
+    shadow.invalidate();
+    for (int slot = 0; ok && slot < SHADOW_CHIPS; slot++) {
+        ChipShadow &chip = shadow.chipSlot(slot);
+        uint8_t defaultSram;
+        ok = fread(&defaultSram, 1, 1, file) == 1 && fread(chip.monitors, sizeof(chip.monitors), 1, file) == 1
+            && readSnapshotTable(file, chip.biases) && readSnapshotTable(file, chip.routes)
+            && readSnapshotTable(file, chip.cams);
+        chip.defaultSram = defaultSram != 0;
+    }
+    fclose(file);
+    if (!ok) {
+        shadow.invalidate();
+        fprintf(stderr, "Invalid snapshot: %s\n", path.c_str());
+    }
+    return ok;
+}
+
+#endif /* DYNAPSE_DEVICE_SNAPSHOT_H_ */
@@ -0,0 +1,442 @@
+/*
+ * Device abstraction for the Dynap-se server.
+ *
+ * UsbDynapseDevice forwards to libcaer and a real board. ReplayDynapseDevice
+ * feeds an AEDAT 3.1 recording into the same pipeline as packet containers
+ * and keeps all configuration writes in an in-memory mock, so the spike
+ * server, clients and the config path can be load-tested without hardware.
+ *
+ * The replay device also emulates the FPGA spike generator: a run of
+ * stimulus words written with writeSramWords() is played back, ISI by ISI,
+ * as output spikes of the addressed neurons, as if every injected spike made
+ * its target fire once. The stimulus path (stimulus.h) can so be driven and
+ * its loop time measured without a board.
+ *
+ * Replay speed: 1 = real time, N = N times faster, 0 = as fast as possible.
+ */
+
+#ifndef DYNAPSE_DEVICE_H_
+#define DYNAPSE_DEVICE_H_
+
+#include "../aedat-python/aedat_decoder.h"
+
+#include <libcaer/libcaer.h>
+#include <libcaer/devices/dynapse.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// FPGA spike generator stimulus, variable ISI mode: per spike one ISI word
+// (in units of ISIBASE logic clock cycles) followed by one address word.
+#define SPIKEGEN_WORDS_PER_SPIKE 2
+#define SPIKEGEN_NEURON_MASK 0xFF
+#define SPIKEGEN_CORE_SHIFT 8      // source core of the virtual spike
+#define SPIKEGEN_DEST_CORES_SHIFT 10 // destination core mask on the selected chip
+
+static inline uint16_t spikeGenAddressWord(uint8_t core, uint8_t neuron, uint8_t destCores) {
+    return static_cast<uint16_t>(neuron | ((core & 0x03) << SPIKEGEN_CORE_SHIFT)
+                                 | ((destCores & 0x0F) << SPIKEGEN_DEST_CORES_SHIFT));
+}
+
+class DynapseDevice {
+public:
+    virtual ~DynapseDevice() {}
+
+    virtual struct caer_dynapse_info info() = 0;
+
+    virtual bool configSet(int8_t modAddr, uint8_t paramAddr, uint32_t param) = 0;
+    virtual bool configGet(int8_t modAddr, uint8_t paramAddr, uint32_t *param) = 0;
+
+    virtual bool dataStart() = 0;
+    virtual bool dataStop() = 0;
+    virtual caerEventPacketContainer dataGet() = 0;
+
+    virtual bool writeCam(uint16_t inputNeuronAddr, uint16_t neuronAddr, uint8_t camId, uint8_t synapseType) = 0;
+    // Bulk transfer of ready-made CHIP_CONTENT words (biases, CAM, ...) to the selected chip.
+    virtual bool sendDataToUSB(const uint32_t *data, size_t numConfig) = 0;
+    // Bulk transfer to the FPGA SRAM read by the spike generator.
+    virtual bool writeSramWords(const uint16_t *data, uint32_t baseAddr, size_t numWords) = 0;
+
+    virtual void printStats() {}
+};
+
+class UsbDynapseDevice : public DynapseDevice {
+public:
+    explicit UsbDynapseDevice(caerDeviceHandle handle) : handle(handle) {}
+    ~UsbDynapseDevice() override { caerDeviceClose(&handle); }
+
+    struct caer_dynapse_info info() override { return caerDynapseInfoGet(handle); }
+
+    bool configSet(int8_t modAddr, uint8_t paramAddr, uint32_t param) override {
+        return caerDeviceConfigSet(handle, modAddr, paramAddr, param);
+    }
+    bool configGet(int8_t modAddr, uint8_t paramAddr, uint32_t *param) override {
+        return caerDeviceConfigGet(handle, modAddr, paramAddr, param);
+    }
+
+    bool dataStart() override { return caerDeviceDataStart(handle, NULL, NULL, NULL, NULL, NULL); }
+    bool dataStop() override { return caerDeviceDataStop(handle); }
+    caerEventPacketContainer dataGet() override { return caerDeviceDataGet(handle); }
+
+    bool writeCam(uint16_t inputNeuronAddr, uint16_t neuronAddr, uint8_t camId, uint8_t synapseType) override {
+        return caerDynapseWriteCam(handle, inputNeuronAddr, neuronAddr, camId, synapseType);
+    }
+    bool sendDataToUSB(const uint32_t *data, size_t numConfig) override {
+        return caerDynapseSendDataToUSB(handle, data, numConfig);
+    }
+    bool writeSramWords(const uint16_t *data, uint32_t baseAddr, size_t numWords) override {
+        return caerDynapseWriteSramWords(handle, data, baseAddr, numWords);
+    }
+
+private:
+    caerDeviceHandle handle;
+};
+
+// Configuration sink for replay/benchmark runs: remembers the last value per
+// (module, parameter) and counts every write.
+class MockConfigStore {
+public:
+    std::atomic<uint64_t> configWrites{0};
+    std::atomic<uint64_t> camWrites{0};
+    std::atomic<uint64_t> usbWords{0};
+    std::atomic<uint64_t> sramWords{0};
+    std::atomic<uint64_t> spikeGenRuns{0};
+
+    void set(int8_t modAddr, uint8_t paramAddr, uint32_t param) {
+        std::lock_guard<std::mutex> lock(mutex);
+        values[key(modAddr, paramAddr)] = param;
+        configWrites.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool get(int8_t modAddr, uint8_t paramAddr, uint32_t *param) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = values.find(key(modAddr, paramAddr));
+        *param = (it == values.end()) ? 0 : it->second;
+        return true;
+    }
+
+    void print() const {
+        printf("Mock device: %llu config writes, %llu CAM writes, %llu bulk USB words, %llu SRAM words, "
+               "%llu spike generator runs.\n",
+               (unsigned long long) configWrites.load(), (unsigned long long) camWrites.load(),
+               (unsigned long long) usbWords.load(), (unsigned long long) sramWords.load(),
+               (unsigned long long) spikeGenRuns.load());
+    }
+
+private:
+    std::mutex mutex;
+    std::map<uint16_t, uint32_t> values;
+
+    static uint16_t key(int8_t modAddr, uint8_t paramAddr) {
+        return static_cast<uint16_t>((static_cast<uint8_t>(modAddr) << 8) | paramAddr);
+    }
+};
+
+class ReplayDynapseDevice : public DynapseDevice {
+public:
+    std::atomic<uint64_t> packetsReplayed{0};
+    std::atomic<uint64_t> eventsReplayed{0};
+
+    ReplayDynapseDevice(double speed, bool loop) : speed(speed), loop(loop) {}
+
+    bool open(const std::string &path) {
+        if (!file.open(path)) {
+            return false;
+        }
+        if (file.packets().empty()) {
+            fprintf(stderr, "No spike or special packets in %s.\n", path.c_str());
+            return false;
+        }
+        deviceString = "Dynap-se replay of " + path;
+        printf("Replaying %s: %zu packets, %llu spikes, speed %s.\n", path.c_str(), file.packets().size(),
+               (unsigned long long) file.spikeCount(), speed > 0 ? std::to_string(speed).c_str() : "max");
+        return true;
+    }
+
+    struct caer_dynapse_info info() override {
+        struct caer_dynapse_info dynapseInfo;
+        memset(&dynapseInfo, 0, sizeof(dynapseInfo));
+        dynapseInfo.deviceString = const_cast<char *>(deviceString.c_str());
+        dynapseInfo.deviceIsMaster = true;
+        return dynapseInfo;
+    }
+
+    bool configSet(int8_t modAddr, uint8_t paramAddr, uint32_t param) override {
+        mock.set(modAddr, paramAddr, param);
+        if (modAddr == DYNAPSE_CONFIG_SPIKEGEN && paramAddr == DYNAPSE_CONFIG_SPIKEGEN_RUN) {
+            runSpikeGen(param != 0);
+        }
+        return true;
+    }
+    bool configGet(int8_t modAddr, uint8_t paramAddr, uint32_t *param) override {
+        return mock.get(modAddr, paramAddr, param);
+    }
+
+    bool dataStart() override {
+        next = 0;
+        nextEvent = 0;
+        started = false;
+        return true;
+    }
+    bool dataStop() override { return true; }
+
+    // One recorded packet per container, paced against the recording's own timestamps.
+    // Spikes played by the emulated spike generator go out as soon as they are due.
+    caerEventPacketContainer dataGet() override {
+        caerEventPacketContainer injected = takeInjected();
+        if (injected != NULL) {
+            return injected;
+        }
+        if (next >= file.packets().size()) {
+            if (!loop) {
+                // Behave like an idle board in blocking mode.
+                idleUntil(std::chrono::steady_clock::now() + std::chrono::milliseconds(10));
+                return NULL;
+            }
+            next = 0;
+            loopOffset = lastTimestamp.load(std::memory_order_relaxed) - firstTimestamp(file.packets()[0]) + 1;
+        }
+
+        const AedatPacketInfo &packet = file.packets()[next];
+        int64_t ts = eventTimestamp(packet, nextEvent) + loopOffset;
+        if (!started) {
+            std::lock_guard<std::mutex> lock(spikeGenMutex);
+            started = true;
+            replayStartTs = ts;
+            replayStartWall = std::chrono::steady_clock::now();
+        }
+        if (speed > 0) {
+            auto due = replayStartWall + std::chrono::microseconds(static_cast<int64_t>((ts - replayStartTs) / speed));
+            // Long gaps in the recording are waited out in idle slices, so shutdown stays responsive.
+            auto slice = std::chrono::steady_clock::now() + std::chrono::milliseconds(10);
+            if (due > slice) {
+                idleUntil(slice);
+                return NULL;
+            }
+            if (!idleUntil(due)) {
+                return NULL; // injected spikes first, this packet on the next call
+            }
+        }
+        // Shifted by loopOffset, a packet can cross a 2^31 us boundary: it then goes out as
+        // one packet per overflow period, the next part on the next call.
+        int32_t first = nextEvent, count = 0;
+        while (first + count < packet.eventNumber
+               && ((eventTimestamp(packet, first + count) + loopOffset) >> 31) == (ts >> 31)) {
+            count++;
+        }
+        nextEvent += count;
+        // The next loop continues after the last event, not the first, of the last packet.
+        lastTimestamp.store(eventTimestamp(packet, nextEvent - 1) + loopOffset, std::memory_order_relaxed);
+        if (nextEvent >= packet.eventNumber) {
+            next++;
+            nextEvent = 0;
+        }
+
+        size_t size = static_cast<size_t>(packet.eventSize);
+        caerEventPacketHeader copy
+            = static_cast<caerEventPacketHeader>(malloc(AEDAT_PACKET_HEADER_SIZE + static_cast<size_t>(count) * size));
+        memcpy(copy, file.packetData(packet), AEDAT_PACKET_HEADER_SIZE);
+        memcpy(reinterpret_cast<uint8_t *>(copy) + AEDAT_PACKET_HEADER_SIZE,
+               file.packetData(packet) + AEDAT_PACKET_HEADER_SIZE + static_cast<size_t>(first) * size,
+               static_cast<size_t>(count) * size);
+        copy->eventCapacity = count;
+        if (count != packet.eventNumber) {
+            copy->eventNumber = count;
+            copy->eventValid = countValid(copy);
+        }
+        if (loopOffset != 0) {
+            shiftTimestamps(copy, ts >> 31);
+        }
+
+        caerEventPacketContainer packetContainer = caerEventPacketContainerAllocate(1);
+        caerEventPacketContainerSetEventPacket(packetContainer, 0, copy);
+        packetsReplayed.fetch_add(1, std::memory_order_relaxed);
+        eventsReplayed.fetch_add(static_cast<uint64_t>(count), std::memory_order_relaxed);
+        return packetContainer;
+    }
+
+    bool writeCam(uint16_t, uint16_t, uint8_t, uint8_t) override {
+        mock.camWrites.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    bool sendDataToUSB(const uint32_t *, size_t numConfig) override {
+        mock.usbWords.fetch_add(numConfig, std::memory_order_relaxed);
+        return true;
+    }
+    bool writeSramWords(const uint16_t *data, uint32_t baseAddr, size_t numWords) override {
+        std::lock_guard<std::mutex> lock(spikeGenMutex);
+        if (spikeGenSram.size() < baseAddr + numWords) {
+            spikeGenSram.resize(baseAddr + numWords, 0);
+        }
+        std::copy(data, data + numWords, spikeGenSram.begin() + baseAddr);
+        mock.sramWords.fetch_add(numWords, std::memory_order_relaxed);
+        return true;
+    }
+
+    void printStats() override {
+        printf("Replay: %llu packets, %llu events.\n", (unsigned long long) packetsReplayed.load(),
+               (unsigned long long) eventsReplayed.load());
+        mock.print();
+    }
+
+    MockConfigStore mock;
+
+private:
+    AedatFile file;
+    double speed;
+    bool loop;
+    std::string deviceString;
+
+    size_t next = 0;
+    int32_t nextEvent = 0; // first event of packets()[next] not sent yet
+    bool started = false;
+    int64_t replayStartTs = 0, loopOffset = 0;
+    std::atomic<int64_t> lastTimestamp{0};
+    std::chrono::steady_clock::time_point replayStartWall;
+
+    // Emulated spike generator: its SRAM and the spikes of the current run not yet due.
+    struct InjectedSpike {
+        std::chrono::steady_clock::time_point due;
+        int64_t timestamp;
+        uint8_t chipId, core, neuron;
+    };
+    std::mutex spikeGenMutex;
+    std::condition_variable spikeGenReady;
+    std::vector<uint16_t> spikeGenSram;
+    std::deque<InjectedSpike> injected;
+
+    // Device time now, as the replayed timestamps run.
+    int64_t deviceTimeLocked(std::chrono::steady_clock::time_point now) const {
+        if (!started || speed <= 0) {
+            return lastTimestamp.load(std::memory_order_relaxed);
+        }
+        return replayStartTs
+            + static_cast<int64_t>(std::chrono::duration<double, std::micro>(now - replayStartWall).count() * speed);
+    }
+
+    // RUN restarts the generator on the stimulus at BASEADDR; stopping drops what it has not played yet.
+    void runSpikeGen(bool run) {
+        uint32_t baseAddr, count, chipId, isiBase;
+        mock.get(DYNAPSE_CONFIG_SPIKEGEN, DYNAPSE_CONFIG_SPIKEGEN_BASEADDR, &baseAddr);
+        mock.get(DYNAPSE_CONFIG_SPIKEGEN, DYNAPSE_CONFIG_SPIKEGEN_STIMCOUNT, &count);
+        mock.get(DYNAPSE_CONFIG_SPIKEGEN, DYNAPSE_CONFIG_SPIKEGEN_CHIPID, &chipId);
+        mock.get(DYNAPSE_CONFIG_SPIKEGEN, DYNAPSE_CONFIG_SPIKEGEN_ISIBASE, &isiBase);
+
+        std::lock_guard<std::mutex> lock(spikeGenMutex);
+        injected.clear();
+        if (!run) {
+            return;
+        }
+        mock.spikeGenRuns.fetch_add(1, std::memory_order_relaxed);
+        // The mock logic clock runs at 1 MHz: an ISI unit is ISIBASE microseconds.
+        auto now = std::chrono::steady_clock::now();
+        int64_t offsetUs = 0, deviceNow = deviceTimeLocked(now);
+        for (uint32_t i = 0; i < count; i++) {
+            size_t word = baseAddr + static_cast<size_t>(i) * SPIKEGEN_WORDS_PER_SPIKE;
+            if (word + 1 >= spikeGenSram.size()) {
+                break;
+            }
+            offsetUs += static_cast<int64_t>(spikeGenSram[word]) * std::max<uint32_t>(1, isiBase);
+            uint16_t address = spikeGenSram[word + 1];
+            InjectedSpike spike = {now + std::chrono::microseconds(offsetUs), deviceNow + offsetUs,
+                                   static_cast<uint8_t>(chipId),
+                                   static_cast<uint8_t>((address >> SPIKEGEN_CORE_SHIFT) & 0x03),
+                                   static_cast<uint8_t>(address & SPIKEGEN_NEURON_MASK)};
+            injected.push_back(spike);
+        }
+        spikeGenReady.notify_all();
+    }
+
+    // Sleeps until tp; returns false early once injected spikes are due.
+    bool idleUntil(std::chrono::steady_clock::time_point tp) {
+        std::unique_lock<std::mutex> lock(spikeGenMutex);
+        for (;;) {
+            auto now = std::chrono::steady_clock::now();
+            if (!injected.empty() && injected.front().due <= now) {
+                return false;
+            }
+            if (now >= tp) {
+                return true;
+            }
+            spikeGenReady.wait_until(lock, injected.empty() ? tp : std::min(tp, injected.front().due));
+        }
+    }
+
+    // The injected spikes that are due, as one spike packet.
+    caerEventPacketContainer takeInjected() {
+        std::lock_guard<std::mutex> lock(spikeGenMutex);
+        auto now = std::chrono::steady_clock::now();
+        size_t due = 0;
+        while (due < injected.size() && injected[due].due <= now) {
+            due++;
+        }
+        if (due == 0) {
+            return NULL;
+        }
+        int32_t tsOverflow = static_cast<int32_t>(injected.front().timestamp >> 31);
+        caerSpikeEventPacket packet = caerSpikeEventPacketAllocate(static_cast<int32_t>(due), 0, tsOverflow);
+        int32_t events = 0;
+        for (; events < static_cast<int32_t>(due) && (injected.front().timestamp >> 31) == tsOverflow; events++) {
+            const InjectedSpike &spike = injected.front();
+            caerSpikeEvent event = caerSpikeEventPacketGetEvent(packet, events);
+            caerSpikeEventSetTimestamp(event, static_cast<int32_t>(spike.timestamp & 0x7FFFFFFF));
+            caerSpikeEventSetSourceCoreID(event, spike.core);
+            caerSpikeEventSetChipID(event, spike.chipId);
+            caerSpikeEventSetNeuronID(event, spike.neuron);
+            caerSpikeEventValidate(event, packet);
+            injected.pop_front();
+        }
+        caerEventPacketHeaderSetEventNumber(&packet->packetHeader, events);
+
+        caerEventPacketContainer packetContainer = caerEventPacketContainerAllocate(1);
+        caerEventPacketContainerSetEventPacket(packetContainer, 0, (caerEventPacketHeader) packet);
+        eventsReplayed.fetch_add(static_cast<uint64_t>(events), std::memory_order_relaxed);
+        return packetContainer;
+    }
+
+    int64_t eventTimestamp(const AedatPacketInfo &packet, int32_t index) const {
+        int32_t ts;
+        memcpy(&ts, file.packetData(packet) + AEDAT_PACKET_HEADER_SIZE + static_cast<size_t>(index) * packet.eventSize + 4,
+               sizeof(ts));
+        return (static_cast<int64_t>(packet.tsOverflow) << 31) + ts;
+    }
+
+    int64_t firstTimestamp(const AedatPacketInfo &packet) const { return eventTimestamp(packet, 0); }
+
+    // The valid mark is bit 0 of every event's first word.
+    static int32_t countValid(caerEventPacketHeader packetHeader) {
+        const uint8_t *events = reinterpret_cast<const uint8_t *>(packetHeader) + AEDAT_PACKET_HEADER_SIZE;
+        int32_t valid = 0;
+        for (int32_t i = 0; i < packetHeader->eventNumber; i++) {
+            valid += events[static_cast<size_t>(i) * packetHeader->eventSize] & 0x01;
+        }
+        return valid;
+    }
+
+    // Looped replays continue the timeline instead of jumping back. Every event of the
+    // packet lies in the overflow period given, see dataGet().
+    void shiftTimestamps(caerEventPacketHeader packetHeader, int64_t overflow) {
+        int64_t base = (static_cast<int64_t>(packetHeader->eventTSOverflow) << 31) + loopOffset - (overflow << 31);
+        uint8_t *events = reinterpret_cast<uint8_t *>(packetHeader) + AEDAT_PACKET_HEADER_SIZE;
+        int32_t size = packetHeader->eventSize;
+        packetHeader->eventTSOverflow = static_cast<int32_t>(overflow);
+        for (int32_t i = 0; i < packetHeader->eventNumber; i++) {
+            int32_t ts;
+            memcpy(&ts, events + i * size + 4, sizeof(ts));
+            int32_t shifted = static_cast<int32_t>(base + ts);
+            memcpy(events + i * size + 4, &shifted, sizeof(shifted));
+        }
+    }
+};
+
+#endif /* DYNAPSE_DEVICE_H_ */
@@ -1,6 +1,6 @@
 /*
  * Mac os X: g++ -std=c++11  -O2 -o dynapse_simple_v1 dynapse_simple_v1.cpp -I/usr/local/include/ -L/usr/local/lib/ -lcaer
- * Linux: g++ -std=c++11 -O2 -o dynapse_simple_v1 dynapse_simple_v1.cpp -lcaer
+ * Linux: g++ -std=c++11 -O2 -o dynapse_simple_v1 dynapse_simple_v1.cpp -lcaer -lpthread -lrt
  */
  
 #include <libcaer/libcaer.h>
@@ -8,6 +8,7 @@
 #include <cstdio>
 #include <csignal>
 #include <atomic>
+#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -20,26 +21,68 @@
 // Networking
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <unistd.h>
 
+#include "aedat_recorder.h"
+#include "bias_image.h"
+#include "bias_sweep.h"
+#include "bias_tables.h"
+#include "cam_table.h"
+#include "config_protocol.h"
+#include "config_queue.h"
+#include "device_shadow.h"
+#include "device_snapshot.h"
+#include "dynapse_device.h"
+#include "latency_stats.h"
+#include "metrics.h"
+#include "network_program.h"
+#include "poisson_rates.h"
+#include "rate_engine.h"
+#include "route_table.h"
+#include "spike_ring.h"
+#include "spike_server.h"
+#include "spike_shm.h"
+#include "startup_plan.h"
+#include "stimulus.h"
+
 #define DEFAULTBIASES "data/defaultbiases_values.txt"
 #define LOWPOWERBIASES "data/lowpowerbiases_values.txt"
+#define SPIKE_SEND_BATCH 64 // containers per sender round before servicing client I/O
 
 using namespace std;
 
 static atomic_bool globalShutdown(false);
-int serverSocket = -1, clientSocket = -1;
+SpikeServer spikeServer;
+SpikeServer rateServer("Rate"); // per-neuron rates (port 9003)
+RateEngine rateEngine;
+StimulusServer stimulusServer; // input spikes into the chips (port 9005)
+PoissonRateTable poissonRates;  // what the FPGA Poisson generator holds
+BiasSweep biasSweep;            // unattended bias sweeps, stepped by the config thread
+SpikeShmWriter spikeShm;   // optional same-host transport, enabled with --shm
+AedatRecorder aedatRecorder;
+
+// USB acquisition → network sender hand-off
+struct FetchedContainer {
+	caerEventPacketContainer container;
+	int64_t fetchedNs; // latencyNowNs() when caerDeviceDataGet() returned it
+};
+SpscRing<FetchedContainer> spikeRing(SPIKE_RING_CAPACITY);
+HotPathStats hotPath;
+AcquisitionMetrics acquisitionMetrics; // per-thread counters for the metrics endpoint
+SenderMetrics senderMetrics;
+ConfigMetrics configMetrics;
+MetricsEndpoint metricsEndpoint;
+SpikeRingStats spikeRingStats;
+std::atomic<uint8_t> spikeRingPolicy(RING_POLICY_DROP);
+static atomic_bool acquisitionDone(false);
 int configSocket = -1, configClient = -1;
+ConfigStats configStats;
+ConfigWriteQueue configWrites; // SET, PARAM_SET and MONITOR_SET of one read, merged per register
 
-// Biases currently loaded/applied → to allow SAVE later
-std::map<std::string, std::pair<int, int>> currentBiasValues;
-
-struct BiasFlags {
-    uint32_t param;
-    bool sexN;
-    bool typeNormal;
-    bool biasHigh;
-};
+// Bias words last written to each chip → differential LOAD and per-chip SAVE
+ShadowDynapseDevice *deviceShadow = NULL;
+std::string snapshotPath = SNAPSHOT_DEFAULT_PATH; // shadow saved here for the next warm start
 
 static inline uint8_t coarseValueForward(uint8_t coarseRev) {
     if (coarseRev == 0) return 0;
@@ -53,145 +96,6 @@ static inline uint8_t coarseValueForward(uint8_t coarseRev) {
     else return 0;  // Fallback
 }
 
-std::map<std::string, uint32_t> parameterMap = {
-    // CHIP
-    {"CHIP_RUN", DYNAPSE_CONFIG_CHIP_RUN},
-    {"CHIP_ID", DYNAPSE_CONFIG_CHIP_ID},   // <--- ADD THIS LINE!
-    {"CHIP_REQ_DELAY", DYNAPSE_CONFIG_CHIP_REQ_DELAY},
-    {"CHIP_REQ_EXTENSION", DYNAPSE_CONFIG_CHIP_REQ_EXTENSION},
-
-    // MUX
-    {"MUX_RUN", DYNAPSE_CONFIG_MUX_RUN},
-    {"MUX_TIMESTAMP_RUN", DYNAPSE_CONFIG_MUX_TIMESTAMP_RUN},
-    {"MUX_FORCE_CHIP_BIAS_ENABLE", DYNAPSE_CONFIG_MUX_FORCE_CHIP_BIAS_ENABLE},
-
-    // AER
-    {"AER_RUN", DYNAPSE_CONFIG_AER_RUN},
-    {"AER_ACK_DELAY", DYNAPSE_CONFIG_AER_ACK_DELAY},
-    {"AER_ACK_EXTENSION", DYNAPSE_CONFIG_AER_ACK_EXTENSION},
-    {"AER_WAIT_ON_TRANSFER_STALL", DYNAPSE_CONFIG_AER_WAIT_ON_TRANSFER_STALL},
-};
-
-std::map<std::string, BiasFlags> biasFlagMap = {
-
-    // ------- C0 -------
-    {"C0_PULSE_PWLK_P", { DYNAPSE_CONFIG_BIAS_C0_PULSE_PWLK_P, false, true, true }},
-    {"C0_PS_WEIGHT_INH_S_N", { DYNAPSE_CONFIG_BIAS_C0_PS_WEIGHT_INH_S_N, true, true, true }},
-    {"C0_PS_WEIGHT_INH_F_N", { DYNAPSE_CONFIG_BIAS_C0_PS_WEIGHT_INH_F_N, true, true, true }},
-    {"C0_PS_WEIGHT_EXC_S_N", { DYNAPSE_CONFIG_BIAS_C0_PS_WEIGHT_EXC_S_N, true, true, true }},
-    {"C0_PS_WEIGHT_EXC_F_N", { DYNAPSE_CONFIG_BIAS_C0_PS_WEIGHT_EXC_F_N, true, true, true }},
-    {"C0_IF_RFR_N", { DYNAPSE_CONFIG_BIAS_C0_IF_RFR_N, true, true, true }},
-    {"C0_IF_TAU1_N", { DYNAPSE_CONFIG_BIAS_C0_IF_TAU1_N, false, true, true }},
-    {"C0_IF_AHTAU_N", { DYNAPSE_CONFIG_BIAS_C0_IF_AHTAU_N, true, true, true }},
-    {"C0_IF_CASC_N", { DYNAPSE_CONFIG_BIAS_C0_IF_CASC_N, true, true, true }},
-    {"C0_IF_TAU2_N", { DYNAPSE_CONFIG_BIAS_C0_IF_TAU2_N, true, true, true }},
-    {"C0_IF_BUF_P", { DYNAPSE_CONFIG_BIAS_C0_IF_BUF_P, false, true, true }},
-    {"C0_IF_AHTHR_N", { DYNAPSE_CONFIG_BIAS_C0_IF_AHTHR_N, true, true, true }},
-    {"C0_IF_THR_N", { DYNAPSE_CONFIG_BIAS_C0_IF_THR_N, true, true, true }},
-    {"C0_NPDPIE_THR_S_P", { DYNAPSE_CONFIG_BIAS_C0_NPDPIE_THR_S_P, false, true, true }},
-    {"C0_NPDPIE_THR_F_P", { DYNAPSE_CONFIG_BIAS_C0_NPDPIE_THR_F_P, false, true, true }},
-    {"C0_NPDPII_THR_F_P", { DYNAPSE_CONFIG_BIAS_C0_NPDPII_THR_F_P, false, true, true }},
-    {"C0_NPDPII_THR_S_P", { DYNAPSE_CONFIG_BIAS_C0_NPDPII_THR_S_P, false, true, true }},
-    {"C0_IF_NMDA_N", { DYNAPSE_CONFIG_BIAS_C0_IF_NMDA_N, true, true, true }},
-    {"C0_IF_DC_P", { DYNAPSE_CONFIG_BIAS_C0_IF_DC_P, false, true, true }},
-    {"C0_IF_AHW_P", { DYNAPSE_CONFIG_BIAS_C0_IF_AHW_P, false, true, true }},
-    {"C0_NPDPII_TAU_S_P", { DYNAPSE_CONFIG_BIAS_C0_NPDPII_TAU_S_P, false, true, true }},
-    {"C0_NPDPII_TAU_F_P", { DYNAPSE_CONFIG_BIAS_C0_NPDPII_TAU_F_P, false, true, true }},
-    {"C0_NPDPIE_TAU_F_P", { DYNAPSE_CONFIG_BIAS_C0_NPDPIE_TAU_F_P, false, true, true }},
-    {"C0_NPDPIE_TAU_S_P", { DYNAPSE_CONFIG_BIAS_C0_NPDPIE_TAU_S_P, false, true, true }},
-    {"C0_R2R_P", { DYNAPSE_CONFIG_BIAS_C0_R2R_P, false, true, true }},
-
-    // ------- C1 -------
-    {"C1_PULSE_PWLK_P", { DYNAPSE_CONFIG_BIAS_C1_PULSE_PWLK_P, false, true, true }},
-    {"C1_PS_WEIGHT_INH_S_N", { DYNAPSE_CONFIG_BIAS_C1_PS_WEIGHT_INH_S_N, true, true, true }},
-    {"C1_PS_WEIGHT_INH_F_N", { DYNAPSE_CONFIG_BIAS_C1_PS_WEIGHT_INH_F_N, true, true, true }},
-    {"C1_PS_WEIGHT_EXC_S_N", { DYNAPSE_CONFIG_BIAS_C1_PS_WEIGHT_EXC_S_N, true, true, true }},
-    {"C1_PS_WEIGHT_EXC_F_N", { DYNAPSE_CONFIG_BIAS_C1_PS_WEIGHT_EXC_F_N, true, true, true }},
-    {"C1_IF_RFR_N", { DYNAPSE_CONFIG_BIAS_C1_IF_RFR_N, true, true, true }},
-    {"C1_IF_TAU1_N", { DYNAPSE_CONFIG_BIAS_C1_IF_TAU1_N, false, true, true }},
-    {"C1_IF_AHTAU_N", { DYNAPSE_CONFIG_BIAS_C1_IF_AHTAU_N, true, true, true }},
-    {"C1_IF_CASC_N", { DYNAPSE_CONFIG_BIAS_C1_IF_CASC_N, true, true, true }},
-    {"C1_IF_TAU2_N", { DYNAPSE_CONFIG_BIAS_C1_IF_TAU2_N, true, true, true }},
-    {"C1_IF_BUF_P", { DYNAPSE_CONFIG_BIAS_C1_IF_BUF_P, false, true, true }},
-    {"C1_IF_AHTHR_N", { DYNAPSE_CONFIG_BIAS_C1_IF_AHTHR_N, true, true, true }},
-    {"C1_IF_THR_N", { DYNAPSE_CONFIG_BIAS_C1_IF_THR_N, true, true, true }},
-    {"C1_NPDPIE_THR_S_P", { DYNAPSE_CONFIG_BIAS_C1_NPDPIE_THR_S_P, false, true, true }},
-    {"C1_NPDPIE_THR_F_P", { DYNAPSE_CONFIG_BIAS_C1_NPDPIE_THR_F_P, false, true, true }},
-    {"C1_NPDPII_THR_F_P", { DYNAPSE_CONFIG_BIAS_C1_NPDPII_THR_F_P, false, true, true }},
-    {"C1_NPDPII_THR_S_P", { DYNAPSE_CONFIG_BIAS_C1_NPDPII_THR_S_P, false, true, true }},
-    {"C1_IF_NMDA_N", { DYNAPSE_CONFIG_BIAS_C1_IF_NMDA_N, true, true, true }},
-    {"C1_IF_DC_P", { DYNAPSE_CONFIG_BIAS_C1_IF_DC_P, false, true, true }},
-    {"C1_IF_AHW_P", { DYNAPSE_CONFIG_BIAS_C1_IF_AHW_P, false, true, true }},
-    {"C1_NPDPII_TAU_S_P", { DYNAPSE_CONFIG_BIAS_C1_NPDPII_TAU_S_P, false, true, true }},
-    {"C1_NPDPII_TAU_F_P", { DYNAPSE_CONFIG_BIAS_C1_NPDPII_TAU_F_P, false, true, true }},
-    {"C1_NPDPIE_TAU_F_P", { DYNAPSE_CONFIG_BIAS_C1_NPDPIE_TAU_F_P, false, true, true }},
-    {"C1_NPDPIE_TAU_S_P", { DYNAPSE_CONFIG_BIAS_C1_NPDPIE_TAU_S_P, false, true, true }},
-    {"C1_R2R_P", { DYNAPSE_CONFIG_BIAS_C1_R2R_P, false, true, true }},
-
-    // ------- C2 -------
-    {"C2_PULSE_PWLK_P", { DYNAPSE_CONFIG_BIAS_C2_PULSE_PWLK_P, false, true, true }},
-    {"C2_PS_WEIGHT_INH_S_N", { DYNAPSE_CONFIG_BIAS_C2_PS_WEIGHT_INH_S_N, true, true, true }},
-    {"C2_PS_WEIGHT_INH_F_N", { DYNAPSE_CONFIG_BIAS_C2_PS_WEIGHT_INH_F_N, true, true, true }},
-    {"C2_PS_WEIGHT_EXC_S_N", { DYNAPSE_CONFIG_BIAS_C2_PS_WEIGHT_EXC_S_N, true, true, true }},
-    {"C2_PS_WEIGHT_EXC_F_N", { DYNAPSE_CONFIG_BIAS_C2_PS_WEIGHT_EXC_F_N, true, true, true }},
-    {"C2_IF_RFR_N", { DYNAPSE_CONFIG_BIAS_C2_IF_RFR_N, true, true, true }},
-    {"C2_IF_TAU1_N", { DYNAPSE_CONFIG_BIAS_C2_IF_TAU1_N, false, true, true }},
-    {"C2_IF_AHTAU_N", { DYNAPSE_CONFIG_BIAS_C2_IF_AHTAU_N, true, true, true }},
-    {"C2_IF_CASC_N", { DYNAPSE_CONFIG_BIAS_C2_IF_CASC_N, true, true, true }},
-    {"C2_IF_TAU2_N", { DYNAPSE_CONFIG_BIAS_C2_IF_TAU2_N, true, true, true }},
-    {"C2_IF_BUF_P", { DYNAPSE_CONFIG_BIAS_C2_IF_BUF_P, false, true, true }},
-    {"C2_IF_AHTHR_N", { DYNAPSE_CONFIG_BIAS_C2_IF_AHTHR_N, true, true, true }},
-    {"C2_IF_THR_N", { DYNAPSE_CONFIG_BIAS_C2_IF_THR_N, true, true, true }},
-    {"C2_NPDPIE_THR_S_P", { DYNAPSE_CONFIG_BIAS_C2_NPDPIE_THR_S_P, false, true, true }},
-    {"C2_NPDPIE_THR_F_P", { DYNAPSE_CONFIG_BIAS_C2_NPDPIE_THR_F_P, false, true, true }},
-    {"C2_NPDPII_THR_F_P", { DYNAPSE_CONFIG_BIAS_C2_NPDPII_THR_F_P, false, true, true }},
-    {"C2_NPDPII_THR_S_P", { DYNAPSE_CONFIG_BIAS_C2_NPDPII_THR_S_P, false, true, true }},
-    {"C2_IF_NMDA_N", { DYNAPSE_CONFIG_BIAS_C2_IF_NMDA_N, true, true, true }},
-    {"C2_IF_DC_P", { DYNAPSE_CONFIG_BIAS_C2_IF_DC_P, false, true, true }},
-    {"C2_IF_AHW_P", { DYNAPSE_CONFIG_BIAS_C2_IF_AHW_P, false, true, true }},
-    {"C2_NPDPII_TAU_S_P", { DYNAPSE_CONFIG_BIAS_C2_NPDPII_TAU_S_P, false, true, true }},
-    {"C2_NPDPII_TAU_F_P", { DYNAPSE_CONFIG_BIAS_C2_NPDPII_TAU_F_P, false, true, true }},
-    {"C2_NPDPIE_TAU_F_P", { DYNAPSE_CONFIG_BIAS_C2_NPDPIE_TAU_F_P, false, true, true }},
-    {"C2_NPDPIE_TAU_S_P", { DYNAPSE_CONFIG_BIAS_C2_NPDPIE_TAU_S_P, false, true, true }},
-    {"C2_R2R_P", { DYNAPSE_CONFIG_BIAS_C2_R2R_P, false, true, true }},
-
-    // ------- C3 -------
-    {"C3_PULSE_PWLK_P", { DYNAPSE_CONFIG_BIAS_C3_PULSE_PWLK_P, false, true, true }},
-    {"C3_PS_WEIGHT_INH_S_N", { DYNAPSE_CONFIG_BIAS_C3_PS_WEIGHT_INH_S_N, true, true, true }},
-    {"C3_PS_WEIGHT_INH_F_N", { DYNAPSE_CONFIG_BIAS_C3_PS_WEIGHT_INH_F_N, true, true, true }},
-    {"C3_PS_WEIGHT_EXC_S_N", { DYNAPSE_CONFIG_BIAS_C3_PS_WEIGHT_EXC_S_N, true, true, true }},
-    {"C3_PS_WEIGHT_EXC_F_N", { DYNAPSE_CONFIG_BIAS_C3_PS_WEIGHT_EXC_F_N, true, true, true }},
-    {"C3_IF_RFR_N", { DYNAPSE_CONFIG_BIAS_C3_IF_RFR_N, true, true, true }},
-    {"C3_IF_TAU1_N", { DYNAPSE_CONFIG_BIAS_C3_IF_TAU1_N, false, true, true }},
-    {"C3_IF_AHTAU_N", { DYNAPSE_CONFIG_BIAS_C3_IF_AHTAU_N, true, true, true }},
-    {"C3_IF_CASC_N", { DYNAPSE_CONFIG_BIAS_C3_IF_CASC_N, true, true, true }},
-    {"C3_IF_TAU2_N", { DYNAPSE_CONFIG_BIAS_C3_IF_TAU2_N, true, true, true }},
-    {"C3_IF_BUF_P", { DYNAPSE_CONFIG_BIAS_C3_IF_BUF_P, false, true, true }},
-    {"C3_IF_AHTHR_N", { DYNAPSE_CONFIG_BIAS_C3_IF_AHTHR_N, true, true, true }},
-    {"C3_IF_THR_N", { DYNAPSE_CONFIG_BIAS_C3_IF_THR_N, true, true, true }},
-    {"C3_NPDPIE_THR_S_P", { DYNAPSE_CONFIG_BIAS_C3_NPDPIE_THR_S_P, false, true, true }},
-    {"C3_NPDPIE_THR_F_P", { DYNAPSE_CONFIG_BIAS_C3_NPDPIE_THR_F_P, false, true, true }},
-    {"C3_NPDPII_THR_F_P", { DYNAPSE_CONFIG_BIAS_C3_NPDPII_THR_F_P, false, true, true }},
-    {"C3_NPDPII_THR_S_P", { DYNAPSE_CONFIG_BIAS_C3_NPDPII_THR_S_P, false, true, true }},
-    {"C3_IF_NMDA_N", { DYNAPSE_CONFIG_BIAS_C3_IF_NMDA_N, true, true, true }},
-    {"C3_IF_DC_P", { DYNAPSE_CONFIG_BIAS_C3_IF_DC_P, false, true, true }},
-    {"C3_IF_AHW_P", { DYNAPSE_CONFIG_BIAS_C3_IF_AHW_P, false, true, true }},
-    {"C3_NPDPII_TAU_S_P", { DYNAPSE_CONFIG_BIAS_C3_NPDPII_TAU_S_P, false, true, true }},
-    {"C3_NPDPII_TAU_F_P", { DYNAPSE_CONFIG_BIAS_C3_NPDPII_TAU_F_P, false, true, true }},
-    {"C3_NPDPIE_TAU_F_P", { DYNAPSE_CONFIG_BIAS_C3_NPDPIE_TAU_F_P, false, true, true }},
-    {"C3_NPDPIE_TAU_S_P", { DYNAPSE_CONFIG_BIAS_C3_NPDPIE_TAU_S_P, false, true, true }},
-    {"C3_R2R_P", { DYNAPSE_CONFIG_BIAS_C3_R2R_P, false, true, true }},
-
-    // ------- U + D -------
-    {"U_BUFFER", { DYNAPSE_CONFIG_BIAS_U_BUFFER, false, true, true }},
-    {"U_SSP", { DYNAPSE_CONFIG_BIAS_U_SSP, false, true, true }},
-    {"U_SSN", { DYNAPSE_CONFIG_BIAS_U_SSN, true, true, true }},
-    {"D_BUFFER", { DYNAPSE_CONFIG_BIAS_D_BUFFER, false, true, true }},
-    {"D_SSP", { DYNAPSE_CONFIG_BIAS_D_SSP, false, true, true }},
-    {"D_SSN", { DYNAPSE_CONFIG_BIAS_D_SSN, true, true, true }}
-
-};
-
 static void globalShutdownSignalHandler(int signal) {
 	if (signal == SIGTERM || signal == SIGINT) {
 		globalShutdown.store(true);
@@ -213,96 +117,66 @@ void setupSignalHandlers() {
 #endif
 }
 
-bool loadBiases(caerDeviceHandle handle, const std::string &biasFile) {
-    std::ifstream input(biasFile);
-    if (!input.is_open()) {
-        std::cerr << "Error opening bias file: " << biasFile << std::endl;
-        return false;
-    }
-
-    // Ensure bias generator is enabled
-    caerDeviceConfigSet(handle, DYNAPSE_CONFIG_MUX, DYNAPSE_CONFIG_MUX_FORCE_CHIP_BIAS_ENABLE, true);
-
-    // Detect format
-    std::string firstLine;
-    if (!std::getline(input, firstLine)) {
-        std::cerr << "Empty bias file: " << biasFile << std::endl;
+static bool generateBiasWord(const std::string &biasName, int coarse, int fine, uint32_t *word) {
+    int biasId = lookupBias(biasName.data(), biasName.size());
+    if (biasId < 0) {
         return false;
     }
 
-    input.clear();
-    input.seekg(0, std::ios::beg);
-
-    std::istringstream issTest(firstLine);
-    int testInt;
-    if (issTest >> testInt) {
-        // Detected RAW → LOAD ONLY, do not touch currentBiasValues
-        std::cout << "Biases loaded in RAW format from " << biasFile << std::endl;
+    *word = biasWord(biasId, coarse, fine);
+    return true;
+}
 
-        for (std::string line; std::getline(input, line);) {
-            std::istringstream issRaw(line);
-            uint32_t rawValue;
-            if (!(issRaw >> rawValue)) {
-                std::cerr << "Invalid RAW bias line: " << line << std::endl;
-                continue;
-            }
+// Bias files are compiled to CHIP_CONTENT words once; see bias_image.h.
+BiasImageCache biasImageCache(generateBiasWord);
 
-            caerDeviceConfigSet(handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_CONTENT, rawValue);
-        }
+bool loadBiases(DynapseDevice *handle, const std::string &biasFile) {
+    BiasImagePtr image = biasImageCache.get(biasFile);
+    if (!image) {
+        return false;
     }
-    else {
-        // Detected NAMED → LOAD AND FILL currentBiasValues
-        std::cout << "Biases loaded in NAMED format from " << biasFile << std::endl;
-        currentBiasValues.clear();
-
-        for (std::string line; std::getline(input, line);) {
-            std::istringstream issNamed(line);
-            std::string biasName;
-            int coarse, fine;
-
-            if (!(issNamed >> biasName >> coarse >> fine)) {
-                std::cerr << "Invalid NAMED bias line: " << line << std::endl;
-                continue;
-            }
-
-            auto it = biasFlagMap.find(biasName);
-            if (it == biasFlagMap.end()) {
-                std::cerr << "Unknown bias name: " << biasName << " → skipping." << std::endl;
-                continue;
-            }
-
-            uint32_t param = it->second.param;
 
-            caer_bias_dynapse biasStruct;
-            biasStruct.biasAddress = param;
-            biasStruct.coarseValue = coarse;
-            biasStruct.fineValue = fine;
-            biasStruct.enabled = true;
-            biasStruct.sexN = it->second.sexN;
-            biasStruct.typeNormal = it->second.typeNormal;
-            biasStruct.biasHigh = it->second.biasHigh;
-
-            uint32_t biasValue = caerBiasDynapseGenerate(biasStruct);
-            caerDeviceConfigSet(handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_CONTENT, biasValue);
+    // Ensure bias generator is enabled
+    handle->configSet(DYNAPSE_CONFIG_MUX, DYNAPSE_CONFIG_MUX_FORCE_CHIP_BIAS_ENABLE, true);
 
-            currentBiasValues[biasName] = { coarse, fine };
+    auto start = std::chrono::steady_clock::now();
+    if (!handle->sendDataToUSB(image->words.data(), image->words.size())) {
+        for (uint32_t word : image->words) {
+            handle->configSet(DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_CONTENT, word);
         }
     }
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
 
-    input.close();
+    std::cout << "Biases loaded in " << (image->named ? "NAMED" : "RAW") << " format from " << biasFile << " ("
+              << image->words.size() << " words in " << static_cast<int>(us) << " us)" << std::endl;
     return true;
 }
 
 
 
-void saveBiases(const std::string &filename) {
+// Writes the biases of one chip, decoded from its shadow, as a NAMED file.
+bool saveBiases(const std::string &filename, int chipId, ConfigResult &result) {
+    const ChipShadow *chip = (deviceShadow != NULL && chipId >= 0) ? deviceShadow->chipShadow(chipId) : NULL;
+    if (chip == NULL) {
+        return result.fail("No chip selected to save biases from (SAVE <file> U0|U1|U2|U3).");
+    }
+
     std::ofstream output(filename);
     if (!output.is_open()) {
-        std::cerr << "Error opening file for writing: " << filename << std::endl;
-        return;
+        return result.fail("Error opening file for writing: %s", filename.c_str());
+    }
+
+    std::map<std::string, std::pair<int, int>> chipBiasValues;
+    char name[BIAS_NAME_MAX];
+    for (int biasId = 0; biasId < BIAS_COUNT; biasId++) {
+        uint8_t address = biasParam(biasId);
+        if (chip->biases.known[address]) {
+            caer_bias_dynapse bias = caerBiasDynapseParse(chip->biases.words[address]);
+            chipBiasValues[biasName(biasId, name)] = { bias.coarseValue, bias.fineValue };
+        }
     }
 
-    for (const auto& entry : currentBiasValues) {
+    for (const auto& entry : chipBiasValues) {
         const std::string& biasName = entry.first;
         int coarseReversed = entry.second.first;
         int fine = entry.second.second;
@@ -314,51 +188,14 @@ void saveBiases(const std::string &filename) {
     }
 
     output.close();
-    std::cout << "Biases saved to " << filename << std::endl;
+    std::cout << chipBiasValues.size() << " biases of chip " << chipId << " saved to " << filename << std::endl;
+    return true;
 }
 
 
-bool configureDevice(caerDeviceHandle handle, const std::string &biasFile) {
-	printf("Applying biases from %s...\n", biasFile.c_str());
-	
-
-	if (!loadBiases(handle, biasFile)) {
-		return false;
-	}
-	
-	// Enable neuron monitors (example: neuron 0 from all cores)
-	caerDeviceConfigSet(handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, DYNAPSE_CONFIG_DYNAPSE_U0);
-	for (int core = 0; core < 4; core++) {
-		caerDeviceConfigSet(handle, DYNAPSE_CONFIG_MONITOR_NEU, core, 0);
-	}
-	caerDeviceConfigSet(handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, DYNAPSE_CONFIG_DYNAPSE_U1);
-	for (int core = 0; core < 4; core++) {
-		caerDeviceConfigSet(handle, DYNAPSE_CONFIG_MONITOR_NEU, core, 0);
-	}
-	caerDeviceConfigSet(handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, DYNAPSE_CONFIG_DYNAPSE_U2);
-	for (int core = 0; core < 4; core++) {
-		caerDeviceConfigSet(handle, DYNAPSE_CONFIG_MONITOR_NEU, core, 0);
-	}
-	caerDeviceConfigSet(handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, DYNAPSE_CONFIG_DYNAPSE_U3);
-	for (int core = 0; core < 4; core++) {
-		caerDeviceConfigSet(handle, DYNAPSE_CONFIG_MONITOR_NEU, core, 0);
-	}
-
-	return true;
-}
-
-void setupSocketServer(int port = 9001) {
-	serverSocket = socket(AF_INET, SOCK_STREAM, 0);
-	sockaddr_in serverAddr{};
-	serverAddr.sin_family = AF_INET;
-	serverAddr.sin_addr.s_addr = INADDR_ANY;
-	serverAddr.sin_port = htons(port);
-
-	bind(serverSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr));
-	listen(serverSocket, 1);
-	printf("Waiting for GUI to connect on port %d...\n", port);
-	clientSocket = accept(serverSocket, nullptr, nullptr);
-	printf("GUI connected.\n");
+bool setupSocketServer(int port = 9001) {
+	// Clients (GUI, recorder, analysis) may connect and leave at any time.
+	return spikeServer.start(port);
 }
 
 void setupConfigSocketServer(int port = 9002) {
@@ -377,367 +214,1059 @@ void setupConfigSocketServer(int port = 9002) {
 
 
 
-void configHandler(caerDeviceHandle handle) {
-    char buffer[256];
-    while (!globalShutdown.load()) {
-        ssize_t len = recv(configClient, buffer, sizeof(buffer) - 1, 0);
-        if (len > 0) {
-            buffer[len] = '\0';
-            std::string command(buffer);
-            std::istringstream iss(command);
-            std::string token;
-            iss >> token;
-            //std::cout << "[DEBUG] token '" << token << "'" << std::endl;
-            if (token == "LOAD") {
-                std::string filename;
-                iss >> filename;
-                std::string path = "data/" + filename;
-                std::cout << "Reconfiguring with bias file: " << path << std::endl;
-                configureDevice(handle, path);
-            } else if (token == "SET") {
-                int core_id;
-                std::string bias_base_name;
-                int coarse, fine;
-                iss >> core_id >> bias_base_name >> coarse >> fine;
-
-                std::ostringstream full_bias_name;
-                if (bias_base_name.rfind("C", 0) != 0 && bias_base_name != "U_BUFFER" && bias_base_name != "D_BUFFER" && bias_base_name != "U_SSP" && bias_base_name != "U_SSN" && bias_base_name != "D_SSP" && bias_base_name != "D_SSN") {
-                    // Core-specific: auto-prefix with "C{core_id}_"
-                    full_bias_name << "C" << core_id << "_" << bias_base_name;
-                } else {
-                    // U or D biases → leave as is
-                    full_bias_name << bias_base_name;
-                }
+// "SET <core> <bias> <coarse> <fine>": <bias> is per core ("IF_DC_P"), a full name or a U/D bias.
+static bool setBias(DynapseDevice *handle, const char *args, ConfigResult &result) {
+    int core_id, coarse, fine;
+    char bias_name[BIAS_NAME_MAX];
+    if (sscanf(args, "%d %31s %d %d", &core_id, bias_name, &coarse, &fine) != 4) {
+        return result.fail("Usage: SET <core> <bias> <coarse> <fine>");
+    }
 
-                std::string bias_name = full_bias_name.str();
+    int biasId = lookupBiasOnCore(core_id, bias_name, strlen(bias_name));
+    if (biasId < 0) {
+        return result.fail("Unknown bias name: %s", bias_name);
+    }
 
-                std::cout << "Setting bias: core " << core_id << " bias " << bias_name
-                          << " coarse " << coarse << " fine " << fine << std::endl;
+    char full_name[BIAS_NAME_MAX];
+    std::cout << "Setting bias: core " << core_id << " bias " << biasName(biasId, full_name)
+              << " coarse " << coarse << " fine " << fine << std::endl;
 
-                auto it = biasFlagMap.find(bias_name);
-                if (it == biasFlagMap.end()) {
-                    std::cerr << "Unknown bias name: " << bias_name << std::endl;
-                    continue;
-                }
+    if (!handle->configSet(DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_CONTENT, biasWord(biasId, coarse, fine))) {
+        return result.fail("Bias write failed: %s", full_name);
+    }
 
-                // Compute correct bias param based on core
-                uint32_t param = it->second.param;
-                
-                struct caer_bias_dynapse biasStruct;
-                biasStruct.biasAddress = param; // Already correct!
-                biasStruct.coarseValue = coarse;
-                biasStruct.fineValue = fine;
-                biasStruct.enabled = true;
-                biasStruct.sexN = it->second.sexN;
-                biasStruct.typeNormal = it->second.typeNormal;
-                biasStruct.biasHigh = it->second.biasHigh;
-
-                uint32_t bias_value = caerBiasDynapseGenerate(biasStruct);
-                caerDeviceConfigSet(handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_CONTENT, bias_value);
-
-                currentBiasValues[bias_name] = { coarse, fine };
-                std::cout << "Bias applied." << std::endl;
-            } else if (token == "SAVE") {
-                std::string filename;
-                iss >> filename;
-                std::string path = "data/" + filename;
-                cout << "Saving biases to file: " << path << endl;
-                saveBiases(path);
-            }else if (token == "PARAM_SET") {
-                std::string moduleStr, paramStr;
-                int value;
-                iss >> moduleStr >> paramStr >> value;
-
-                uint8_t module = 0;
-                if (moduleStr == "CHIP") module = DYNAPSE_CONFIG_CHIP;
-                else if (moduleStr == "MUX") module = DYNAPSE_CONFIG_MUX;
-                else if (moduleStr == "AER") module = DYNAPSE_CONFIG_AER;
-                else {
-                    std::cerr << "Unknown module: " << moduleStr << std::endl;
-                    continue;
-                }
+    std::cout << "Bias applied." << std::endl;
+    return true;
+}
 
-                auto it = parameterMap.find(paramStr);
-                if (it == parameterMap.end()) {
-                    std::cerr << "Unknown param: " << paramStr << std::endl;
-                    continue;
-                }
+// PARAM_SET module name → DYNAPSE_CONFIG_<name>, -1 if unknown.
+static int lookupModule(const char *name) {
+    if (strcmp(name, "CHIP") == 0) return DYNAPSE_CONFIG_CHIP;
+    if (strcmp(name, "MUX") == 0) return DYNAPSE_CONFIG_MUX;
+    if (strcmp(name, "AER") == 0) return DYNAPSE_CONFIG_AER;
+    return -1;
+}
 
-                std::cout << "Setting PARAM: " << moduleStr << " " << paramStr
-                          << " = " << value << std::endl;
-
-                caerDeviceConfigSet(handle, module, it->second, value);
-            } else if (token == "MONITOR_SET") {
-                int monitorId, coreId, neuronId;
-                iss >> monitorId >> coreId >> neuronId;
-
-                std::cout << "Setting MONITOR_NEU monitor=" << monitorId
-                          << " core=" << coreId
-                          << " neuron=" << neuronId << std::endl;
-
-                caerDeviceConfigSet(handle, DYNAPSE_CONFIG_MONITOR_NEU, coreId, neuronId);
-            } else if (token == "CAM_SET") {
-                int inputNeuron, targetNeuron, camId, synType;
-                iss >> inputNeuron >> targetNeuron >> camId >> synType;
-
-                std::cout << "Writing CAM: InputNeuron=" << inputNeuron
-                          << " TargetNeuron=" << targetNeuron
-                          << " CAM_ID=" << camId
-                          << " SynapseType=" << synType << std::endl;
-
-                caerDynapseWriteCam(handle,
-                    static_cast<uint16_t>(inputNeuron),
-                    static_cast<uint16_t>(targetNeuron),
-                    static_cast<uint8_t>(camId),
-                    static_cast<uint8_t>(synType));
-            }else if (token == "ROUTE_SET") {
-                int chip, core, neuronCore, sramId, virtCore, sx, dx, sy, dy, destCore;
-                iss >> chip >> core >> neuronCore >> sramId >> virtCore >> sx >> dx >> sy >> dy >> destCore;
-
-                std::cout << "ROUTE_SET: CHIP=" << chip
-                          << " CORE=" << core
-                          << " NEURON=" << neuronCore
-                          << " SRAM=" << sramId
-                          << " VirtCore=" << virtCore
-                          << " SX=" << sx << " DX=" << dx
-                          << " SY=" << sy << " DY=" << dy
-                          << " DEST=" << destCore << std::endl;
-
-                // Set CHIP_ID first:
-                caerDeviceConfigSet(handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, chip);
-
-                // Compute global neuronId:
-                uint16_t neuronId = caerDynapseCoreAddrToNeuronId(core, neuronCore);
-
-                // Write SRAM:
-                uint32_t sramWord = caerDynapseGenerateSramBits(
-                    neuronId,
-                    static_cast<uint8_t>(sramId),
-                    static_cast<uint8_t>(virtCore),
-                    static_cast<bool>(sx),
-                    static_cast<uint8_t>(dx),
-                    static_cast<bool>(sy),
-                    static_cast<uint8_t>(dy),
-                    static_cast<uint8_t>(destCore)
-                );
-
-                // Now perform write:
-                caerDeviceConfigSet(handle, DYNAPSE_CONFIG_SRAM, DYNAPSE_CONFIG_SRAM_WRITEDATA, sramWord);
-                caerDeviceConfigSet(handle, DYNAPSE_CONFIG_SRAM, DYNAPSE_CONFIG_SRAM_RWCOMMAND, DYNAPSE_CONFIG_SRAM_WRITE);
-                caerDeviceConfigSet(handle, DYNAPSE_CONFIG_SRAM, DYNAPSE_CONFIG_SRAM_ADDRESS,
-                                    neuronId * 4 + sramId); // Each neuron has 4 SRAMs
-
-                std::cout << "SRAM write completed." << std::endl;
-            }else if (token == "HELP") {
-                std::cout << "Available biases:" << std::endl;
-                for (const auto& entry : biasFlagMap) {
-                    std::cout << "  " << entry.first << std::endl;
+// "PARAM_SET <CHIP|MUX|AER> <param> <value>"
+static bool setParameter(DynapseDevice *handle, const char *args, ConfigResult &result) {
+    char moduleStr[16], paramStr[BIAS_NAME_MAX];
+    int value;
+    if (sscanf(args, "%15s %31s %d", moduleStr, paramStr, &value) != 3) {
+        return result.fail("Usage: PARAM_SET <CHIP|MUX|AER> <param> <value>");
+    }
+
+    int module = lookupModule(moduleStr);
+    if (module < 0) {
+        return result.fail("Unknown module: %s", moduleStr);
+    }
+
+    int param = lookupParameter(paramStr, strlen(paramStr));
+    if (param < 0) {
+        return result.fail("Unknown param: %s", paramStr);
+    }
+
+    std::cout << "Setting PARAM: " << moduleStr << " " << paramStr
+              << " = " << value << std::endl;
+
+    if (!handle->configSet(static_cast<uint8_t>(module), static_cast<uint8_t>(param), value)) {
+        return result.fail("Parameter write failed: %s %s", moduleStr, paramStr);
+    }
+    return true;
+}
+
+// Programs a CAM table in bulk and restores the chip selection of the config client.
+static bool programCam(DynapseDevice *handle, const std::vector<CamEntry> &entries, const char *source,
+                       ConfigResult &result) {
+    int selectedChip = deviceShadow->selectedChip();
+    CamProgramReport report;
+    bool ok = programCamTable(handle, deviceShadow, entries, report);
+    if (selectedChip >= 0) {
+        handle->configSet(DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, selectedChip);
+    }
+    printf("CAM: %zu entries from %s to %zu chips in %.1f ms (%.0f entries/s, %zu already present).\n",
+           report.entries, source, report.chips, report.us / 1000.0, report.entriesPerSecond(), report.present);
+    return ok || result.fail("CAM write failed (%s)", source);
+}
+
+// Loads a network_compiler program: all CAMs, then all routes, one transfer per chip each.
+static bool loadNetwork(DynapseDevice *handle, const std::string &path, ConfigResult &result) {
+    NetworkProgram program;
+    if (!readNetworkProgram(path, program)) {
+        return result.fail("Cannot load network program: %s", path.c_str());
+    }
+
+    std::vector<CamEntry> cams(program.cams.size());
+    for (size_t i = 0; i < program.cams.size(); i++) {
+        const NetCamRecord &record = program.cams[i];
+        const long fields[4] = {record.inputNeuron, record.neuronAddr, record.camId, record.synapseType};
+        if (!makeCamEntry(record.chipId, fields, cams[i])) {
+            return result.fail("Invalid CAM in network program: %s", path.c_str());
+        }
+    }
+    std::vector<RouteEntry> routes(program.routes.size());
+    for (size_t i = 0; i < program.routes.size(); i++) {
+        const NetRouteRecord &record = program.routes[i];
+        const long fields[9] = {record.core, record.neuron, record.sramId, record.virtualCore, record.sx,
+                                record.dx, record.sy, record.dy, record.destCores};
+        if (!makeRouteEntry(record.chipId, fields, routes[i])) {
+            return result.fail("Invalid route in network program: %s", path.c_str());
+        }
+    }
+
+    int selectedChip = deviceShadow->selectedChip();
+    CamProgramReport camReport;
+    RouteLoadReport routeReport;
+    bool ok = programCamTable(handle, deviceShadow, cams, camReport);
+    ok = programRouteTable(handle, deviceShadow, routes, routeReport) && ok;
+    if (selectedChip >= 0) {
+        handle->configSet(DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, selectedChip);
+    }
+
+    printf("Network %s: %zu CAM entries in %.1f ms, %zu routes in %.1f ms (%zu CAMs, %zu routes already present).\n",
+           path.c_str(), camReport.entries, camReport.us / 1000.0, routeReport.entries, routeReport.us / 1000.0,
+           camReport.present, routeReport.present);
+    for (const NetPopulation &population : program.populations) {
+        printf("  %s: %zu neurons\n", population.name.c_str(), population.neuronIds.size());
+    }
+    return ok || result.fail("Network write failed (%s)", path.c_str());
+}
+
+// One Poisson batch: only rates that changed are written.
+static bool programPoisson(DynapseDevice *handle, const std::vector<PoissonRate> &rates, const char *source,
+                           ConfigResult &result) {
+    PoissonProgramReport report;
+    const char *error = "";
+    if (!poissonRates.program(handle, rates, report, &error)) {
+        return result.fail("Poisson rates from %s not applied: %s", source, error);
+    }
+    printf("Poisson: %zu rates from %s in %.1f us, %zu written with %zu DATA writes, %zu unchanged.\n",
+           report.entries, source, report.us, report.written, report.dataWrites, report.unchanged);
+    return true;
+}
+
+// "SWEEP <chip> <cores> <bias> <coarse>[-<coarse>] <fine>[-<fine>][/<step>] [settle ms] [measure ms] [file]"
+// "SWEEP_TARGET <chip> <cores> <bias> <coarse> <target Hz> [settle ms] [measure ms] [file]"
+static bool startSweep(std::istringstream &iss, uint8_t mode, ConfigResult &result) {
+    SweepSettings settings;
+    settings.mode = mode;
+    std::string chip, cores, coarse, fine, filename = SWEEP_DEFAULT_FILE;
+    iss >> chip >> cores >> settings.bias >> coarse;
+    const char *chipText = chip.c_str();
+    bool ok = parseChipId(&chipText, &settings.chipId) && isBlank(chipText);
+    settings.coreMask = parseSweepCores(cores);
+    if (mode == SWEEP_GRID) {
+        iss >> fine;
+        ok = ok && parseSweepRange(coarse, 7, settings.coarseLo, settings.coarseHi)
+             && parseSweepRange(fine, 255, settings.fineLo, settings.fineHi, &settings.fineStep);
+    }
+    else {
+        ok = ok && parseSweepRange(coarse, 7, settings.coarseLo, settings.coarseHi)
+             && settings.coarseLo == settings.coarseHi && (iss >> settings.targetHz) && settings.targetHz >= 0;
+    }
+    if (!ok || settings.coreMask == 0) {
+        return result.fail(mode == SWEEP_GRID
+                               ? "Usage: SWEEP <chip> <cores|ALL> <bias> <coarse>[-<coarse>] <fine>[-<fine>][/<step>] "
+                                 "[settle ms] [measure ms] [file]"
+                               : "Usage: SWEEP_TARGET <chip> <cores|ALL> <bias> <coarse> <target Hz> [settle ms] "
+                                 "[measure ms] [file]");
+    }
+    if (!(iss >> settings.settleMs)) settings.settleMs = SWEEP_DEFAULT_SETTLE_MS;
+    if (!(iss >> settings.measureMs)) settings.measureMs = SWEEP_DEFAULT_MEASURE_MS;
+    iss.clear();
+    iss >> filename;
+    if (settings.measureMs == 0) {
+        return result.fail("SWEEP needs a measurement time > 0 ms");
+    }
+    settings.path = "data/" + filename;
+    const char *error = "";
+    if (!biasSweep.start(deviceShadow, settings, &error)) {
+        return result.fail("Sweep not started: %s", error);
+    }
+    return true;
+}
+
+// Runs one config command. Errors are reported through result (and stderr).
+static bool runConfigCommand(DynapseDevice *handle, const char *command, ConfigResult &result) {
+    // GUI sliders send these at high rate: parsed in place, no allocation.
+    if (strncmp(command, "SET ", 4) == 0) {
+        return setBias(handle, command + 4, result);
+    }
+    if (strncmp(command, "PARAM_SET ", 10) == 0) {
+        return setParameter(handle, command + 10, result);
+    }
+
+    std::istringstream iss(command);
+    std::string token;
+    iss >> token;
+    //std::cout << "[DEBUG] token '" << token << "'" << std::endl;
+    if (token.empty()) {
+        return true;
+    } else if (token == "LOAD") {
+        std::string filename;
+        iss >> filename;
+        std::string path = "data/" + filename;
+        std::cout << "Reconfiguring with bias file: " << path << std::endl;
+        if (!loadBiases(handle, path)) {
+            return result.fail("Cannot load bias file: %s", path.c_str());
+        }
+    } else if (token == "SAVE") {
+        std::string filename, chipName;
+        iss >> filename >> chipName;
+        int chipId = deviceShadow->selectedChip();
+        if (chipName == "U0") chipId = DYNAPSE_CONFIG_DYNAPSE_U0;
+        else if (chipName == "U1") chipId = DYNAPSE_CONFIG_DYNAPSE_U1;
+        else if (chipName == "U2") chipId = DYNAPSE_CONFIG_DYNAPSE_U2;
+        else if (chipName == "U3") chipId = DYNAPSE_CONFIG_DYNAPSE_U3;
+        std::string path = "data/" + filename;
+        cout << "Saving biases to file: " << path << endl;
+        return saveBiases(path, chipId, result);
+    } else if (token == "SHADOW_RESET") {
+        // After a board reset the shadow no longer matches; the next LOAD rewrites everything.
+        deviceShadow->invalidate();
+        poissonRates.invalidate();
+        std::cout << "Bias shadow cleared." << std::endl;
+    } else if (token == "MONITOR_SET") {
+        int monitorId, coreId, neuronId;
+        if (!(iss >> monitorId >> coreId >> neuronId)) {
+            return result.fail("Usage: MONITOR_SET <monitor> <core> <neuron>");
+        }
+
+        std::cout << "Setting MONITOR_NEU monitor=" << monitorId
+                  << " core=" << coreId
+                  << " neuron=" << neuronId << std::endl;
+
+        if (!handle->configSet(DYNAPSE_CONFIG_MONITOR_NEU, coreId, neuronId)) {
+            return result.fail("Monitor write failed");
+        }
+    } else if (token == "CAM_SET") {
+        int inputNeuron, targetNeuron, camId, synType;
+        if (!(iss >> inputNeuron >> targetNeuron >> camId >> synType)) {
+            return result.fail("Usage: CAM_SET <input neuron> <target neuron> <cam> <synapse type>");
+        }
+
+        std::cout << "Writing CAM: InputNeuron=" << inputNeuron
+                  << " TargetNeuron=" << targetNeuron
+                  << " CAM_ID=" << camId
+                  << " SynapseType=" << synType << std::endl;
+
+        if (!handle->writeCam(
+                static_cast<uint16_t>(inputNeuron),
+                static_cast<uint16_t>(targetNeuron),
+                static_cast<uint8_t>(camId),
+                static_cast<uint8_t>(synType))) {
+            return result.fail("CAM write failed");
+        }
+    } else if (token == "CAM_LOAD") {
+        // CAM_LOAD <file>: whole connectivity table, see cam_table.h
+        std::string filename;
+        iss >> filename;
+        std::string path = "data/" + filename;
+        std::vector<CamEntry> entries;
+        if (filename.empty() || !loadCamFile(path, entries)) {
+            return result.fail("Cannot load CAM table: %s", path.c_str());
+        }
+        return programCam(handle, entries, path.c_str(), result);
+    } else if (token == "CAM_TABLE") {
+        // CAM_TABLE <chip> <input> <target> <cam> <type>; ...
+        std::vector<CamEntry> entries;
+        if (!parseCamTable(command + strlen("CAM_TABLE"), entries)) {
+            return result.fail("Invalid CAM_TABLE entry after %zu entries", entries.size());
+        }
+        return programCam(handle, entries, "CAM_TABLE", result);
+    } else if (token == "NET_LOAD") {
+        // NET_LOAD <file>: program written by network_compiler
+        std::string filename;
+        iss >> filename;
+        if (filename.empty()) {
+            return result.fail("Usage: NET_LOAD <program file>");
+        }
+        return loadNetwork(handle, "data/" + filename, result);
+    } else if (token == "ROUTE_SET") {
+        int chip, core, neuronCore, sramId, virtCore, sx, dx, sy, dy, destCore;
+        if (!(iss >> chip >> core >> neuronCore >> sramId >> virtCore >> sx >> dx >> sy >> dy >> destCore)) {
+            return result.fail("Usage: ROUTE_SET <chip> <core> <neuron> <sram> <virtual core> <sx> <dx> <sy> <dy> <dest cores>");
+        }
+
+        std::cout << "ROUTE_SET: CHIP=" << chip
+                  << " CORE=" << core
+                  << " NEURON=" << neuronCore
+                  << " SRAM=" << sramId
+                  << " VirtCore=" << virtCore
+                  << " SX=" << sx << " DX=" << dx
+                  << " SY=" << sy << " DY=" << dy
+                  << " DEST=" << destCore << std::endl;
+
+        // A one-entry route table; leaves CHIP_ID on the routed chip, as before.
+        RouteEntry entry;
+        if (!parseRouteEntry(command + strlen("ROUTE_SET"), entry)) {
+            return result.fail("ROUTE_SET value out of range");
+        }
+        RouteLoadReport report;
+        if (!programRouteTable(handle, deviceShadow, std::vector<RouteEntry>(1, entry), report)) {
+            return result.fail("SRAM write failed");
+        }
+
+        std::cout << (report.present ? "SRAM entry already present." : "SRAM write completed.") << std::endl;
+    } else if (token == "ROUTE_LOAD") {
+        // ROUTE_LOAD <file>: whole routing table, see route_table.h
+        std::string filename;
+        iss >> filename;
+        std::string path = "data/" + filename;
+        std::vector<RouteEntry> entries;
+        if (filename.empty() || !loadRouteFile(path, entries)) {
+            return result.fail("Cannot load route table: %s", path.c_str());
+        }
+        int selectedChip = deviceShadow->selectedChip();
+        RouteLoadReport report;
+        bool ok = programRouteTable(handle, deviceShadow, entries, report);
+        if (selectedChip >= 0) {
+            handle->configSet(DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, selectedChip);
+        }
+        printf("Routes: %zu cells from %s (U0 %zu, U1 %zu, U2 %zu, U3 %zu, %zu duplicates) in %.1f ms (%.0f entries/s): "
+               "%zu written, %zu already present, %zu/%zu verified against the shadow.\n",
+               report.entries, path.c_str(), report.perChip[shadowChipSlot(DYNAPSE_CONFIG_DYNAPSE_U0)],
+               report.perChip[shadowChipSlot(DYNAPSE_CONFIG_DYNAPSE_U1)],
+               report.perChip[shadowChipSlot(DYNAPSE_CONFIG_DYNAPSE_U2)],
+               report.perChip[shadowChipSlot(DYNAPSE_CONFIG_DYNAPSE_U3)], report.duplicates, report.us / 1000.0,
+               report.entriesPerSecond(), report.written, report.present, report.verified, report.entries);
+        if (!ok) {
+            return result.fail("SRAM write failed (%s)", path.c_str());
+        }
+    } else if (token == "POISSON") {
+        // POISSON <chip> <core> <neuron> <rate Hz>; ...
+        std::vector<PoissonRate> rates;
+        if (!parsePoissonTable(command + strlen("POISSON"), rates)) {
+            return result.fail("Invalid POISSON entry after %zu entries", rates.size());
+        }
+        return programPoisson(handle, rates, "POISSON", result);
+    } else if (token == "POISSON_DENSE") {
+        // POISSON_DENSE <chip> <first neuron address> <rate Hz> <rate Hz> ...
+        std::vector<PoissonRate> rates;
+        if (!parsePoissonDense(command + strlen("POISSON_DENSE"), rates)) {
+            return result.fail("Usage: POISSON_DENSE <chip> <first neuron 0-1023> <rate Hz>...");
+        }
+        return programPoisson(handle, rates, "POISSON_DENSE", result);
+    } else if (token == "POISSON_LOAD") {
+        // POISSON_LOAD <file>: see poisson_rates.h
+        std::string filename;
+        iss >> filename;
+        std::string path = "data/" + filename;
+        std::vector<PoissonRate> rates;
+        if (filename.empty() || !loadPoissonFile(path, rates)) {
+            return result.fail("Cannot load Poisson rates: %s", path.c_str());
+        }
+        return programPoisson(handle, rates, path.c_str(), result);
+    } else if (token == "SWEEP" || token == "SWEEP_TARGET") {
+        // Runs in the background, see bias_sweep.h
+        return startSweep(iss, (token == "SWEEP") ? SWEEP_GRID : SWEEP_TARGET, result);
+    } else if (token == "SWEEP_STOP") {
+        if (!biasSweep.active()) {
+            return result.fail("No sweep running");
+        }
+        biasSweep.stop(deviceShadow);
+    } else if (token == "RING_POLICY") {
+        std::string policy;
+        iss >> policy;
+        if (policy == "DROP") spikeRingPolicy.store(RING_POLICY_DROP);
+        else if (policy == "BLOCK") spikeRingPolicy.store(RING_POLICY_BLOCK);
+        else {
+            return result.fail("Unknown ring policy: %s (DROP or BLOCK)", policy.c_str());
+        }
+        std::cout << "Spike ring policy set to " << policy << std::endl;
+    } else if (token == "SLOW_CLIENT") {
+        std::string policy;
+        iss >> policy;
+        if (policy == "DROP") spikeServer.slowClientPolicy.store(SLOW_CLIENT_DROP);
+        else if (policy == "DOWNSAMPLE") spikeServer.slowClientPolicy.store(SLOW_CLIENT_DOWNSAMPLE);
+        else if (policy == "DISCONNECT") spikeServer.slowClientPolicy.store(SLOW_CLIENT_DISCONNECT);
+        else {
+            return result.fail("Unknown slow client policy: %s (DROP, DOWNSAMPLE or DISCONNECT)", policy.c_str());
+        }
+        std::cout << "Slow client policy set to " << policy << std::endl;
+    } else if (token == "RATE") {
+        // RATE <interval ms> [tau ms] [window ms] [DECAYED|WINDOW]
+        uint32_t interval = 0, tau = rateEngine.tauMs.load(), window = rateEngine.windowMs.load();
+        std::string kind;
+        iss >> interval;
+        if (!(iss >> tau)) tau = rateEngine.tauMs.load();
+        if (!(iss >> window)) window = rateEngine.windowMs.load();
+        iss.clear();
+        iss >> kind;
+        if (interval == 0 || tau == 0 || window == 0) {
+            return result.fail("RATE needs an interval, tau and window > 0 ms");
+        }
+        if (!kind.empty() && kind != "DECAYED" && kind != "WINDOW") {
+            return result.fail("Unknown rate estimator: %s (DECAYED or WINDOW)", kind.c_str());
+        }
+        rateEngine.intervalMs.store(interval);
+        rateEngine.tauMs.store(tau);
+        rateEngine.windowMs.store(window);
+        if (!kind.empty()) rateEngine.estimator.store(kind == "WINDOW" ? RATE_WINDOW : RATE_DECAYED);
+        std::cout << "Rates every " << interval << " ms, tau " << tau << " ms, window " << window << " ms" << std::endl;
+    } else if (token == "STIM") {
+        // STIM <lead us|AUTO> [window us] [max late us]
+        std::string lead;
+        uint32_t window = stimulusServer.windowUs.load(), maxLate = stimulusServer.maxLateUs.load();
+        iss >> lead;
+        if (!(iss >> window)) window = stimulusServer.windowUs.load();
+        if (!(iss >> maxLate)) maxLate = stimulusServer.maxLateUs.load();
+        char *end = NULL;
+        long long leadUs = (lead == "AUTO") ? -1 : strtoll(lead.c_str(), &end, 10);
+        if (lead.empty() || (end != NULL && *end != '\0') || leadUs < -1 || window == 0
+            || window > STIMULUS_MAX_WINDOW_US) {
+            return result.fail("Usage: STIM <lead us|AUTO> [window 1-%d us] [max late us]", STIMULUS_MAX_WINDOW_US);
+        }
+        stimulusServer.leadUs.store(leadUs);
+        stimulusServer.windowUs.store(window);
+        stimulusServer.maxLateUs.store(maxLate);
+        std::cout << "Stimulus lead " << lead << ", window " << window << " us, max late " << maxLate << " us"
+                  << std::endl;
+    } else if (token == "RECORD_START") {
+        // RECORD_START <prefix> [max MB per file] [max seconds per file]
+        std::string prefix;
+        uint64_t maxMB = 0;
+        uint32_t maxSeconds = 0;
+        iss >> prefix >> maxMB >> maxSeconds;
+        if (prefix.empty()) {
+            return result.fail("RECORD_START needs a file prefix");
+        }
+        aedatRecorder.start(prefix, maxMB * 1000000, maxSeconds);
+    } else if (token == "RECORD_STOP") {
+        aedatRecorder.stop();
+        std::cout << "Recording stopped." << std::endl;
+    } else if (token == "SNAPSHOT_SAVE") {
+        if (!saveDeviceSnapshot(snapshotPath, handle->info(), *deviceShadow)) {
+            return result.fail("Could not save snapshot to %s", snapshotPath.c_str());
+        }
+        std::cout << "Snapshot saved to " << snapshotPath << std::endl;
+    } else if (token == "LATENCY") {
+        // LATENCY [RESET]
+        std::string action;
+        iss >> action;
+        hotPath.print();
+        if (action == "RESET") {
+            hotPath.reset();
+            std::cout << "Latency histograms reset." << std::endl;
+        }
+    } else if (token == "STATS") {
+        spikeRingStats.print(spikeRing.occupancy(), spikeRing.capacity());
+        spikeServer.printStats();
+        rateServer.printStats();
+        rateEngine.printStats();
+        stimulusServer.printStats();
+        poissonRates.printStats();
+        biasSweep.printStats();
+        aedatRecorder.printStats();
+        biasImageCache.printStats();
+        configStats.print();
+        configWrites.printStats();
+        handle->printStats();
+    } else if (token == "HELP") {
+        std::cout << "Available biases:" << std::endl;
+        char name[BIAS_NAME_MAX];
+        for (int biasId = 0; biasId < BIAS_COUNT; biasId++) {
+            std::cout << "  " << biasName(biasId, name) << std::endl;
+        }
+    } else {
+        return result.fail("Unknown command: %s", token.c_str());
+    }
+    return true;
+}
+
+// Waits up to timeoutMs for fd to become readable.
+static bool waitReadable(int fd, int timeoutMs) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    return poll(&pfd, 1, timeoutMs) > 0;
+}
+
+// Plain value registers: only the last value matters, so queued writes to them may merge.
+static bool isValueRegister(int module, int param) {
+    if (module == DYNAPSE_CONFIG_CHIP) {
+        return param == DYNAPSE_CONFIG_CHIP_REQ_DELAY || param == DYNAPSE_CONFIG_CHIP_REQ_EXTENSION;
+    }
+    if (module == DYNAPSE_CONFIG_AER) {
+        return param == DYNAPSE_CONFIG_AER_ACK_DELAY || param == DYNAPSE_CONFIG_AER_ACK_EXTENSION;
+    }
+    return false;
+}
+
+// SET, MONITOR_SET and PARAM_SET of a value register as a write for the coalescing
+// queue (config_queue.h). Anything else, a malformed one, CHIP_ID or a *_RUN
+// switch (CHIP_RUN 0 then 1 is a reset) runs as a command, after the queue.
+static bool parseConfigWrite(const char *command, ConfigWrite &write) {
+    write.chipId = deviceShadow->selectedChip();
+    if (strncmp(command, "SET ", 4) == 0) {
+        int core, coarse, fine;
+        char name[BIAS_NAME_MAX];
+        if (sscanf(command + 4, "%d %31s %d %d", &core, name, &coarse, &fine) != 4) {
+            return false;
+        }
+        int biasId = lookupBiasOnCore(core, name, strlen(name));
+        if (biasId < 0) {
+            return false;
+        }
+        write.type = CONFIG_WRITE_BIAS;
+        write.module = DYNAPSE_CONFIG_CHIP;
+        write.param = DYNAPSE_CONFIG_CHIP_CONTENT;
+        write.value = biasWord(biasId, coarse, fine);
+        write.address = biasParam(biasId);
+        write.biasId = biasId;
+        write.coarse = coarse;
+        write.fine = fine;
+        return true;
+    }
+    if (strncmp(command, "PARAM_SET ", 10) == 0) {
+        char moduleStr[16], paramStr[BIAS_NAME_MAX];
+        int value;
+        if (sscanf(command + 10, "%15s %31s %d", moduleStr, paramStr, &value) != 3) {
+            return false;
+        }
+        int module = lookupModule(moduleStr), param = lookupParameter(paramStr, strlen(paramStr));
+        if (module < 0 || param < 0 || !isValueRegister(module, param)) {
+            return false;
+        }
+        write.type = CONFIG_WRITE_PARAMETER;
+        write.module = static_cast<uint8_t>(module);
+        write.param = static_cast<uint8_t>(param);
+        write.value = static_cast<uint32_t>(value);
+        write.address = static_cast<uint16_t>(param);
+        return true;
+    }
+    if (strncmp(command, "MONITOR_SET ", 12) == 0) {
+        int monitorId, core, neuron;
+        if (sscanf(command + 12, "%d %d %d", &monitorId, &core, &neuron) != 3) {
+            return false;
+        }
+        write.type = CONFIG_WRITE_MONITOR;
+        write.module = DYNAPSE_CONFIG_MONITOR_NEU;
+        write.param = static_cast<uint8_t>(core);
+        write.value = static_cast<uint32_t>(neuron);
+        write.address = static_cast<uint16_t>(core);
+        return true;
+    }
+    return false;
+}
+
+// Applies the queued writes and acks their requests in the order they came.
+static void flushConfigWrites(DynapseDevice *handle, ConfigConnection &connection) {
+    static const char *commandNames[CONFIG_WRITE_TYPES] = {"PARAM_SET", "SET", "MONITOR_SET"};
+    if (configWrites.empty()) {
+        return;
+    }
+    configWrites.drain(handle, hotPath.configWrite);
+
+    const std::vector<ConfigWrite> &writes = configWrites.queuedWrites();
+    std::vector<ConfigResult> results(writes.size());
+    char name[BIAS_NAME_MAX];
+    for (size_t i = 0; i < writes.size(); i++) {
+        const ConfigWrite &write = writes[i];
+        if (write.type == CONFIG_WRITE_BIAS) {
+            biasName(write.biasId, name);
+            if (write.ok) {
+                printf("Bias %s set to coarse %d fine %d in %u us (%u SET merged).\n", name, write.coarse,
+                       write.fine, write.us, write.requests);
+            }
+            else {
+                results[i].fail("Bias write failed: %s", name);
+            }
+        }
+        else if (!write.ok) {
+            results[i].fail("%s write failed: module %u param %u", commandNames[write.type], write.module,
+                            write.param);
+        }
+    }
+    // A superseded request shares the outcome of the write that replaced it.
+    for (const QueuedConfigRequest &queued : configWrites.queuedRequests()) {
+        const ConfigWrite &write = writes[queued.write];
+        const ConfigResult &result = results[queued.write];
+        uint32_t us = queued.superseded ? 0 : write.us;
+        configStats.add(result.ok, us);
+        hotPath.config.recordSince(queued.receivedNs);
+        configMetrics.record(commandNames[write.type], result.ok, static_cast<uint64_t>(us) * 1000);
+        connection.ack(queued.request, result, us);
+    }
+    configWrites.clear();
+}
+
+// Steps a running bias sweep; returns how long the config thread may wait for input.
+static int serviceSweep() {
+    auto now = std::chrono::steady_clock::now();
+    biasSweep.step(deviceShadow, now);
+    return std::min(100, biasSweep.msUntilDue(now));
+}
+
+// Serves the config client, then any client connecting after it, until shutdown.
+// See config_protocol.h for the framing; every read may carry many commands.
+// A bias sweep keeps running between clients.
+void configHandler(DynapseDevice *handle) {
+    while (!globalShutdown.load()) {
+        if (configClient < 0) {
+            if (!waitReadable(configSocket, serviceSweep())) {
+                continue;
+            }
+            configClient = accept(configSocket, nullptr, nullptr);
+            if (configClient < 0) {
+                continue;
+            }
+            printf("Config client connected.\n");
+        }
+
+        ConfigConnection connection(configClient);
+        bool connected = true;
+        while (connected && !globalShutdown.load()) {
+            if (!waitReadable(configClient, serviceSweep())) {
+                continue;
+            }
+            connected = connection.receive();
+
+            ConfigRequest request;
+            for (;;) {
+                if (!connection.next(request)) {
+                    // One command per write without a newline (older GUIs): run it once the client pauses.
+                    if (!connection.hasPending() || waitReadable(configClient, CONFIG_LEGACY_IDLE_MS)
+                        || !connection.takeUnterminated(request)) {
+                        break;
+                    }
+                }
+                int64_t startNs = latencyNowNs();
+                ConfigWrite write;
+                if (parseConfigWrite(request.command, write)) {
+                    configWrites.add(request, write, startNs);
+                    continue;
                 }
-            } else {
-                std::cerr << "Unknown command: " << token << std::endl;
+                flushConfigWrites(handle, connection); // everything before it goes first
+
+                auto start = std::chrono::steady_clock::now();
+                startNs = latencyNowNs();
+                ConfigResult result;
+                runConfigCommand(handle, request.command, result);
+                uint32_t us = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start).count());
+                configStats.add(result.ok, us);
+                hotPath.config.recordSince(startNs);
+                configMetrics.record(request.command, result.ok, static_cast<uint64_t>(latencyNowNs() - startNs));
+                connection.ack(request, result, us);
             }
+            // Acks for everything this read carried go out together.
+            flushConfigWrites(handle, connection);
+            connected = connection.flush() && connected;
+        }
 
+        close(configClient);
+        configClient = -1;
+        if (!globalShutdown.load()) {
+            printf("Config client disconnected, waiting for a new one.\n");
         }
     }
+    biasSweep.stop(deviceShadow); // closes the results file, biases back as before
 }
 
 
 void closeSockets() {
-	if (clientSocket != -1) close(clientSocket);
-	if (serverSocket != -1) close(serverSocket);
+	spikeServer.shutdown();
+	rateServer.shutdown();
+	stimulusServer.stop();
 	if (configClient != -1) close(configClient);
 	if (configSocket != -1) close(configSocket);
 }
 
-void readSpikes(caerDeviceHandle handle) {
-	printf("Starting spike monitoring...\n");
+static int32_t containerEventCount(caerEventPacketContainer packetContainer) {
+	int32_t events = 0;
+	int32_t packetNum = caerEventPacketContainerGetEventPacketsNumber(packetContainer);
+	for (int32_t i = 0; i < packetNum; i++) {
+		caerEventPacketHeader packetHeader = caerEventPacketContainerGetEventPacket(packetContainer, i);
+		if (packetHeader != NULL) {
+			events += caerEventPacketHeaderGetEventNumber(packetHeader);
+		}
+	}
+	return events;
+}
 
-	caerDeviceDataStart(handle, NULL, NULL, NULL, NULL, NULL);
+// Spikes per chip and core for the metrics endpoint.
+static void countSpikes(caerSpikeEventPacket packet) {
+	uint64_t counts[16] = {0};
+	CAER_SPIKE_ITERATOR_VALID_START(packet)
+		int index = spikeAddressIndex(caerSpikeEventGetChipID(caerSpikeIteratorElement),
+		                              caerSpikeEventGetSourceCoreID(caerSpikeIteratorElement),
+		                              static_cast<uint16_t>(caerSpikeEventGetNeuronID(caerSpikeIteratorElement)));
+		if (index >= 0) {
+			counts[index >> 8]++; // chip slot * 4 + core
+		}
+	CAER_SPIKE_ITERATOR_VALID_END
+	senderMetrics.packets.increment();
+	for (int i = 0; i < 16; i++) {
+		if (counts[i] != 0) senderMetrics.spikes[i >> 2][i & 3].add(counts[i]);
+	}
+}
 
-	while (!globalShutdown.load(memory_order_relaxed)) {
-		caerEventPacketContainer packetContainer = caerDeviceDataGet(handle);
-		if (packetContainer == NULL) {
-			continue;
+// The last spike of each packet keeps the stimulus stream's device clock in sync.
+static void observeDeviceClock(caerSpikeEventPacket packet, int64_t fetchedNs) {
+	int32_t events = caerEventPacketHeaderGetEventNumber(&packet->packetHeader);
+	if (events > 0) {
+		caerSpikeEventConst last = caerSpikeEventPacketGetEvent(packet, events - 1);
+		stimulusServer.clock.observe(caerSpikeEventGetTimestamp64(last, packet), fetchedNs);
+	}
+}
+
+static void addServerMetrics(MetricsText &text, const char *name, const char *help, const char *type,
+                             double spikes, double rates) {
+	text.family(name, type, help);
+	text.sample(name, "stream=\"spikes\"", spikes);
+	text.sample(name, "stream=\"rates\"", rates);
+}
+
+// Scraped by the metrics endpoint thread: only reads counters.
+static std::string renderMetrics() {
+	static const char *chipNames[4] = {"U0", "U2", "U1", "U3"}; // by slot
+	MetricsText text;
+	text.counter("dynapse_containers_total", "Packet containers read from USB.",
+	             acquisitionMetrics.containers.get());
+	text.counter("dynapse_container_events_total", "Events in the containers read from USB.",
+	             acquisitionMetrics.events.get());
+	text.counter("dynapse_spike_packets_total", "Spike packets forwarded by the sender.", senderMetrics.packets.get());
+	text.family("dynapse_spikes_total", "counter", "Spikes forwarded, by chip and core.");
+	for (int slot = 0; slot < 4; slot++) {
+		for (int core = 0; core < 4; core++) {
+			char labels[32];
+			snprintf(labels, sizeof(labels), "chip=\"%s\",core=\"%d\"", chipNames[slot], core);
+			text.sample("dynapse_spikes_total", labels, senderMetrics.spikes[slot][core].get());
 		}
+	}
+	text.counter("dynapse_ring_dropped_containers_total", "Containers dropped because the sender ring was full.",
+	             spikeRingStats.droppedContainers.load());
+	text.counter("dynapse_ring_dropped_events_total", "Events dropped because the sender ring was full.",
+	             spikeRingStats.droppedEvents.load());
+	text.counter("dynapse_ring_stall_seconds_total", "Time the acquisition thread waited for ring space.",
+	             spikeRingStats.stallNs.load() / 1e9);
+	text.family("dynapse_ring_occupancy", "gauge", "Containers waiting for the sender.");
+	text.sample("dynapse_ring_occupancy", "", spikeRing.occupancy());
+
+	addServerMetrics(text, "dynapse_bytes_sent_total", "Bytes sent to stream clients.", "counter",
+	                 spikeServer.bytesSent.load(), rateServer.bytesSent.load());
+	addServerMetrics(text, "dynapse_frames_sent_total", "Frames sent to stream clients.", "counter",
+	                 spikeServer.framesSent.load(), rateServer.framesSent.load());
+	addServerMetrics(text, "dynapse_frames_dropped_total", "Frames dropped for slow stream clients.", "counter",
+	                 spikeServer.framesDropped.load(), rateServer.framesDropped.load());
+	addServerMetrics(text, "dynapse_send_eagain_total", "sendmsg() calls that found the socket full.", "counter",
+	                 spikeServer.sendWouldBlock.load(), rateServer.sendWouldBlock.load());
+	addServerMetrics(text, "dynapse_send_blocked_seconds_total", "Time clients waited for socket space.", "counter",
+	                 spikeServer.sendBlockedNs.load() / 1e9, rateServer.sendBlockedNs.load() / 1e9);
+	addServerMetrics(text, "dynapse_clients", "Connected stream clients.", "gauge",
+	                 spikeServer.clientsConnected.load() - spikeServer.clientsDisconnected.load(),
+	                 rateServer.clientsConnected.load() - rateServer.clientsDisconnected.load());
+
+	text.counter("dynapse_stimulus_spikes_received_total", "Spikes received on the stimulus stream.",
+	             stimulusServer.spikesReceived.load());
+	text.counter("dynapse_stimulus_spikes_injected_total", "Stimulus spikes written to the spike generator.",
+	             stimulusServer.spikesInjected.load());
+	text.counter("dynapse_stimulus_spikes_dropped_total", "Stimulus spikes dropped (invalid, late or failed).",
+	             stimulusServer.spikesDropped.load());
+	text.counter("dynapse_stimulus_batches_total", "Spike generator runs.", stimulusServer.batches.load());
+	text.counter("dynapse_poisson_rates_written_total", "Poisson generator rates written.",
+	             poissonRates.ratesWritten.load());
+	text.counter("dynapse_poisson_rates_unchanged_total", "Poisson rates skipped as already set.",
+	             poissonRates.ratesUnchanged.load());
+
+	text.counter("dynapse_config_writes_superseded_total", "Queued config writes replaced by a later value.",
+	             configWrites.writesCoalesced.load());
+	text.counter("dynapse_config_writes_applied_total", "Config register writes sent to the device.",
+	             configWrites.writesApplied.load());
+	text.counter("dynapse_bias_sweep_points_total", "Bias sweep points measured.", biasSweep.pointsMeasured.load());
+
+	text.family("dynapse_config_commands_total", "counter", "Config commands executed, by command and result.");
+	for (int i = 0; i < configMetrics.count; i++) {
+		const ConfigMetrics::Command &command = configMetrics.commands[i];
+		char labels[64];
+		snprintf(labels, sizeof(labels), "command=\"%s\",status=\"ok\"", command.name);
+		text.sample("dynapse_config_commands_total", labels, command.ok.get());
+		snprintf(labels, sizeof(labels), "command=\"%s\",status=\"error\"", command.name);
+		text.sample("dynapse_config_commands_total", labels, command.failed.get());
+	}
+	text.family("dynapse_config_command_seconds_total", "counter", "Time spent executing config commands.");
+	for (int i = 0; i < configMetrics.count; i++) {
+		char labels[48];
+		snprintf(labels, sizeof(labels), "command=\"%s\"", configMetrics.commands[i].name);
+		text.sample("dynapse_config_command_seconds_total", labels, configMetrics.commands[i].ns.get() / 1e9);
+	}
+	return text.str();
+}
 
-		int32_t packetNum = caerEventPacketContainerGetEventPacketsNumber(packetContainer);
-		for (int32_t i = 0; i < packetNum; i++) {
-			caerEventPacketHeader packetHeader = caerEventPacketContainerGetEventPacket(packetContainer, i);
-			if (packetHeader == NULL) {
-				continue;
+// Sender thread: drains the ring and fans spike packets out to all clients.
+// A slow client only fills its own queue, it never blocks caerDeviceDataGet().
+void sendSpikes() {
+	FetchedContainer fetched;
+
+	for (;;) {
+		bool done = acquisitionDone.load(memory_order_acquire);
+
+		// Bounded, so client I/O keeps up even when the ring never runs empty.
+		int drained = 0;
+		while (drained < SPIKE_SEND_BATCH && spikeRing.tryPop(fetched)) {
+			drained++;
+			int64_t poppedNs = latencyNowNs(), encodeNs = 0;
+			hotPath.ringQueue.record(static_cast<uint64_t>(poppedNs - fetched.fetchedNs));
+			caerEventPacketContainer packetContainer = fetched.container;
+			int32_t packetNum = caerEventPacketContainerGetEventPacketsNumber(packetContainer);
+			for (int32_t i = 0; i < packetNum; i++) {
+				caerEventPacketHeader packetHeader = caerEventPacketContainerGetEventPacket(packetContainer, i);
+				if (packetHeader != NULL && caerEventPacketHeaderGetEventType(packetHeader) == SPIKE_EVENT) {
+					hotPath.packetEvents.record(static_cast<uint64_t>(caerEventPacketHeaderGetEventNumber(packetHeader)));
+					int64_t encodeStart = latencyNowNs();
+					spikeServer.publish((caerSpikeEventPacket) packetHeader);
+					int64_t encodeEnd = latencyNowNs();
+					hotPath.encode.record(static_cast<uint64_t>(encodeEnd - encodeStart));
+					encodeNs += encodeEnd - encodeStart;
+					rateEngine.add((caerSpikeEventPacket) packetHeader);
+					biasSweep.add((caerSpikeEventPacket) packetHeader);
+					observeDeviceClock((caerSpikeEventPacket) packetHeader, fetched.fetchedNs);
+					countSpikes((caerSpikeEventPacket) packetHeader);
+					if (spikeShm.isOpen()) {
+						spikeShm.publish((caerSpikeEventPacket) packetHeader);
+					}
+				}
 			}
+			int64_t doneNs = latencyNowNs();
+			hotPath.decode.record(static_cast<uint64_t>(doneNs - poppedNs - encodeNs));
+			hotPath.endToEnd.record(static_cast<uint64_t>(doneNs - fetched.fetchedNs));
 
-			if (caerEventPacketHeaderGetEventType(packetHeader) == SPIKE_EVENT) {
-				caerSpikeEventPacket evts = (caerSpikeEventPacket) packetHeader;
-				CAER_SPIKE_ITERATOR_ALL_START(evts)
-					uint64_t ts = caerSpikeEventGetTimestamp(caerSpikeIteratorElement);
-					uint64_t neuronId = caerSpikeEventGetNeuronID(caerSpikeIteratorElement);
-					uint64_t sourceCoreId = caerSpikeEventGetSourceCoreID(caerSpikeIteratorElement);
-					uint64_t chipId = caerSpikeEventGetChipID(caerSpikeIteratorElement);
-
-					char buffer[128];
-					snprintf(buffer, sizeof(buffer), "%llu %llu %llu %llu\n", ts, neuronId, sourceCoreId, chipId);
-					send(clientSocket, buffer, strlen(buffer), 0);
-					//printf("Sent spike: %s", buffer);  
-				CAER_SPIKE_ITERATOR_ALL_END
-			}
+			aedatRecorder.submit(packetContainer); // frees it when not recording
+		}
+
+		if (done && drained < SPIKE_SEND_BATCH) {
+			break;
 		}
 
-		caerEventPacketContainerFree(packetContainer);
+		auto now = std::chrono::steady_clock::now();
+		SpikeFramePtr rates = rateEngine.publish(now);
+		if (rates) {
+			rateServer.publishFrame(rates);
+		}
+		rateServer.poll(0);
+
+		// Sleeps until a socket is ready, the next rate update is due or the acquisition thread wakes us.
+		spikeServer.poll(drained == SPIKE_SEND_BATCH ? 0 : std::min(100, rateEngine.msUntilDue(now)));
+	}
+}
+
+// Acquisition loop: only drains USB and hands containers to the sender thread.
+void readSpikes(DynapseDevice *handle) {
+	printf("Starting spike monitoring...\n");
+
+	handle->dataStart();
+
+	acquisitionDone.store(false);
+	std::thread senderThread(sendSpikes);
+
+	while (!globalShutdown.load(memory_order_relaxed)) {
+		int64_t fetchStart = latencyNowNs();
+		caerEventPacketContainer packetContainer = handle->dataGet();
+		if (packetContainer == NULL) {
+			continue;
+		}
+		FetchedContainer fetched = {packetContainer, latencyNowNs()};
+		hotPath.usbFetch.record(static_cast<uint64_t>(fetched.fetchedNs - fetchStart));
+		int32_t events = containerEventCount(packetContainer);
+		hotPath.containerEvents.record(static_cast<uint64_t>(events));
+		acquisitionMetrics.containers.increment();
+		acquisitionMetrics.events.add(static_cast<uint64_t>(events));
+
+		SpikeRingPolicy policy = static_cast<SpikeRingPolicy>(spikeRingPolicy.load(memory_order_relaxed));
+		if (!ringPush(spikeRing, fetched, policy, spikeRingStats, globalShutdown)) {
+			spikeRingStats.droppedEvents.fetch_add(containerEventCount(packetContainer), memory_order_relaxed);
+			caerEventPacketContainerFree(packetContainer);
+		}
+		else if (spikeRing.occupancy() == 1) {
+			spikeServer.wake(); // sender may be asleep on an empty ring
+		}
 	}
 
-	caerDeviceDataStop(handle);
+	acquisitionDone.store(true, memory_order_release);
+	senderThread.join();
+
+	handle->dataStop();
+	spikeRingStats.print(spikeRing.occupancy(), spikeRing.capacity());
 	printf("Stopped spike monitoring.\n");
 }
 
-int main() {
+int main(int argc, char *argv[]) {
 	setupSignalHandlers();
 
-	caerDeviceHandle usb_handle = caerDeviceOpen(1, CAER_DEVICE_DYNAPSE, 0, 0, NULL);
-	if (usb_handle == NULL) {
-		cerr << "Failed to open Dynapse device." << endl;
-		return EXIT_FAILURE;
+	std::string replayFile;
+	double replaySpeed = 1.0;
+	bool replayLoop = false;
+	enum { START_AUTO, START_COLD, START_WARM } startMode = START_AUTO;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg(argv[i]);
+		if (arg == "--shm" || arg.rfind("--shm=", 0) == 0) {
+			std::string shmName = (arg == "--shm") ? SPIKE_SHM_DEFAULT_NAME : arg.substr(6);
+			if (!spikeShm.open(shmName)) {
+				return EXIT_FAILURE;
+			}
+		}
+		else if (arg.rfind("--record=", 0) == 0) {
+			aedatRecorder.start(arg.substr(9), 0, 0);
+		}
+		else if (arg.rfind("--replay=", 0) == 0) {
+			replayFile = arg.substr(9);
+		}
+		else if (arg.rfind("--replay-speed=", 0) == 0) {
+			replaySpeed = atof(arg.c_str() + 15); // 0 = as fast as possible
+		}
+		else if (arg == "--replay-loop") {
+			replayLoop = true;
+		}
+		else if (arg.rfind("--snapshot=", 0) == 0) {
+			snapshotPath = arg.substr(11);
+		}
+		else if (arg == "--cold-start") {
+			startMode = START_COLD;
+		}
+		else if (arg == "--warm-start") {
+			startMode = START_WARM; // trust the snapshot even if the chips do not report running
+		}
+		else {
+			cerr << "Usage: " << argv[0] << " [--shm[=/name]] [--record=prefix]"
+			     << " [--replay=file.aedat [--replay-speed=N] [--replay-loop]]"
+			     << " [--snapshot=file] [--cold-start|--warm-start]" << endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	DynapseDevice *device = NULL;
+	if (!replayFile.empty()) {
+		ReplayDynapseDevice *replay = new ReplayDynapseDevice(replaySpeed, replayLoop);
+		if (!replay->open(replayFile)) {
+			delete replay;
+			return EXIT_FAILURE;
+		}
+		device = replay;
+	}
+	else {
+		caerDeviceHandle usb_handle = caerDeviceOpen(1, CAER_DEVICE_DYNAPSE, 0, 0, NULL);
+		if (usb_handle == NULL) {
+			cerr << "Failed to open Dynapse device." << endl;
+			return EXIT_FAILURE;
+		}
+		device = new UsbDynapseDevice(usb_handle);
 	}
+	deviceShadow = new ShadowDynapseDevice(device);
+	device = deviceShadow;
 
-	auto dynapse_info = caerDynapseInfoGet(usb_handle);
+	auto dynapse_info = device->info();
 	printf("%s --- ID: %d, Master: %d, Logic: %d.\n",
 	       dynapse_info.deviceString, dynapse_info.deviceID,
 	       dynapse_info.deviceIsMaster, dynapse_info.logicVersion);
 
-	caerDeviceConfigSet(usb_handle, CAER_HOST_CONFIG_DATAEXCHANGE,
-	                    CAER_HOST_CONFIG_DATAEXCHANGE_BLOCKING, true);
-
-	caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_MUX,
-	                    DYNAPSE_CONFIG_MUX_FORCE_CHIP_BIAS_ENABLE, true);
+	// Warm start: the chips kept running since the last session, so what the
+	// snapshot says they hold is still there and need not be sent again.
+	uint32_t chipsRunning = 0;
+	bool warmStart = startMode == START_WARM
+	    || (startMode == START_AUTO && device->configGet(DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_RUN, &chipsRunning)
+	        && chipsRunning);
+	warmStart = warmStart && loadDeviceSnapshot(snapshotPath, dynapse_info, *deviceShadow);
+	if (warmStart) {
+		deviceShadow->assumeRunning();
+	}
+	auto startupBegin = std::chrono::steady_clock::now();
+	uint64_t startupWords = deviceShadow->wordsWritten;
+
+	// Startup sequence: silent biases, USB monitoring routes, then low power
+	// biases. The plan drops repeated writes and groups chip steps.
+	static const uint32_t chipIds[SHADOW_CHIPS] = {DYNAPSE_CONFIG_DYNAPSE_U0, DYNAPSE_CONFIG_DYNAPSE_U1,
+	                                               DYNAPSE_CONFIG_DYNAPSE_U2, DYNAPSE_CONFIG_DYNAPSE_U3};
+	StartupPlan plan;
+	plan.phase("device");
+	plan.set(CAER_HOST_CONFIG_DATAEXCHANGE, CAER_HOST_CONFIG_DATAEXCHANGE_BLOCKING, true);
+	// force chip to be enable even if aer is off
+	plan.set(DYNAPSE_CONFIG_MUX, DYNAPSE_CONFIG_MUX_FORCE_CHIP_BIAS_ENABLE, true);
+	plan.set(DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_RUN, true);
+	plan.set(DYNAPSE_CONFIG_AER, DYNAPSE_CONFIG_AER_RUN, true);
+
+	// Apply initial silent biases (to U0, the chip selected after reset)
+	plan.phase("silent biases");
+	plan.loadBiases(DYNAPSE_CONFIG_DYNAPSE_U0, DEFAULTBIASES);
+	for (uint32_t chipId : chipIds) {
+		// Enable neuron monitors (example: neuron 0 from all cores)
+		for (int core = 0; core < 4; core++) {
+			plan.setChip(chipId, DYNAPSE_CONFIG_MONITOR_NEU, core, 0);
+		}
+	}
 
-     caerDeviceConfigSet(usb_handle, CAER_HOST_CONFIG_DATAEXCHANGE, CAER_HOST_CONFIG_DATAEXCHANGE_BLOCKING, true);
-        
-	// Apply initial silent biases
-	caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_RUN, true);
-	caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_AER, DYNAPSE_CONFIG_AER_RUN, true);
+	// Setup SRAM for USB monitoring of spike events.
+	plan.phase("sram");
+	for (uint32_t chipId : chipIds) {
+		plan.setChip(chipId, DYNAPSE_CONFIG_DEFAULT_SRAM, chipId, 0);
+	}
 
-	if (!configureDevice(usb_handle, DEFAULTBIASES)) {
-		caerDeviceClose(&usb_handle);
-		return EXIT_FAILURE;
-    }
-	
-	//caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_RUN, false);
-	//caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_AER, DYNAPSE_CONFIG_AER_RUN, false);
-
-    //caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_RUN, true);
-    //caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_AER, DYNAPSE_CONFIG_AER_RUN, true);
-
-    caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, DYNAPSE_CONFIG_DYNAPSE_U0);
-    // force chip to be enable even if aer is off
-    caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_MUX, DYNAPSE_CONFIG_MUX_FORCE_CHIP_BIAS_ENABLE, true);
-    
-    caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, DYNAPSE_CONFIG_DYNAPSE_U1);
-    // force chip to be enable even if aer is off
-    caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_MUX, DYNAPSE_CONFIG_MUX_FORCE_CHIP_BIAS_ENABLE, true);
-
-    caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, DYNAPSE_CONFIG_DYNAPSE_U2);
-    // force chip to be enable even if aer is off
-    caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_MUX, DYNAPSE_CONFIG_MUX_FORCE_CHIP_BIAS_ENABLE, true);
-
-    caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, DYNAPSE_CONFIG_DYNAPSE_U3);
-    // force chip to be enable even if aer is off
-    caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_MUX, DYNAPSE_CONFIG_MUX_FORCE_CHIP_BIAS_ENABLE, true);
-  
-  
-  
-	// Clear all SRAM.
-	/*printf("Clearing SRAM SRAM U0 ...\n");
-	caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, DYNAPSE_CONFIG_DYNAPSE_U0);
-	caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_DEFAULT_SRAM_EMPTY, 0, 0);
-	printf("Clearing SRAM SRAM U1 ...\n");
-	caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, DYNAPSE_CONFIG_DYNAPSE_U1);
-	caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_DEFAULT_SRAM_EMPTY, 0, 0);
-	printf("Clearing SRAM SRAM U2 ...\n");
-	caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, DYNAPSE_CONFIG_DYNAPSE_U2);
-	caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_DEFAULT_SRAM_EMPTY, 0, 0);
-	printf("Clearing SRAM SRAM U3 ...\n");
-	caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, DYNAPSE_CONFIG_DYNAPSE_U3);
-	caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_DEFAULT_SRAM_EMPTY, 0, 0);*/
-
-
-    // Setup SRAM for USB monitoring of spike events.
-    printf("Configuring sram content...");
-    caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, DYNAPSE_CONFIG_DYNAPSE_U0);
-    caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_DEFAULT_SRAM, DYNAPSE_CONFIG_DYNAPSE_U0, 0);
-    printf(" Done.\n");
-    printf("Configuring cam content...");
-    caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, DYNAPSE_CONFIG_DYNAPSE_U0);
-    caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_DEFAULT_SRAM, DYNAPSE_CONFIG_DYNAPSE_U0, 0);
-    printf(" Done.\n");
-    printf("Configuring sram content...");
-    caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, DYNAPSE_CONFIG_DYNAPSE_U1);
-    caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_DEFAULT_SRAM, DYNAPSE_CONFIG_DYNAPSE_U1, 0);
-    printf(" Done.\n");
-    printf("Configuring cam content...");
-    caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, DYNAPSE_CONFIG_DYNAPSE_U1);
-    caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_DEFAULT_SRAM, DYNAPSE_CONFIG_DYNAPSE_U1, 0);
-    printf(" Done.\n");
-    printf("Configuring sram content...");
-    caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, DYNAPSE_CONFIG_DYNAPSE_U2);
-    caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_DEFAULT_SRAM, DYNAPSE_CONFIG_DYNAPSE_U2, 0);
-    printf(" Done.\n");
-    printf("Configuring cam content...");
-    caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, DYNAPSE_CONFIG_DYNAPSE_U2);
-    caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_DEFAULT_SRAM, DYNAPSE_CONFIG_DYNAPSE_U2, 0);
-    printf(" Done.\n");
-      printf("Configuring sram content...");
-    caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, DYNAPSE_CONFIG_DYNAPSE_U3);
-    caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_DEFAULT_SRAM, DYNAPSE_CONFIG_DYNAPSE_U3, 0);
-    printf(" Done.\n");
-    printf("Configuring cam content...");
-    caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, DYNAPSE_CONFIG_DYNAPSE_U3);
-    caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_DEFAULT_SRAM, DYNAPSE_CONFIG_DYNAPSE_U3, 0);
-    printf(" Done.\n");
-            
 	// Reconfigure with low power biases before monitoring
-	caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_RUN, true);
-	caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_AER, DYNAPSE_CONFIG_AER_RUN, true);
-
+	plan.phase("low power biases");
+	plan.set(DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_RUN, true); // still running: dropped
+	plan.set(DYNAPSE_CONFIG_AER, DYNAPSE_CONFIG_AER_RUN, true);
+	for (uint32_t chipId : chipIds) {
+		plan.loadBiases(chipId, LOWPOWERBIASES);
+	}
 
-    caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, DYNAPSE_CONFIG_DYNAPSE_U0);
-	if (!configureDevice(usb_handle, LOWPOWERBIASES)) {
-		caerDeviceClose(&usb_handle);
+	size_t dropped = plan.optimize();
+	StartupPlanReport planReport;
+	if (!plan.run(device, &loadBiases, planReport)) {
+		delete device;
 		return EXIT_FAILURE;
 	}
+	printf("Startup plan: %zu steps declared, %zu dropped, %zu executed, %zu chip switches.\n", planReport.declared,
+	       dropped, planReport.executed, planReport.chipSwitches);
 
-    caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, DYNAPSE_CONFIG_DYNAPSE_U1);
-	if (!configureDevice(usb_handle, LOWPOWERBIASES)) {
-		caerDeviceClose(&usb_handle);
+	printf("Startup configuration: %s start, %.1f ms, %llu words written, %llu words and %llu writes skipped.\n",
+	       warmStart ? "warm" : "cold",
+	       std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupBegin).count(),
+	       (unsigned long long) (deviceShadow->wordsWritten - startupWords),
+	       (unsigned long long) deviceShadow->wordsSkipped, (unsigned long long) deviceShadow->writesSkipped);
+
+	setupConfigSocketServer();   // Accept config client FIRST
+	spikeServer.sendLatency = &hotPath.send;
+	if (!setupSocketServer() || !rateServer.start(9003)) {  // Then open the spike and rate streams for any number of clients
+		delete device;
 		return EXIT_FAILURE;
 	}
-	
-	caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, DYNAPSE_CONFIG_DYNAPSE_U2);
-	if (!configureDevice(usb_handle, LOWPOWERBIASES)) {
-		caerDeviceClose(&usb_handle);
+	stimulusServer.writeLatency = &hotPath.stimulusWrite;
+	stimulusServer.lateness = &hotPath.stimulusLate;
+	stimulusServer.hostToChip = &hotPath.hostToChip;
+	stimulusServer.poissonRates = &poissonRates;
+	// Spike generator writes hold no chip state: they bypass the shadow.
+	if (!stimulusServer.start(STIMULUS_PORT, deviceShadow->wrapped())) {
+		delete device;
 		return EXIT_FAILURE;
 	}
 	
-	caerDeviceConfigSet(usb_handle, DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, DYNAPSE_CONFIG_DYNAPSE_U3);
-	if (!configureDevice(usb_handle, LOWPOWERBIASES)) {
-		caerDeviceClose(&usb_handle);
-		return EXIT_FAILURE;
+	static const char *configCommands[] = {"SET", "PARAM_SET", "LOAD", "SAVE", "SHADOW_RESET", "MONITOR_SET",
+	                                       "CAM_SET", "CAM_LOAD", "CAM_TABLE", "NET_LOAD", "ROUTE_SET", "ROUTE_LOAD",
+	                                       "POISSON", "POISSON_DENSE", "POISSON_LOAD", "SWEEP", "SWEEP_TARGET",
+	                                       "SWEEP_STOP", "RING_POLICY", "SLOW_CLIENT", "RATE", "STIM", "RECORD_START",
+	                                       "RECORD_STOP", "SNAPSHOT_SAVE", "LATENCY", "STATS", "HELP", "OTHER"};
+	for (const char *command : configCommands) {
+		configMetrics.add(command); // OTHER last: collects unknown commands
 	}
-	
+	metricsEndpoint.start(METRICS_PORT, renderMetrics); // optional, the server runs without it
 
-	setupConfigSocketServer();   // Accept config client FIRST
-	setupSocketServer();         // Then accept GUI stream
-	
 	// Launch config handler thread
-	std::thread configThread(configHandler, usb_handle);
+	std::thread configThread(configHandler, device);
+	aedatRecorder.startThread();
 
-	readSpikes(usb_handle);     // Blocking loop
+	readSpikes(device);     // Blocking loop
+	aedatRecorder.stopThread(); // Flush what is still queued for disk
 	
 	globalShutdown.store(true);
 	configThread.join();
+	metricsEndpoint.stop();
 
 	closeSockets();           // ← Clean up sockets
+	spikeShm.close();
+
+	if (saveDeviceSnapshot(snapshotPath, dynapse_info, *deviceShadow)) {
+		printf("Snapshot saved to %s.\n", snapshotPath.c_str());
+	}
 
-	caerDeviceClose(&usb_handle);
+	delete device;
 	printf("Shutdown successful.\n");
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,168 @@
+/*
+ * Hot-path latency histograms, dumped with the LATENCY config command.
+ *
+ * Each histogram is log-linear in the style of HdrHistogram: 16 buckets per
+ * power of two (about 6% resolution) over the whole uint64 range, counted
+ * with relaxed atomics, so record() costs a few instructions and may be
+ * called from any thread. Latencies are recorded in nanoseconds; the same
+ * class also counts plain distributions (events per packet).
+ *
+ * Stages of a spike container, all on the steady clock:
+ *   usb fetch  - caerDeviceDataGet() call (acquisition thread)
+ *   ring queue - fetched until the sender thread pops it
+ *   decode     - taking the container apart into spike packets and feeding
+ *                the rate engine and shared memory
+ *   encode     - SpikeServer::publish(): filtering, encoding, queueing
+ *   send       - one sendmsg() of queued frames to a client
+ *   end to end - fetched until every client has its frames queued
+ * plus the execution time of config commands (for queued writes, from
+ * receipt until applied), the device time of every coalesced config write
+ * (config write, config_queue.h), and for the stimulus stream
+ * (stimulus.h):
+ *   stim write   - SRAM transfer and generator run of one batch
+ *   stim late    - generator run started after the first spike was due
+ *   host to chip - stimulus frame received until its last batch was written
+ */
+
+#ifndef DYNAPSE_LATENCY_STATS_H_
+#define DYNAPSE_LATENCY_STATS_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+#define LATENCY_SUB_BITS 4
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS ((64 - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+static inline int64_t latencyNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+class LatencyHistogram {
+public:
+    // scale converts recorded values to the printed unit (1e-3: ns → us).
+    LatencyHistogram(const char *name, const char *unit, double scale) : name(name), unit(unit), scale(scale) {
+        reset();
+    }
+
+    void record(uint64_t value) {
+        counts[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+        uint64_t prevMax = max.load(std::memory_order_relaxed);
+        while (value > prevMax && !max.compare_exchange_weak(prevMax, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    void recordSince(int64_t startNs) {
+        int64_t elapsed = latencyNowNs() - startNs;
+        record(static_cast<uint64_t>(elapsed > 0 ? elapsed : 0));
+    }
+
+    // Lower bound of the bucket holding quantile q (0..1) of the recorded values.
+    uint64_t percentile(double q) const {
+        uint64_t n = total.load(std::memory_order_relaxed);
+        uint64_t rank = static_cast<uint64_t>(q * n), seen = 0;
+        for (int i = 0; i < LATENCY_BUCKETS; i++) {
+            seen += counts[i].load(std::memory_order_relaxed);
+            if (seen > rank) return bucketFloor(i);
+        }
+        return max.load(std::memory_order_relaxed);
+    }
+
+    void print() const {
+        uint64_t n = total.load();
+        if (n == 0) {
+            printf("  %-12s no samples\n", name);
+            return;
+        }
+        printf("  %-12s %10llu samples, mean %.1f, p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f %s\n", name,
+               (unsigned long long) n, sum.load() * scale / n, percentile(0.5) * scale, percentile(0.9) * scale,
+               percentile(0.99) * scale, percentile(0.999) * scale, max.load() * scale, unit);
+    }
+
+    void reset() {
+        for (std::atomic<uint64_t> &count : counts) {
+            count.store(0, std::memory_order_relaxed);
+        }
+        total.store(0);
+        sum.store(0);
+        max.store(0);
+    }
+
+private:
+    const char *name;
+    const char *unit;
+    double scale;
+    std::atomic<uint64_t> counts[LATENCY_BUCKETS];
+    std::atomic<uint64_t> total, sum, max;
+
+    // Values below 16 get their own bucket; above, the top 5 significant bits pick one.
+    static int bucketOf(uint64_t value) {
+        if (value < LATENCY_SUB_BUCKETS) return static_cast<int>(value);
+        int exponent = 63 - __builtin_clzll(value);
+        int sub = static_cast<int>(value >> (exponent - LATENCY_SUB_BITS)) - LATENCY_SUB_BUCKETS;
+        return (exponent - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS + sub;
+    }
+
+    static uint64_t bucketFloor(int bucket) {
+        if (bucket < LATENCY_SUB_BUCKETS) return static_cast<uint64_t>(bucket);
+        int exponent = bucket / LATENCY_SUB_BUCKETS + LATENCY_SUB_BITS - 1;
+        uint64_t sub = static_cast<uint64_t>(bucket % LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKETS);
+        return sub << (exponent - LATENCY_SUB_BITS);
+    }
+};
+
+struct HotPathStats {
+    LatencyHistogram usbFetch{"usb fetch", "us", 1e-3};
+    LatencyHistogram ringQueue{"ring queue", "us", 1e-3};
+    LatencyHistogram decode{"decode", "us", 1e-3};
+    LatencyHistogram encode{"encode", "us", 1e-3};
+    LatencyHistogram send{"send", "us", 1e-3};
+    LatencyHistogram endToEnd{"end to end", "us", 1e-3};
+    LatencyHistogram config{"config", "us", 1e-3};
+    LatencyHistogram configWrite{"config write", "us", 1e-3};
+    LatencyHistogram stimulusWrite{"stim write", "us", 1e-3};
+    LatencyHistogram stimulusLate{"stim late", "us", 1e-3};
+    LatencyHistogram hostToChip{"host to chip", "us", 1e-3};
+    LatencyHistogram packetEvents{"packet", "events", 1};
+    LatencyHistogram containerEvents{"container", "events", 1};
+
+    void print() const {
+        printf("Latency:\n");
+        usbFetch.print();
+        ringQueue.print();
+        decode.print();
+        encode.print();
+        send.print();
+        endToEnd.print();
+        config.print();
+        configWrite.print();
+        stimulusWrite.print();
+        stimulusLate.print();
+        hostToChip.print();
+        packetEvents.print();
+        containerEvents.print();
+    }
+
+    void reset() {
+        usbFetch.reset();
+        ringQueue.reset();
+        decode.reset();
+        encode.reset();
+        send.reset();
+        endToEnd.reset();
+        config.reset();
+        configWrite.reset();
+        stimulusWrite.reset();
+        stimulusLate.reset();
+        hostToChip.reset();
+        packetEvents.reset();
+        containerEvents.reset();
+    }
+};
+
+#endif /* DYNAPSE_LATENCY_STATS_H_ */
@@ -0,0 +1,183 @@
+/*
+ * Prometheus-style metrics endpoint (http://127.0.0.1:9004/metrics).
+ *
+ * Counters are grouped by the thread that updates them (acquisition, sender,
+ * config). Each counter has a single writer, which bumps it with a relaxed
+ * load and store instead of a locked read-modify-write; a scrape only reads
+ * them, so updates cost the same as a plain increment and never contend.
+ * Counters the server already keeps as atomics (spike server, ring) are
+ * read directly at scrape time.
+ *
+ * The endpoint runs on its own thread, serves one HTTP/1.0 response per
+ * connection and only listens on the loopback interface.
+ */
+
+#ifndef DYNAPSE_METRICS_H_
+#define DYNAPSE_METRICS_H_
+
+#include "spike_stream.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define METRICS_PORT 9004
+#define METRICS_MAX_COMMANDS 32
+
+// Counter with exactly one writing thread; any thread may read it.
+class SingleWriterCounter {
+public:
+    void add(uint64_t n) { value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    void increment() { add(1); }
+    uint64_t get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value{0};
+};
+
+// Acquisition thread (readSpikes).
+struct alignas(64) AcquisitionMetrics {
+    SingleWriterCounter containers;
+    SingleWriterCounter events;
+};
+
+// Sender thread (sendSpikes).
+struct alignas(64) SenderMetrics {
+    SingleWriterCounter packets;
+    SingleWriterCounter spikes[4][4]; // by chip slot (U0, U2, U1, U3) and core
+};
+
+// Config thread: commands by name, with their execution time.
+struct alignas(64) ConfigMetrics {
+    struct Command {
+        const char *name = NULL;
+        SingleWriterCounter ok, failed, ns;
+    };
+    Command commands[METRICS_MAX_COMMANDS];
+    int count = 0;
+
+    // Before the config thread starts. The last one registered collects unknown names.
+    void add(const char *name) {
+        if (count < METRICS_MAX_COMMANDS) commands[count++].name = name;
+    }
+
+    void record(const char *command, bool ok, uint64_t ns) {
+        if (count == 0) return;
+        size_t len = strcspn(command, " \t\r\n");
+        Command *match = &commands[count - 1];
+        for (int i = 0; i < count - 1; i++) {
+            if (strlen(commands[i].name) == len && strncmp(commands[i].name, command, len) == 0) {
+                match = &commands[i];
+                break;
+            }
+        }
+        (ok ? match->ok : match->failed).increment();
+        match->ns.add(ns);
+    }
+};
+
+// Text exposition format builder.
+class MetricsText {
+public:
+    void family(const char *name, const char *type, const char *help) {
+        text += "# HELP ";
+        text += name;
+        text += ' ';
+        text += help;
+        text += "\n# TYPE ";
+        text += name;
+        text += ' ';
+        text += type;
+        text += '\n';
+    }
+
+    void sample(const char *name, const char *labels, double value) {
+        char line[256];
+        snprintf(line, sizeof(line), "%s%s%s%s %.12g\n", name, labels[0] ? "{" : "", labels, labels[0] ? "}" : "",
+                 value);
+        text += line;
+    }
+
+    void counter(const char *name, const char *help, double value) {
+        family(name, "counter", help);
+        sample(name, "", value);
+    }
+
+    const std::string &str() const { return text; }
+
+private:
+    std::string text;
+};
+
+class MetricsEndpoint {
+public:
+    ~MetricsEndpoint() { stop(); }
+
+    bool start(int port, std::function<std::string()> render) {
+        listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        if (listenFd < 0) {
+            perror("metrics socket");
+            return false;
+        }
+        int one = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port);
+        if (bind(listenFd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(listenFd, 4) < 0) {
+            perror("metrics bind/listen");
+            close(listenFd);
+            listenFd = -1;
+            return false;
+        }
+        running.store(true);
+        thread = std::thread(&MetricsEndpoint::serve, this, render);
+        printf("Metrics on http://127.0.0.1:%d/metrics\n", port);
+        return true;
+    }
+
+    void stop() {
+        if (!running.exchange(false)) return;
+        thread.join();
+        close(listenFd);
+        listenFd = -1;
+    }
+
+private:
+    int listenFd = -1;
+    std::atomic<bool> running{false};
+    std::thread thread;
+
+    void serve(std::function<std::string()> render) {
+        while (running.load()) {
+            struct pollfd pfd = {listenFd, POLLIN, 0};
+            if (poll(&pfd, 1, 100) <= 0) continue;
+            int fd = accept(listenFd, NULL, NULL);
+            if (fd < 0) continue;
+            // The request itself does not matter: everything is under /metrics.
+            char request[1024];
+            struct pollfd cfd = {fd, POLLIN, 0};
+            if (poll(&cfd, 1, 1000) > 0) {
+                ssize_t r = recv(fd, request, sizeof(request), 0);
+                (void) r;
+            }
+            std::string body = render();
+            std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+                + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+            sendAll(fd, reinterpret_cast<const uint8_t *>(response.data()), response.size());
+            close(fd);
+        }
+    }
+};
+
+#endif /* DYNAPSE_METRICS_H_ */
@@ -0,0 +1,660 @@
+/*
+ * Network compiler: places populations and projections on the 4 chips x
+ * 4 cores x 256 neurons of a Dynap-se board and writes the CAM and routing
+ * SRAM content as a binary program (network_program.h), which the server
+ * loads in one shot with NET_LOAD <file>.
+ *
+ * Network description, one statement per line, '#' starts a comment:
+ *
+ *   population <name> <size> [chip=U0..U3] [core=0..3]
+ *   projection <source> <target> all_to_all|one_to_one|random|fixed_indegree
+ *              type=SLOW_INH|FAST_INH|SLOW_EXC|FAST_EXC [p=0.1] [k=10]
+ *              [weight=1] [seed=1]
+ *
+ * random connects each pair with probability p, fixed_indegree gives every
+ * target k distinct sources. Projections within one population never connect
+ * a neuron to itself. weight is the number of CAMs used per connection.
+ *
+ * Placement works on blocks of NET_BLOCK neurons; a core holds 256 / NET_BLOCK
+ * blocks. Simulated annealing swaps blocks between slots to minimise
+ *   - synapses x chip hops (inter-chip traffic, 2 x 2 board grid),
+ *   - tag aliasing: two source blocks at the same core/position on different
+ *     chips routed into the same core present the same CAM tag there, so their
+ *     targets' CAMs match spikes they should not see (CAM pressure that
+ *     placement can avoid; the number of CAMs per neuron is fixed by the
+ *     projections and checked against the 64 available),
+ *   - sources needing more chips than routing SRAM cells (NET_FIRST_SRAM..3;
+ *     SRAM 0 is left alone for existing routes such as the one to the FPGA).
+ * One independent annealing chain runs per thread and the best placement wins.
+ *
+ * Linux: g++ -std=c++11 -O2 -o network_compiler network_compiler.cpp -lpthread
+ *
+ * ./network_compiler <network.txt> <program.dynp> [--threads=N] [--iterations=N] [--seed=N]
+ */
+
+#include <libcaer/libcaer.h>
+#include <libcaer/devices/dynapse.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "network_program.h"
+
+#define NET_CHIPS 4
+#define NET_CORES 4
+#define NET_CORE_NEURONS 256
+#define NET_BLOCK 16
+#define NET_BLOCKS_PER_CORE (NET_CORE_NEURONS / NET_BLOCK)
+#define NET_SLOTS (NET_CHIPS * NET_CORES * NET_BLOCKS_PER_CORE)
+#define NET_CAMS 64
+#define NET_FIRST_SRAM 1
+#define NET_SRAMS 4
+
+#define NET_ALIAS_COST (NET_BLOCK * NET_BLOCK) // per aliased block pair, about the spurious synapses it can cause
+#define NET_SRAM_COST 1e6                      // per chip a source block cannot route to
+
+// Chip slot 0..3 ↔ chip id, in shadowChipSlot() order.
+static const uint8_t netChipIds[NET_CHIPS] = {DYNAPSE_CONFIG_DYNAPSE_U0, DYNAPSE_CONFIG_DYNAPSE_U2,
+	DYNAPSE_CONFIG_DYNAPSE_U1, DYNAPSE_CONFIG_DYNAPSE_U3};
+
+// Board position: U0 (0,0), U1 (1,0), U2 (0,1), U3 (1,1).
+static inline int chipX(int chipSlot) {
+	return (netChipIds[chipSlot] >> 3) & 1;
+}
+static inline int chipY(int chipSlot) {
+	return (netChipIds[chipSlot] >> 2) & 1;
+}
+static inline int chipHops(int a, int b) {
+	return std::abs(chipX(a) - chipX(b)) + std::abs(chipY(a) - chipY(b));
+}
+
+// SRAM hop fields from chip a to chip b; sx/sy set means towards smaller x/y.
+static void chipRoute(int a, int b, NetRouteRecord &route) {
+	int dx = chipX(b) - chipX(a), dy = chipY(b) - chipY(a);
+	route.sx = dx < 0;
+	route.dx = static_cast<uint8_t>(std::abs(dx));
+	route.sy = dy < 0;
+	route.dy = static_cast<uint8_t>(std::abs(dy));
+}
+
+struct Population {
+	std::string name;
+	int size;
+	int chipSlot = -1, core = -1; // pins, -1 = anywhere
+	int firstNeuron = 0, firstBlock = 0, blocks = 0;
+};
+
+struct Synapse {
+	int source, target; // network neuron indices
+	uint8_t type;
+	uint8_t weight;
+};
+
+struct Network {
+	std::vector<Population> populations;
+	std::vector<Synapse> synapses;
+	int neurons = 0;
+	std::vector<int> blockPopulation; // per block
+};
+
+// Placement problem on blocks, shared read-only by the annealing threads.
+struct PlacementProblem {
+	int blocks = 0;
+	std::vector<std::vector<std::pair<int, uint32_t>>> out, in; // block edges weighted by synapses
+	std::vector<int> pinChip, pinCore;
+
+	bool allowed(int block, int slot) const {
+		return (pinChip[block] < 0 || pinChip[block] == slot / (NET_CORES * NET_BLOCKS_PER_CORE))
+			&& (pinCore[block] < 0 || pinCore[block] == (slot / NET_BLOCKS_PER_CORE) % NET_CORES);
+	}
+};
+
+static inline int slotChip(int slot) {
+	return slot / (NET_CORES * NET_BLOCKS_PER_CORE);
+}
+static inline int slotCore(int slot) {
+	return slot / NET_BLOCKS_PER_CORE; // chip * NET_CORES + core
+}
+static inline int slotTag(int slot) {
+	return slot % (NET_CORES * NET_BLOCKS_PER_CORE); // core and position within the chip
+}
+
+class Annealer {
+public:
+	std::vector<int> pos;
+	double hopCost = 0;
+	int aliasConflicts = 0, sramExcess = 0;
+
+	Annealer(const PlacementProblem &problem, const std::vector<int> &initial) : problem(problem) {
+		occupant.assign(NET_SLOTS, -1);
+		pos.assign(problem.blocks, -1);
+		coreCount.assign(problem.blocks * NET_CHIPS * NET_CORES, 0);
+		aliasCount.assign(NET_CHIPS * NET_CORES * NET_CORES * NET_BLOCKS_PER_CORE, 0);
+		for (int b = 0; b < problem.blocks; b++) {
+			place(b, initial[b]);
+		}
+	}
+
+	double cost() const {
+		return hopCost + NET_ALIAS_COST * aliasConflicts + NET_SRAM_COST * sramExcess;
+	}
+
+	void run(uint64_t iterations, unsigned seed, std::vector<int> &best, double &bestCost) {
+		std::mt19937_64 rng(seed);
+		std::uniform_int_distribution<int> anyBlock(0, problem.blocks - 1), anySlot(0, NET_SLOTS - 1);
+		std::uniform_real_distribution<double> unit(0, 1);
+
+		// Start hot enough to accept a typical uphill move with probability ~0.5.
+		double meanDelta = 0;
+		int samples = 0;
+		for (int i = 0; i < 1000; i++) {
+			int b = anyBlock(rng), s = anySlot(rng), from = pos[b];
+			double before = cost();
+			if (swap(b, s)) {
+				meanDelta += std::fabs(cost() - before);
+				samples++;
+				swap(b, from);
+			}
+		}
+		double temperature = (samples > 0 && meanDelta > 0) ? meanDelta / samples / std::log(2.0) : 1.0;
+		double cooling = std::pow(1e-4, 1.0 / static_cast<double>(std::max<uint64_t>(iterations, 1)));
+
+		best = pos;
+		bestCost = cost();
+		for (uint64_t i = 0; i < iterations; i++, temperature *= cooling) {
+			int b = anyBlock(rng), s = anySlot(rng);
+			int from = pos[b];
+			double before = cost();
+			if (!swap(b, s)) {
+				continue;
+			}
+			double delta = cost() - before;
+			if (delta > 0 && unit(rng) >= std::exp(-delta / temperature)) {
+				swap(b, from);
+				continue;
+			}
+			if (cost() < bestCost) {
+				bestCost = cost();
+				best = pos;
+			}
+		}
+	}
+
+private:
+	const PlacementProblem &problem;
+	std::vector<int> occupant;
+	std::vector<int> coreCount;  // [block][core]: target blocks of block in that core
+	std::vector<int> aliasCount; // [target core][tag]: source blocks with that tag routed into the core
+
+	// Moves block b to slot s, swapping with its occupant. False if a pin forbids it.
+	bool swap(int b, int s) {
+		int from = pos[b], other = occupant[s];
+		if (s == from || !problem.allowed(b, s) || (other >= 0 && !problem.allowed(other, from))) {
+			return false;
+		}
+		remove(b);
+		if (other >= 0) remove(other);
+		place(b, s);
+		if (other >= 0) place(other, from);
+		return true;
+	}
+
+	int chipsUsed(int b) const {
+		int chips = 0;
+		for (int chip = 0; chip < NET_CHIPS; chip++) {
+			const int *count = &coreCount[(b * NET_CHIPS + chip) * NET_CORES];
+			chips += (count[0] | count[1] | count[2] | count[3]) != 0;
+		}
+		return chips;
+	}
+
+	int excess(int b) const {
+		return std::max(0, chipsUsed(b) - (NET_SRAMS - NET_FIRST_SRAM));
+	}
+
+	void aliasAdd(int core, int tag, int d) {
+		int &count = aliasCount[core * NET_CORES * NET_BLOCKS_PER_CORE + tag];
+		aliasConflicts -= std::max(0, count - 1);
+		count += d;
+		aliasConflicts += std::max(0, count - 1);
+	}
+
+	// Block source now has one more/less target block in core.
+	void coreCountAdd(int source, int core, int d) {
+		int before = excess(source);
+		int &count = coreCount[source * NET_CHIPS * NET_CORES + core];
+		count += d;
+		if (pos[source] >= 0 && ((d > 0 && count == 1) || (d < 0 && count == 0))) {
+			aliasAdd(core, slotTag(pos[source]), d);
+		}
+		sramExcess += excess(source) - before;
+	}
+
+	void hops(int b, double sign) {
+		int chip = slotChip(pos[b]);
+		for (const auto &edge : problem.out[b]) {
+			if (edge.first != b && pos[edge.first] >= 0) hopCost += sign * edge.second * chipHops(chip, slotChip(pos[edge.first]));
+		}
+		for (const auto &edge : problem.in[b]) {
+			if (edge.first != b && pos[edge.first] >= 0) hopCost += sign * edge.second * chipHops(slotChip(pos[edge.first]), chip);
+		}
+	}
+
+	void place(int b, int s) {
+		pos[b] = s;
+		occupant[s] = b;
+		hops(b, +1);
+		for (int core = 0; core < NET_CHIPS * NET_CORES; core++) {
+			if (coreCount[b * NET_CHIPS * NET_CORES + core] > 0) aliasAdd(core, slotTag(s), +1);
+		}
+		for (const auto &edge : problem.in[b]) {
+			coreCountAdd(edge.first, slotCore(s), +1);
+		}
+	}
+
+	void remove(int b) {
+		int s = pos[b];
+		hops(b, -1);
+		for (const auto &edge : problem.in[b]) {
+			coreCountAdd(edge.first, slotCore(s), -1);
+		}
+		for (int core = 0; core < NET_CHIPS * NET_CORES; core++) {
+			if (coreCount[b * NET_CHIPS * NET_CORES + core] > 0) aliasAdd(core, slotTag(s), -1);
+		}
+		occupant[s] = -1;
+		pos[b] = -1;
+	}
+};
+
+static bool parseType(const std::string &name, uint8_t &type) {
+	if (name == "SLOW_INH") type = DYNAPSE_CONFIG_CAMTYPE_S_INH;
+	else if (name == "FAST_INH") type = DYNAPSE_CONFIG_CAMTYPE_F_INH;
+	else if (name == "SLOW_EXC") type = DYNAPSE_CONFIG_CAMTYPE_S_EXC;
+	else if (name == "FAST_EXC") type = DYNAPSE_CONFIG_CAMTYPE_F_EXC;
+	else return false;
+	return true;
+}
+
+static int findPopulation(const Network &network, const std::string &name) {
+	for (size_t p = 0; p < network.populations.size(); p++) {
+		if (network.populations[p].name == name) return static_cast<int>(p);
+	}
+	return -1;
+}
+
+static bool parseNetwork(const std::string &path, Network &network) {
+	std::ifstream input(path);
+	if (!input.is_open()) {
+		fprintf(stderr, "Error opening network description: %s\n", path.c_str());
+		return false;
+	}
+	int lineNumber = 0;
+	for (std::string line; std::getline(input, line);) {
+		lineNumber++;
+		line = line.substr(0, line.find('#'));
+		std::istringstream iss(line);
+		std::string statement;
+		if (!(iss >> statement)) continue;
+
+		std::vector<std::string> positional;
+		std::map<std::string, std::string> options;
+		for (std::string token; iss >> token;) {
+			size_t eq = token.find('=');
+			if (eq == std::string::npos) positional.push_back(token);
+			else options[token.substr(0, eq)] = token.substr(eq + 1);
+		}
+
+		if (statement == "population" && positional.size() == 2) {
+			Population population;
+			population.name = positional[0];
+			population.size = atoi(positional[1].c_str());
+			if (options.count("chip")) {
+				const std::string &chip = options["chip"];
+				static const char *names[NET_CHIPS] = {"U0", "U2", "U1", "U3"};
+				for (int c = 0; c < NET_CHIPS; c++) {
+					if (chip == names[c]) population.chipSlot = c;
+				}
+			}
+			if (options.count("core")) population.core = atoi(options["core"].c_str());
+			if (population.size <= 0 || findPopulation(network, population.name) >= 0
+				|| (options.count("chip") && population.chipSlot < 0) || population.core >= NET_CORES
+				|| (options.count("core") && population.core < 0)) {
+				fprintf(stderr, "%s:%d: invalid population: %s\n", path.c_str(), lineNumber, line.c_str());
+				return false;
+			}
+			population.firstNeuron = network.neurons;
+			population.firstBlock = static_cast<int>(network.blockPopulation.size());
+			population.blocks = (population.size + NET_BLOCK - 1) / NET_BLOCK;
+			network.neurons += population.size;
+			network.blockPopulation.insert(network.blockPopulation.end(), population.blocks,
+				static_cast<int>(network.populations.size()));
+			network.populations.push_back(population);
+		}
+		else if (statement == "projection" && positional.size() == 3) {
+			int source = findPopulation(network, positional[0]), target = findPopulation(network, positional[1]);
+			const std::string &pattern = positional[2];
+			uint8_t type;
+			int weight = options.count("weight") ? atoi(options["weight"].c_str()) : 1;
+			double p = options.count("p") ? atof(options["p"].c_str()) : 0;
+			int k = options.count("k") ? atoi(options["k"].c_str()) : 0;
+			std::mt19937 rng(options.count("seed") ? static_cast<unsigned>(atoi(options["seed"].c_str())) : lineNumber);
+			if (source < 0 || target < 0 || !parseType(options["type"], type) || weight < 1 || weight > NET_CAMS) {
+				fprintf(stderr, "%s:%d: invalid projection: %s\n", path.c_str(), lineNumber, line.c_str());
+				return false;
+			}
+
+			const Population &src = network.populations[source], &dst = network.populations[target];
+			bool self = (source == target);
+			auto connect = [&](int i, int j) {
+				network.synapses.push_back({src.firstNeuron + i, dst.firstNeuron + j, type, static_cast<uint8_t>(weight)});
+			};
+			if (pattern == "all_to_all") {
+				for (int i = 0; i < src.size; i++)
+					for (int j = 0; j < dst.size; j++)
+						if (!self || i != j) connect(i, j);
+			}
+			else if (pattern == "one_to_one" && src.size == dst.size && !self) {
+				for (int i = 0; i < src.size; i++) connect(i, i);
+			}
+			else if (pattern == "random" && p > 0 && p <= 1) {
+				std::bernoulli_distribution draw(p);
+				for (int i = 0; i < src.size; i++)
+					for (int j = 0; j < dst.size; j++)
+						if ((!self || i != j) && draw(rng)) connect(i, j);
+			}
+			else if (pattern == "fixed_indegree" && k > 0 && k <= src.size - (self ? 1 : 0)) {
+				std::vector<int> candidates(src.size);
+				for (int j = 0; j < dst.size; j++) {
+					for (int i = 0; i < src.size; i++) candidates[i] = i;
+					if (self) candidates.erase(candidates.begin() + j);
+					for (int n = 0; n < k; n++) {
+						std::uniform_int_distribution<int> pick(n, static_cast<int>(candidates.size()) - 1);
+						std::swap(candidates[n], candidates[pick(rng)]);
+						connect(candidates[n], j);
+					}
+					candidates.resize(src.size);
+				}
+			}
+			else {
+				fprintf(stderr, "%s:%d: invalid projection pattern: %s\n", path.c_str(), lineNumber, line.c_str());
+				return false;
+			}
+		}
+		else {
+			fprintf(stderr, "%s:%d: cannot parse: %s\n", path.c_str(), lineNumber, line.c_str());
+			return false;
+		}
+	}
+	if (network.blockPopulation.size() > NET_SLOTS) {
+		fprintf(stderr, "Network needs %zu blocks of %d neurons, the board has %d.\n", network.blockPopulation.size(),
+			NET_BLOCK, NET_SLOTS);
+		return false;
+	}
+	return !network.populations.empty();
+}
+
+static int neuronBlock(const Network &network, const std::vector<int> &neuronPopulation, int neuron, int *offset) {
+	const Population &population = network.populations[neuronPopulation[neuron]];
+	int index = neuron - population.firstNeuron;
+	*offset = index % NET_BLOCK;
+	return population.firstBlock + index / NET_BLOCK;
+}
+
+// First fit in declaration order, pinned populations first.
+static bool initialPlacement(const PlacementProblem &problem, std::vector<int> &pos) {
+	std::vector<bool> used(NET_SLOTS, false);
+	pos.assign(problem.blocks, -1);
+	for (int pass = 0; pass < 2; pass++) {
+		for (int b = 0; b < problem.blocks; b++) {
+			bool pinned = problem.pinChip[b] >= 0 || problem.pinCore[b] >= 0;
+			if (pinned != (pass == 0)) continue;
+			for (int s = 0; s < NET_SLOTS && pos[b] < 0; s++) {
+				if (!used[s] && problem.allowed(b, s)) {
+					pos[b] = s;
+					used[s] = true;
+				}
+			}
+			if (pos[b] < 0) return false;
+		}
+	}
+	return true;
+}
+
+struct NeuronPlace {
+	int chipSlot, core, address; // address: neuron within the core
+};
+
+static bool emitProgram(const Network &network, const std::vector<NeuronPlace> &place, NetworkProgram &program,
+	int *maxCams, int *aliasedSources) {
+	bool ok = true;
+
+	// CAMs: tag = source core * 256 + source address, one per unit of weight.
+	std::vector<int> camsUsed(network.neurons, 0);
+	for (const Synapse &synapse : network.synapses) {
+		const NeuronPlace &src = place[synapse.source], &dst = place[synapse.target];
+		for (int w = 0; w < synapse.weight; w++) {
+			int &cam = camsUsed[synapse.target];
+			if (cam < NET_CAMS) {
+				NetCamRecord record = {netChipIds[dst.chipSlot], static_cast<uint8_t>(cam), synapse.type, 0,
+					static_cast<uint16_t>(src.core * NET_CORE_NEURONS + src.address),
+					static_cast<uint16_t>(dst.core * NET_CORE_NEURONS + dst.address)};
+				program.cams.push_back(record);
+			}
+			cam++;
+		}
+	}
+	*maxCams = 0;
+	for (int n = 0; n < network.neurons; n++) {
+		*maxCams = std::max(*maxCams, camsUsed[n]);
+		if (camsUsed[n] > NET_CAMS) {
+			if (ok) fprintf(stderr, "Neuron %d needs %d CAMs, %d available.\n", n, camsUsed[n], NET_CAMS);
+			ok = false;
+		}
+	}
+
+	// Routes: per source neuron and destination chip, one SRAM cell with the target core mask.
+	std::vector<uint8_t> coreMask(static_cast<size_t>(network.neurons) * NET_CHIPS, 0);
+	for (const Synapse &synapse : network.synapses) {
+		const NeuronPlace &dst = place[synapse.target];
+		coreMask[synapse.source * NET_CHIPS + dst.chipSlot] |= static_cast<uint8_t>(1 << dst.core);
+	}
+	for (int n = 0; n < network.neurons; n++) {
+		const NeuronPlace &src = place[n];
+		int sram = NET_FIRST_SRAM;
+		for (int chip = 0; chip < NET_CHIPS; chip++) {
+			uint8_t mask = coreMask[n * NET_CHIPS + chip];
+			if (mask == 0) continue;
+			if (sram >= NET_SRAMS) {
+				if (ok) fprintf(stderr, "Neuron %d projects to more chips than it has SRAM cells.\n", n);
+				ok = false;
+				break;
+			}
+			NetRouteRecord route = {};
+			route.chipId = netChipIds[src.chipSlot];
+			route.core = static_cast<uint8_t>(src.core);
+			route.neuron = static_cast<uint8_t>(src.address);
+			route.sramId = static_cast<uint8_t>(sram++);
+			route.virtualCore = static_cast<uint8_t>(src.core);
+			chipRoute(src.chipSlot, chip, route);
+			route.destCores = mask;
+			program.routes.push_back(route);
+		}
+	}
+
+	// Sources sharing a tag on the way into the same core.
+	*aliasedSources = 0;
+	std::vector<int> firstSource(NET_CHIPS * NET_CORES * NET_CORES * NET_CORE_NEURONS, -1);
+	for (int n = 0; n < network.neurons; n++) {
+		const NeuronPlace &src = place[n];
+		for (int chip = 0; chip < NET_CHIPS; chip++) {
+			for (int core = 0; core < NET_CORES; core++) {
+				if (!(coreMask[n * NET_CHIPS + chip] & (1 << core))) continue;
+				int &first = firstSource[((chip * NET_CORES + core) * NET_CORES + src.core) * NET_CORE_NEURONS + src.address];
+				if (first >= 0 && first != n) (*aliasedSources)++;
+				else first = n;
+			}
+		}
+	}
+
+	for (const Population &population : network.populations) {
+		NetPopulation out;
+		out.name = population.name;
+		for (int i = 0; i < population.size; i++) {
+			const NeuronPlace &p = place[population.firstNeuron + i];
+			out.chipIds.push_back(netChipIds[p.chipSlot]);
+			out.neuronIds.push_back(static_cast<uint16_t>(p.core * NET_CORE_NEURONS + p.address));
+		}
+		program.populations.push_back(out);
+	}
+	return ok;
+}
+
+static uint64_t interChipSynapses(const Network &network, const std::vector<NeuronPlace> &place, uint64_t *hopSum) {
+	uint64_t crossing = 0;
+	*hopSum = 0;
+	for (const Synapse &synapse : network.synapses) {
+		int hops = chipHops(place[synapse.source].chipSlot, place[synapse.target].chipSlot);
+		crossing += hops > 0;
+		*hopSum += hops;
+	}
+	return crossing;
+}
+
+static std::vector<NeuronPlace> neuronPlaces(const Network &network, const std::vector<int> &blockPos) {
+	std::vector<NeuronPlace> place(network.neurons);
+	for (const Population &population : network.populations) {
+		for (int i = 0; i < population.size; i++) {
+			int slot = blockPos[population.firstBlock + i / NET_BLOCK];
+			place[population.firstNeuron + i] = {slotChip(slot), slotCore(slot) % NET_CORES,
+				(slot % NET_BLOCKS_PER_CORE) * NET_BLOCK + i % NET_BLOCK};
+		}
+	}
+	return place;
+}
+
+int main(int argc, char *argv[]) {
+	std::vector<std::string> files;
+	int threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+	uint64_t iterations = 200000;
+	unsigned seed = 1;
+	bool usage = false;
+	for (int i = 1; i < argc; i++) {
+		std::string arg(argv[i]);
+		size_t eq = arg.find('=');
+		std::string key = arg.substr(0, eq), value = (eq == std::string::npos) ? "" : arg.substr(eq + 1);
+		if (key == "--threads") threads = std::max(1, atoi(value.c_str()));
+		else if (key == "--iterations") iterations = strtoull(value.c_str(), NULL, 10);
+		else if (key == "--seed") seed = static_cast<unsigned>(atoi(value.c_str()));
+		else if (key.compare(0, 2, "--") == 0) usage = true;
+		else files.push_back(arg);
+	}
+	if (usage || files.size() != 2) {
+		fprintf(stderr, "Usage: %s <network.txt> <program.dynp> [--threads=N] [--iterations=N] [--seed=N]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	Network network;
+	if (!parseNetwork(files[0], network)) {
+		return EXIT_FAILURE;
+	}
+
+	// Block graph.
+	PlacementProblem problem;
+	problem.blocks = static_cast<int>(network.blockPopulation.size());
+	std::vector<int> neuronPopulation(network.neurons);
+	for (size_t p = 0; p < network.populations.size(); p++) {
+		const Population &population = network.populations[p];
+		std::fill(neuronPopulation.begin() + population.firstNeuron,
+			neuronPopulation.begin() + population.firstNeuron + population.size, static_cast<int>(p));
+	}
+	for (int b = 0; b < problem.blocks; b++) {
+		problem.pinChip.push_back(network.populations[network.blockPopulation[b]].chipSlot);
+		problem.pinCore.push_back(network.populations[network.blockPopulation[b]].core);
+	}
+	std::vector<uint32_t> edges(static_cast<size_t>(problem.blocks) * problem.blocks, 0);
+	for (const Synapse &synapse : network.synapses) {
+		int offset;
+		int from = neuronBlock(network, neuronPopulation, synapse.source, &offset);
+		int to = neuronBlock(network, neuronPopulation, synapse.target, &offset);
+		edges[static_cast<size_t>(from) * problem.blocks + to] += synapse.weight;
+	}
+	problem.out.resize(problem.blocks);
+	problem.in.resize(problem.blocks);
+	for (int i = 0; i < problem.blocks; i++) {
+		for (int j = 0; j < problem.blocks; j++) {
+			uint32_t w = edges[static_cast<size_t>(i) * problem.blocks + j];
+			if (w > 0) {
+				problem.out[i].push_back({j, w});
+				problem.in[j].push_back({i, w});
+			}
+		}
+	}
+
+	std::vector<int> initial;
+	if (!initialPlacement(problem, initial)) {
+		fprintf(stderr, "Populations do not fit their chip/core pins.\n");
+		return EXIT_FAILURE;
+	}
+	Annealer start(problem, initial);
+	printf("%d neurons in %d blocks, %zu synapses; initial cost %.0f (%.0f synapse hops, %d aliased, %d unroutable).\n",
+		network.neurons, problem.blocks, network.synapses.size(), start.cost(), start.hopCost, start.aliasConflicts,
+		start.sramExcess);
+
+	// One independent chain per thread.
+	auto searchStart = std::chrono::steady_clock::now();
+	std::vector<std::vector<int>> results(threads);
+	std::vector<double> costs(threads);
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; t++) {
+		workers.emplace_back([&, t]() {
+			Annealer annealer(problem, initial);
+			annealer.run(iterations, seed + static_cast<unsigned>(t) * 7919u, results[t], costs[t]);
+		});
+	}
+	for (std::thread &worker : workers) {
+		worker.join();
+	}
+	int best = static_cast<int>(std::min_element(costs.begin(), costs.end()) - costs.begin());
+	double searchMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - searchStart).count();
+
+	Annealer chosen(problem, results[best]);
+	printf("Placement: %d threads x %llu moves in %.0f ms, best cost %.0f (%.0f synapse hops, %d aliased, %d unroutable).\n",
+		threads, (unsigned long long) iterations, searchMs, chosen.cost(), chosen.hopCost, chosen.aliasConflicts,
+		chosen.sramExcess);
+
+	std::vector<NeuronPlace> place = neuronPlaces(network, results[best]);
+	NetworkProgram program;
+	int maxCams, aliased;
+	if (!emitProgram(network, place, program, &maxCams, &aliased)) {
+		fprintf(stderr, "Network cannot be programmed, no program written.\n");
+		return EXIT_FAILURE;
+	}
+	uint64_t hopSum;
+	uint64_t crossing = interChipSynapses(network, place, &hopSum);
+	printf("Program: %zu CAM entries (max %d per neuron), %zu SRAM routes, %llu inter-chip synapses (%llu hops), "
+		   "%d aliased source tags.\n",
+		program.cams.size(), maxCams, program.routes.size(), (unsigned long long) crossing, (unsigned long long) hopSum,
+		aliased);
+	for (const Population &population : network.populations) {
+		int chips[NET_CHIPS] = {0, 0, 0, 0};
+		for (int i = 0; i < population.size; i++) chips[place[population.firstNeuron + i].chipSlot]++;
+		printf("  %-16s %5d neurons: U0 %d, U1 %d, U2 %d, U3 %d\n", population.name.c_str(), population.size, chips[0],
+			chips[2], chips[1], chips[3]);
+	}
+
+	if (!writeNetworkProgram(files[1], program)) {
+		return EXIT_FAILURE;
+	}
+	printf("Wrote %s.\n", files[1].c_str());
+	return EXIT_SUCCESS;
+}
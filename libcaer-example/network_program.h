@@ -0,0 +1,146 @@
+/*
+ * Compiled network programs (.dynp), written by network_compiler and loaded
+ * by the server with NET_LOAD.
+ *
+ * A program is the complete CAM and routing SRAM content of a placed network,
+ * plus where every population ended up, so spikes can be mapped back to
+ * population and index. Records hold the fields, not the CHIP_CONTENT words,
+ * so the file does not depend on the libcaer version that wrote it.
+ *
+ * Layout (little endian): NetProgramHeader, camCount NetCamRecord,
+ * routeCount NetRouteRecord, then per population: u8 name length, name,
+ * u32 size, size x (u16 chip id, u16 neuron id).
+ */
+
+#ifndef DYNAPSE_NETWORK_PROGRAM_H_
+#define DYNAPSE_NETWORK_PROGRAM_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#define NET_PROGRAM_MAGIC 0x504E5944 // "DYNP" on disk
+#define NET_PROGRAM_VERSION 1
+#define NET_MAX_CAMS (4 * 1024 * 64)  // every CAM of the board
+#define NET_MAX_ROUTES (4 * 1024 * 4) // every SRAM cell of the board
+
+#pragma pack(push, 1)
+struct NetProgramHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t camCount;
+    uint32_t routeCount;
+    uint32_t populationCount;
+};
+
+// One CAM slot, as for CAM_TABLE.
+struct NetCamRecord {
+    uint8_t chipId;
+    uint8_t camId;
+    uint8_t synapseType;
+    uint8_t reserved;
+    uint16_t inputNeuron; // tag: virtual core * 256 + neuron
+    uint16_t neuronAddr;  // core * 256 + neuron
+};
+
+// One SRAM cell, as for ROUTE_SET.
+struct NetRouteRecord {
+    uint8_t chipId;
+    uint8_t core;
+    uint8_t neuron;
+    uint8_t sramId;
+    uint8_t virtualCore;
+    uint8_t sx, dx, sy, dy;
+    uint8_t destCores; // core mask on the destination chip
+    uint16_t reserved;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(NetCamRecord) == 8, "NetCamRecord must stay 8 bytes");
+static_assert(sizeof(NetRouteRecord) == 12, "NetRouteRecord must stay 12 bytes");
+
+struct NetPopulation {
+    std::string name;
+    std::vector<uint16_t> chipIds;   // per population neuron
+    std::vector<uint16_t> neuronIds; // core * 256 + neuron, per population neuron
+};
+
+struct NetworkProgram {
+    std::vector<NetCamRecord> cams;
+    std::vector<NetRouteRecord> routes;
+    std::vector<NetPopulation> populations;
+};
+
+static inline bool writeNetworkProgram(const std::string &path, const NetworkProgram &program) {
+    std::string tmpPath = path + ".tmp";
+    FILE *file = fopen(tmpPath.c_str(), "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening program for writing: %s\n", path.c_str());
+        return false;
+    }
+    NetProgramHeader header = {NET_PROGRAM_MAGIC, NET_PROGRAM_VERSION, static_cast<uint32_t>(program.cams.size()),
+                               static_cast<uint32_t>(program.routes.size()),
+                               static_cast<uint32_t>(program.populations.size())};
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(program.cams.data(), sizeof(NetCamRecord), program.cams.size(), file);
+    fwrite(program.routes.data(), sizeof(NetRouteRecord), program.routes.size(), file);
+    for (const NetPopulation &population : program.populations) {
+        uint8_t len = static_cast<uint8_t>(population.name.size() < 255 ? population.name.size() : 255);
+        uint32_t size = static_cast<uint32_t>(population.neuronIds.size());
+        fwrite(&len, 1, 1, file);
+        fwrite(population.name.data(), 1, len, file);
+        fwrite(&size, sizeof(size), 1, file);
+        for (uint32_t i = 0; i < size; i++) {
+            uint16_t ids[2] = {population.chipIds[i], population.neuronIds[i]};
+            fwrite(ids, sizeof(ids), 1, file);
+        }
+    }
+    if (fclose(file) != 0 || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        remove(tmpPath.c_str());
+        fprintf(stderr, "Error writing program: %s\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+static inline bool readNetworkProgram(const std::string &path, NetworkProgram &program) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening network program: %s\n", path.c_str());
+        return false;
+    }
+    NetProgramHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 && header.magic == NET_PROGRAM_MAGIC
+        && header.version == NET_PROGRAM_VERSION && header.camCount <= NET_MAX_CAMS
+        && header.routeCount <= NET_MAX_ROUTES;
+    if (ok) {
+        program.cams.resize(header.camCount);
+        program.routes.resize(header.routeCount);
+        ok = fread(program.cams.data(), sizeof(NetCamRecord), header.camCount, file) == header.camCount
+            && fread(program.routes.data(), sizeof(NetRouteRecord), header.routeCount, file) == header.routeCount;
+    }
+    for (uint32_t p = 0; ok && p < header.populationCount; p++) {
+        uint8_t len;
+        char name[256];
+        uint32_t size;
+        ok = fread(&len, 1, 1, file) == 1 && fread(name, 1, len, file) == len && fread(&size, sizeof(size), 1, file) == 1
+            && size <= 4 * 1024;
+        NetPopulation population;
+        population.name.assign(name, ok ? len : 0);
+        for (uint32_t i = 0; ok && i < size; i++) {
+            uint16_t ids[2];
+            ok = fread(ids, sizeof(ids), 1, file) == 1;
+            population.chipIds.push_back(ids[0]);
+            population.neuronIds.push_back(ids[1]);
+        }
+        program.populations.push_back(population);
+    }
+    fclose(file);
+    if (!ok) {
+        fprintf(stderr, "Invalid network program: %s\n", path.c_str());
+    }
+    return ok;
+}
+
+#endif /* DYNAPSE_NETWORK_PROGRAM_H_ */
@@ -0,0 +1,266 @@
+/*
+ * Bulk programming of the FPGA Poisson spike generator.
+ *
+ * The generator has one source per neuron address (core * 256 + neuron,
+ * 0-1023), each firing at its own rate into the chip selected with
+ * POISSONSPIKEGEN_CHIPID. A rate is set by writing its generator word to DATA
+ * and then the source address to WRITEADDR, as caerDynapseWritePoissonSpikeRate()
+ * does.
+ *
+ * Rates come as (chip, core, neuron, rate) entries, from a POISSON table, a
+ * dense POISSON_DENSE array, a file or a stimulus frame (stimulus.h). A batch
+ * converts every rate to its generator word once, drops the entries whose
+ * word the generator already holds, and writes the rest back to back after a
+ * single CHIPID write. Changed entries are ordered by word, so sources that
+ * get the same rate (a population switching pattern) share one DATA write and
+ * only cost a WRITEADDR each.
+ *
+ * Entry format (files: one per line, '#' starts a comment; inline: ';'
+ * between entries):
+ *
+ *   <chip> <core> <neuron> <rate Hz>
+ */
+
+#ifndef DYNAPSE_POISSON_RATES_H_
+#define DYNAPSE_POISSON_RATES_H_
+
+#include "cam_table.h"
+#include "dynapse_device.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define POISSON_SOURCES 1024
+#define POISSON_RATE_STEP_HZ 0.06706 // rate of one generator word unit, as in libcaer
+#define POISSON_MAX_RATE_HZ (65535 * POISSON_RATE_STEP_HZ)
+#define POISSON_LINE_MAX 256
+
+struct PoissonRate {
+    uint8_t chipId;
+    uint16_t neuronAddr; // core * 256 + neuron
+    float rateHz;
+};
+
+struct PoissonProgramReport {
+    size_t entries = 0;
+    size_t unchanged = 0;  // the generator already holds this word, or a later entry sets the source
+    size_t written = 0;    // WRITEADDR writes
+    size_t dataWrites = 0; // DATA writes, one per distinct rate
+    double us = 0;
+};
+
+static inline uint16_t poissonRateWord(float rateHz) {
+    double units = std::floor(rateHz / POISSON_RATE_STEP_HZ + 0.5);
+    return static_cast<uint16_t>(std::min(std::max(units, 0.0), 65535.0));
+}
+
+static inline bool makePoissonRate(uint32_t chipId, long core, long neuron, double rateHz, PoissonRate &rate) {
+    if (shadowChipSlot(chipId) < 0 || core < 0 || core > 3 || neuron < 0 || neuron > 255 || !(rateHz >= 0)
+        || rateHz > POISSON_MAX_RATE_HZ) {
+        return false;
+    }
+    rate.chipId = static_cast<uint8_t>(chipId);
+    rate.neuronAddr = static_cast<uint16_t>(core * 256 + neuron);
+    rate.rateHz = static_cast<float>(rateHz);
+    return true;
+}
+
+// Parses one entry; text may continue after it (';' or a comment).
+static inline bool parsePoissonRate(const char *text, PoissonRate &rate, const char **rest = NULL) {
+    uint32_t chipId;
+    if (!parseChipId(&text, &chipId)) {
+        return false;
+    }
+    char *end;
+    long core = strtol(text, &end, 10);
+    if (end == text) return false;
+    text = end;
+    long neuron = strtol(text, &end, 10);
+    if (end == text) return false;
+    text = end;
+    double rateHz = strtod(text, &end);
+    if (end == text || !makePoissonRate(chipId, core, neuron, rateHz, rate)) return false;
+    if (rest != NULL) *rest = end;
+    return true;
+}
+
+// "U0 0 12 50; U0 0 13 50; ..." Returns false on the first invalid entry.
+static inline bool parsePoissonTable(const char *text, std::vector<PoissonRate> &rates) {
+    while (!isBlank(text)) {
+        PoissonRate rate;
+        if (!parsePoissonRate(text, rate, &text)) {
+            return false;
+        }
+        rates.push_back(rate);
+        while (*text == ' ' || *text == '\t') text++;
+        if (*text == ';') text++;
+        else if (!isBlank(text)) return false;
+    }
+    return true;
+}
+
+// "<chip> <first neuron address> <rate> <rate> ...": consecutive sources from the first one.
+static inline bool parsePoissonDense(const char *text, std::vector<PoissonRate> &rates) {
+    uint32_t chipId;
+    if (!parseChipId(&text, &chipId)) {
+        return false;
+    }
+    char *end;
+    long address = strtol(text, &end, 10);
+    if (end == text) return false;
+    text = end;
+    for (;; address++) {
+        double rateHz = strtod(text, &end);
+        if (end == text) break;
+        text = end;
+        PoissonRate rate;
+        if (address >= POISSON_SOURCES || !makePoissonRate(chipId, address / 256, address % 256, rateHz, rate)) {
+            return false;
+        }
+        rates.push_back(rate);
+    }
+    return !rates.empty() && isBlank(text);
+}
+
+// Whole file or nothing, as for CAM tables.
+static inline bool loadPoissonFile(const std::string &path, std::vector<PoissonRate> &rates) {
+    FILE *file = fopen(path.c_str(), "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening Poisson rate table: %s\n", path.c_str());
+        return false;
+    }
+    char line[POISSON_LINE_MAX];
+    int lineNumber = 0, invalid = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        lineNumber++;
+        if (isBlank(line)) continue;
+        PoissonRate rate;
+        const char *rest;
+        if (!parsePoissonRate(line, rate, &rest) || !isBlank(rest)) {
+            if (invalid++ < 10) fprintf(stderr, "%s:%d: invalid Poisson rate: %s", path.c_str(), lineNumber, line);
+            continue;
+        }
+        rates.push_back(rate);
+    }
+    fclose(file);
+    if (invalid > 0) {
+        fprintf(stderr, "%s: %d invalid Poisson rates, table not loaded.\n", path.c_str(), invalid);
+        return false;
+    }
+    return true;
+}
+
+// What the generator holds, so a batch only sends what changed. Used from the
+// config and the stimulus thread.
+class PoissonRateTable {
+public:
+    std::atomic<uint64_t> batches{0};
+    std::atomic<uint64_t> ratesWritten{0};
+    std::atomic<uint64_t> ratesUnchanged{0};
+
+    PoissonRateTable() : words(POISSON_SOURCES, 0), known(POISSON_SOURCES, false) {}
+
+    // All entries must target the same chip: the generator drives one chip at a time.
+    bool program(DynapseDevice *handle, const std::vector<PoissonRate> &rates, PoissonProgramReport &report,
+                 const char **error) {
+        auto start = std::chrono::steady_clock::now();
+        report = PoissonProgramReport();
+        report.entries = rates.size();
+        if (rates.empty()) {
+            return true;
+        }
+        for (const PoissonRate &rate : rates) {
+            if (rate.chipId != rates[0].chipId) {
+                *error = "the Poisson generator drives one chip at a time";
+                return false;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        // The last entry for a source wins.
+        std::vector<int> last(POISSON_SOURCES, -1);
+        for (size_t i = 0; i < rates.size(); i++) {
+            last[rates[i].neuronAddr] = static_cast<int>(i);
+        }
+        changed.clear();
+        for (size_t i = 0; i < rates.size(); i++) {
+            uint16_t address = rates[i].neuronAddr;
+            uint16_t word = poissonRateWord(rates[i].rateHz);
+            if (last[address] != static_cast<int>(i) || (known[address] && words[address] == word)) {
+                report.unchanged++;
+                continue;
+            }
+            changed.push_back((static_cast<uint32_t>(word) << 16) | address);
+        }
+        std::sort(changed.begin(), changed.end());
+
+        bool ok = true;
+        if (!changed.empty() || chipId != rates[0].chipId) {
+            ok = handle->configSet(DYNAPSE_CONFIG_POISSONSPIKEGEN, DYNAPSE_CONFIG_POISSONSPIKEGEN_CHIPID, rates[0].chipId);
+            chipId = ok ? rates[0].chipId : -1;
+        }
+        int data = -1;
+        for (size_t i = 0; ok && i < changed.size(); i++) {
+            uint16_t address = static_cast<uint16_t>(changed[i] & 0xFFFF);
+            uint16_t word = static_cast<uint16_t>(changed[i] >> 16);
+            known[address] = false;
+            if (word != data) {
+                ok = handle->configSet(DYNAPSE_CONFIG_POISSONSPIKEGEN, DYNAPSE_CONFIG_POISSONSPIKEGEN_DATA, word);
+                data = ok ? word : -1;
+                report.dataWrites++;
+            }
+            ok = ok && handle->configSet(DYNAPSE_CONFIG_POISSONSPIKEGEN, DYNAPSE_CONFIG_POISSONSPIKEGEN_WRITEADDR,
+                                         address);
+            if (ok) {
+                words[address] = word;
+                known[address] = true;
+                report.written++;
+            }
+        }
+        if (ok && !running) {
+            ok = handle->configSet(DYNAPSE_CONFIG_POISSONSPIKEGEN, DYNAPSE_CONFIG_POISSONSPIKEGEN_RUN, true);
+            running = ok;
+        }
+        if (!ok) {
+            *error = "Poisson generator write failed";
+        }
+
+        batches.fetch_add(1, std::memory_order_relaxed);
+        ratesWritten.fetch_add(report.written, std::memory_order_relaxed);
+        ratesUnchanged.fetch_add(report.unchanged, std::memory_order_relaxed);
+        report.us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        return ok;
+    }
+
+    // After a board reset the next batch writes everything.
+    void invalidate() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::fill(known.begin(), known.end(), false);
+        chipId = -1;
+        running = false;
+    }
+
+    void printStats() const {
+        printf("Poisson: %llu batches, %llu rates written, %llu unchanged skipped.\n",
+               (unsigned long long) batches.load(), (unsigned long long) ratesWritten.load(),
+               (unsigned long long) ratesUnchanged.load());
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<uint16_t> words;
+    std::vector<bool> known;
+    std::vector<uint32_t> changed; // word << 16 | address
+    int chipId = -1;
+    bool running = false;
+};
+
+#endif /* DYNAPSE_POISSON_RATES_H_ */
@@ -0,0 +1,217 @@
+/*
+ * Per-neuron firing rates for all 4 chips x 4 cores x 256 neurons.
+ *
+ * The sender thread feeds every spike packet in (add(), one counter
+ * increment per spike) and, every interval, publish() folds the counts into
+ * two estimates and encodes one of them as a rate frame for the rate stream
+ * (port 9003):
+ *   DECAYED - exponentially decayed rate, r = r * exp(-dt / tau) + n / tau
+ *   WINDOW  - spike count over the last window, divided by its length
+ * State is kept as flat arrays indexed by spikeAddressIndex() (chip slot *
+ * 1024 + core * 256 + neuron), so the per-interval pass is a
+ * linear sweep over 4096 entries.
+ *
+ * Frame: RateFrameHeader (32 bytes, little endian), then either
+ *   DENSE:  4096 x u16 rate, in 0.1 Hz (saturating), by index
+ *   SPARSE: entries x (u16 index, u16 rate) for the neurons with a rate > 0
+ * whichever is smaller.
+ */
+
+#ifndef DYNAPSE_RATE_ENGINE_H_
+#define DYNAPSE_RATE_ENGINE_H_
+
+#include "spike_server.h"
+
+#include <libcaer/libcaer.h>
+#include <libcaer/devices/dynapse.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#define RATE_FRAME_MAGIC 0x54525944 // "DYRT" on the wire
+#define RATE_FRAME_VERSION 1
+#define RATE_NEURONS SPIKE_ADDRESSES
+#define RATE_MAX_BINS 64 // window / interval
+
+enum RateEstimator : uint8_t {
+    RATE_DECAYED = 0,
+    RATE_WINDOW = 1,
+};
+
+enum RateEncoding : uint8_t {
+    RATE_DENSE = 0,
+    RATE_SPARSE = 1,
+};
+
+#pragma pack(push, 1)
+struct RateFrameHeader {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t estimator;     // RateEstimator
+    uint8_t encoding;      // RateEncoding
+    uint8_t reserved;
+    uint32_t payloadBytes; // bytes following this header
+    uint32_t entries;      // rates in the payload
+    uint32_t sequence;
+    uint32_t intervalUs;   // time covered by this update
+    int64_t lastTimestamp; // 64-bit timestamp of the last spike counted [us]
+};
+#pragma pack(pop)
+
+static_assert(sizeof(RateFrameHeader) == 32, "RateFrameHeader must stay 32 bytes");
+
+class RateEngine {
+public:
+    // Set from the config thread, picked up at the next publish().
+    std::atomic<uint32_t> intervalMs{100};
+    std::atomic<uint32_t> tauMs{500};
+    std::atomic<uint32_t> windowMs{1000};
+    std::atomic<uint8_t> estimator{RATE_DECAYED};
+    std::atomic<uint64_t> framesPublished{0};
+    std::atomic<uint64_t> bytesPublished{0};
+    std::atomic<uint64_t> spikesCounted{0};
+
+    RateEngine() : counts(RATE_NEURONS, 0), decayed(RATE_NEURONS, 0.0f), windowSum(RATE_NEURONS, 0),
+                   rates(RATE_NEURONS, 0) {}
+
+    void add(caerSpikeEventPacket packet) {
+        uint64_t added = 0;
+        CAER_SPIKE_ITERATOR_VALID_START(packet)
+            int index = spikeAddressIndex(caerSpikeEventGetChipID(caerSpikeIteratorElement),
+                                          caerSpikeEventGetSourceCoreID(caerSpikeIteratorElement),
+                                          static_cast<uint16_t>(caerSpikeEventGetNeuronID(caerSpikeIteratorElement)));
+            if (index >= 0) {
+                counts[index]++;
+                added++;
+            }
+            lastTimestamp = caerSpikeEventGetTimestamp64(caerSpikeIteratorElement, packet);
+        CAER_SPIKE_ITERATOR_VALID_END
+        spikesCounted.fetch_add(added, std::memory_order_relaxed);
+    }
+
+    // Milliseconds until the next publish() is due, for the sender's poll timeout.
+    int msUntilDue(std::chrono::steady_clock::time_point now) const {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(nextPublish - now).count();
+        return static_cast<int>(std::max<long long>(0, left));
+    }
+
+    // Folds the counts of the elapsed interval into the estimates and returns
+    // the frame to publish, or nothing if the interval is not over yet.
+    SpikeFramePtr publish(std::chrono::steady_clock::time_point now) {
+        if (now < nextPublish) {
+            return SpikeFramePtr();
+        }
+        uint32_t interval = std::max<uint32_t>(1, intervalMs.load(std::memory_order_relaxed));
+        bool first = lastPublish == std::chrono::steady_clock::time_point();
+        double dt = first ? interval / 1000.0 : std::chrono::duration<double>(now - lastPublish).count();
+        lastPublish = now;
+        nextPublish = now + std::chrono::milliseconds(interval);
+
+        resizeWindow(interval);
+        std::vector<uint32_t> &oldest = bins[binHead];
+        double tau = std::max<uint32_t>(1, tauMs.load(std::memory_order_relaxed)) / 1000.0;
+        float alpha = static_cast<float>(std::exp(-dt / tau));
+        float gain = static_cast<float>(1.0 / tau);
+        for (int i = 0; i < RATE_NEURONS; i++) {
+            uint32_t n = counts[i];
+            decayed[i] = decayed[i] * alpha + n * gain;
+            windowSum[i] += n - oldest[i];
+            oldest[i] = n;
+            counts[i] = 0;
+        }
+        binTimes[binHead] = dt;
+        binHead = (binHead + 1) % bins.size();
+
+        return encode(static_cast<RateEstimator>(estimator.load(std::memory_order_relaxed)), dt);
+    }
+
+    void printStats() const {
+        printf("Rates: %llu frames / %llu bytes published for %llu spikes, interval %u ms, %s.\n",
+               (unsigned long long) framesPublished.load(), (unsigned long long) bytesPublished.load(),
+               (unsigned long long) spikesCounted.load(), intervalMs.load(),
+               (estimator.load() == RATE_WINDOW) ? "WINDOW" : "DECAYED");
+    }
+
+private:
+    // Hot path and per-interval sweep only touch these flat arrays.
+    std::vector<uint32_t> counts;              // spikes in the current interval
+    std::vector<float> decayed;                // Hz
+    std::vector<uint32_t> windowSum;           // spikes in the window
+    std::vector<std::vector<uint32_t>> bins;   // per-interval counts making up the window
+    std::vector<double> binTimes;              // seconds covered by each bin
+    std::vector<uint16_t> rates;               // wire values of the frame being encoded
+    size_t binHead = 0;                        // next bin to overwrite
+    int64_t lastTimestamp = 0;
+    uint32_t sequence = 0;
+    std::chrono::steady_clock::time_point lastPublish, nextPublish;
+
+    // Window length or interval changed: start the window over.
+    void resizeWindow(uint32_t interval) {
+        size_t wanted = std::min<size_t>(RATE_MAX_BINS, std::max<size_t>(1, windowMs.load() / interval));
+        if (bins.size() == wanted) {
+            return;
+        }
+        bins.assign(wanted, std::vector<uint32_t>(RATE_NEURONS, 0));
+        binTimes.assign(wanted, 0.0);
+        std::fill(windowSum.begin(), windowSum.end(), 0);
+        binHead = 0;
+    }
+
+    static uint16_t toWire(double hz) {
+        double tenths = hz * 10.0 + 0.5;
+        return static_cast<uint16_t>(std::min(tenths, 65535.0));
+    }
+
+    SpikeFramePtr encode(RateEstimator kind, double dt) {
+        double windowSeconds = 0;
+        for (double t : binTimes) {
+            windowSeconds += t;
+        }
+        size_t active = 0;
+        for (int i = 0; i < RATE_NEURONS; i++) {
+            double hz = (kind == RATE_WINDOW) ? (windowSeconds > 0 ? windowSum[i] / windowSeconds : 0.0) : decayed[i];
+            rates[i] = toWire(hz);
+            active += (rates[i] != 0);
+        }
+
+        bool sparse = active * 4 < RATE_NEURONS * 2;
+        RateFrameHeader header{};
+        header.magic = RATE_FRAME_MAGIC;
+        header.version = RATE_FRAME_VERSION;
+        header.estimator = kind;
+        header.encoding = sparse ? RATE_SPARSE : RATE_DENSE;
+        header.entries = static_cast<uint32_t>(sparse ? active : RATE_NEURONS);
+        header.payloadBytes = header.entries * (sparse ? 4 : 2);
+        header.sequence = sequence++;
+        header.intervalUs = static_cast<uint32_t>(dt * 1e6);
+        header.lastTimestamp = lastTimestamp;
+
+        auto frame = std::make_shared<SpikeFrame>();
+        frame->bytes.resize(sizeof(header) + header.payloadBytes);
+        memcpy(frame->bytes.data(), &header, sizeof(header));
+        uint8_t *out = frame->bytes.data() + sizeof(header);
+        if (sparse) {
+            for (int i = 0; i < RATE_NEURONS; i++) {
+                if (rates[i] == 0) continue;
+                uint16_t pair[2] = {static_cast<uint16_t>(i), rates[i]};
+                memcpy(out, pair, sizeof(pair));
+                out += sizeof(pair);
+            }
+        }
+        else {
+            memcpy(out, rates.data(), RATE_NEURONS * sizeof(uint16_t));
+        }
+        frame->events = header.entries;
+        framesPublished.fetch_add(1, std::memory_order_relaxed);
+        bytesPublished.fetch_add(frame->bytes.size(), std::memory_order_relaxed);
+        return frame;
+    }
+};
+
+#endif /* DYNAPSE_RATE_ENGINE_H_ */
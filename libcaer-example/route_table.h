@@ -0,0 +1,180 @@
+/*
+ * Batched routing SRAM loader.
+ *
+ * A route table holds one SRAM cell per line, with the ROUTE_SET fields:
+ *
+ *   <chip> <core> <neuron> <sram> <virtual core> <sx> <dx> <sy> <dy> <dest cores>
+ *
+ * chip U0-U3 (or its chip id), core 0-3, neuron 0-255, sram 0-3, virtual core
+ * 0-3, sx/sy 0-1, dx/dy 0-3, dest cores a 4 bit core mask; '#' starts a
+ * comment. A cell listed twice keeps its last value.
+ *
+ * Each entry becomes a caerDynapseGenerateSramBits() CHIP_CONTENT word, the
+ * same write caerDynapseWriteSram() does. Entries are sorted by chip and
+ * cell, cells the shadow already holds are skipped, and each chip's words go
+ * out in one multi-word USB transfer after a single CHIP_ID switch.
+ */
+
+#ifndef DYNAPSE_ROUTE_TABLE_H_
+#define DYNAPSE_ROUTE_TABLE_H_
+
+#include "cam_table.h"
+#include "device_shadow.h"
+#include "dynapse_device.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+struct RouteEntry {
+    uint8_t chipId;
+    uint16_t cell; // neuronId * 4 + sramId
+    uint32_t word;
+};
+
+struct RouteLoadReport {
+    size_t entries = 0;    // distinct cells in the table
+    size_t duplicates = 0; // cells listed more than once
+    size_t written = 0;
+    size_t present = 0;    // skipped, the shadow already holds them
+    size_t perChip[SHADOW_CHIPS] = {0, 0, 0, 0};
+    size_t verified = 0;   // cells the shadow holds with the table's value afterwards
+    double us = 0;
+
+    double entriesPerSecond() const { return (us > 0) ? entries * 1e6 / us : 0.0; }
+};
+
+// Field ranges: core, neuron, sram, virtual core, sx, dx, sy, dy, dest cores.
+static const long routeFieldLimits[9] = {3, 255, 3, 3, 1, 3, 1, 3, 15};
+
+static inline bool makeRouteEntry(uint32_t chipId, const long fields[9], RouteEntry &entry) {
+    if (shadowChipSlot(chipId) < 0) return false;
+    for (int i = 0; i < 9; i++) {
+        if (fields[i] < 0 || fields[i] > routeFieldLimits[i]) return false;
+    }
+    uint16_t neuronId = caerDynapseCoreAddrToNeuronId(static_cast<uint8_t>(fields[0]), static_cast<uint8_t>(fields[1]));
+    entry.chipId = static_cast<uint8_t>(chipId);
+    entry.cell = static_cast<uint16_t>(neuronId * 4 + fields[2]);
+    entry.word = caerDynapseGenerateSramBits(neuronId, static_cast<uint8_t>(fields[2]), static_cast<uint8_t>(fields[3]),
+                                             fields[4] != 0, static_cast<uint8_t>(fields[5]), fields[6] != 0,
+                                             static_cast<uint8_t>(fields[7]), static_cast<uint8_t>(fields[8]));
+    return true;
+}
+
+static inline bool parseRouteEntry(const char *text, RouteEntry &entry, const char **rest = NULL) {
+    uint32_t chipId;
+    if (!parseChipId(&text, &chipId)) {
+        return false;
+    }
+    long fields[9];
+    for (int i = 0; i < 9; i++) {
+        char *end;
+        fields[i] = strtol(text, &end, 10);
+        if (end == text) return false;
+        text = end;
+    }
+    if (!makeRouteEntry(chipId, fields, entry)) {
+        return false;
+    }
+    if (rest != NULL) *rest = text;
+    return true;
+}
+
+// Whole file or nothing, as for CAM tables.
+static inline bool loadRouteFile(const std::string &path, std::vector<RouteEntry> &entries) {
+    FILE *file = fopen(path.c_str(), "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening route table: %s\n", path.c_str());
+        return false;
+    }
+    char line[CAM_LINE_MAX];
+    int lineNumber = 0, invalid = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        lineNumber++;
+        if (isBlank(line)) continue;
+        RouteEntry entry;
+        const char *rest;
+        if (!parseRouteEntry(line, entry, &rest) || !isBlank(rest)) {
+            if (invalid++ < 10) fprintf(stderr, "%s:%d: invalid route: %s", path.c_str(), lineNumber, line);
+            continue;
+        }
+        entries.push_back(entry);
+    }
+    fclose(file);
+    if (invalid > 0) {
+        fprintf(stderr, "%s: %d invalid routes, table not loaded.\n", path.c_str(), invalid);
+        return false;
+    }
+    return true;
+}
+
+// Leaves the last programmed chip selected. shadow may be NULL (no skipping, no verification).
+static inline bool programRouteTable(DynapseDevice *handle, ShadowDynapseDevice *shadow,
+                                     std::vector<RouteEntry> entries, RouteLoadReport &report) {
+    auto start = std::chrono::steady_clock::now();
+    report = RouteLoadReport();
+
+    // Chip order, then cell; stable so the last of several writes to one cell wins.
+    std::stable_sort(entries.begin(), entries.end(), [](const RouteEntry &a, const RouteEntry &b) {
+        return (a.chipId != b.chipId) ? a.chipId < b.chipId : a.cell < b.cell;
+    });
+    std::vector<RouteEntry> unique;
+    unique.reserve(entries.size());
+    for (const RouteEntry &entry : entries) {
+        if (!unique.empty() && unique.back().chipId == entry.chipId && unique.back().cell == entry.cell) {
+            unique.back() = entry;
+            report.duplicates++;
+        }
+        else {
+            unique.push_back(entry);
+        }
+    }
+    report.entries = unique.size();
+
+    bool ok = true;
+    std::vector<uint32_t> words;
+    for (size_t first = 0; first < unique.size();) {
+        uint8_t chipId = unique[first].chipId;
+        size_t last = first;
+        words.clear();
+        for (; last < unique.size() && unique[last].chipId == chipId; last++) {
+            if (shadow != NULL && shadow->routePresent(chipId, unique[last].cell, unique[last].word)) {
+                report.present++;
+                continue;
+            }
+            words.push_back(unique[last].word);
+        }
+        report.perChip[shadowChipSlot(chipId)] = last - first;
+
+        if (!words.empty()) {
+            bool chipOk = handle->configSet(DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, chipId);
+            if (chipOk && !handle->sendDataToUSB(words.data(), words.size())) {
+                for (uint32_t word : words) {
+                    chipOk = handle->configSet(DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_CONTENT, word) && chipOk;
+                }
+            }
+            // Only what surely reached the chip may be skipped next time.
+            for (size_t i = first; shadow != NULL && i < last; i++) {
+                if (chipOk) shadow->rememberRoute(chipId, unique[i].cell, unique[i].word);
+                else shadow->forgetRoute(chipId, unique[i].cell);
+            }
+            report.written += words.size();
+            ok = chipOk && ok;
+        }
+        first = last;
+    }
+
+    for (const RouteEntry &entry : unique) {
+        if (shadow != NULL && shadow->routePresent(entry.chipId, entry.cell, entry.word)) {
+            report.verified++;
+        }
+    }
+    report.us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    return ok;
+}
+
+#endif /* DYNAPSE_ROUTE_TABLE_H_ */
@@ -0,0 +1,473 @@
+/*
+ * Spike path benchmark: a synthetic source stands in for the USB thread and
+ * pushes Poisson or burst traffic over 4 chips x 4 cores x 256 neurons
+ * through the same ring, SpikeServer and encoders as dynapse_simple_v1, to
+ * TCP clients on localhost that decode every frame.
+ *
+ * Each run step reports events/s (per client), bytes/s (all clients), end-to-end latency percentiles
+ * (spike timestamp -> decoded by the client) and sender CPU per million
+ * events (socket fan-out only, see runSender()) as one JSON object per line on stdout; progress and server log lines
+ * go to stderr, so stdout can be piped straight into a regression check.
+ *
+ * Linux: g++ -std=c++11 -O2 -o spike_bench spike_bench.cpp -lcaer -lpthread -lrt
+ *
+ * ./spike_bench [--rates=1e5,1e6,4e6] [--duration=5] [--mode=text|binary|delta]
+ *               [--clients=1] [--pattern=poisson|burst] [--burst-period-ms=100]
+ *               [--burst-duty=0.1] [--slot-us=1000] [--port=9101] [--seed=1]
+ */
+
+#include <libcaer/libcaer.h>
+#include <libcaer/devices/dynapse.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "spike_ring.h"
+#include "spike_server.h"
+
+#define BENCH_LATENCY_BUCKETS 100000 // 1 us resolution up to 100 ms, then one overflow bucket
+#define BENCH_SEND_BATCH 64
+
+static const uint8_t benchChips[4] = {DYNAPSE_CONFIG_DYNAPSE_U0, DYNAPSE_CONFIG_DYNAPSE_U1, DYNAPSE_CONFIG_DYNAPSE_U2,
+	DYNAPSE_CONFIG_DYNAPSE_U3};
+
+struct BenchConfig {
+	std::vector<double> rates{1e5, 1e6, 4e6}; // total events/s
+	double duration = 5;
+	SpikeStreamMode mode = SPIKE_STREAM_BINARY;
+	int clients = 1;
+	bool burst = false;
+	double burstPeriodMs = 100, burstDuty = 0.1;
+	int slotUs = 1000; // one container per slot, like one USB transfer
+	int port = 9101;
+	unsigned seed = 1;
+};
+
+static std::chrono::steady_clock::time_point benchEpoch;
+static FILE *benchResults = stdout;
+
+static int64_t benchNowUs() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - benchEpoch).count();
+}
+
+static double threadCpuSeconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double processCpuSeconds() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+class BenchLatencyHistogram {
+public:
+	BenchLatencyHistogram() : buckets(BENCH_LATENCY_BUCKETS + 1, 0) {}
+
+	void add(int64_t us, uint64_t count) {
+		if (us < 0) us = 0;
+		buckets[static_cast<size_t>(std::min<int64_t>(us, BENCH_LATENCY_BUCKETS))] += count;
+		total += count;
+		maxUs = std::max(maxUs, us);
+	}
+
+	void merge(const BenchLatencyHistogram &other) {
+		for (size_t i = 0; i < buckets.size(); i++) {
+			buckets[i] += other.buckets[i];
+		}
+		total += other.total;
+		maxUs = std::max(maxUs, other.maxUs);
+	}
+
+	int64_t percentile(double p) const {
+		if (total == 0) {
+			return 0;
+		}
+		uint64_t rank = static_cast<uint64_t>(std::ceil(p / 100.0 * total));
+		uint64_t seen = 0;
+		for (size_t i = 0; i < BENCH_LATENCY_BUCKETS; i++) {
+			seen += buckets[i];
+			if (seen >= rank) {
+				return static_cast<int64_t>(i);
+			}
+		}
+		return maxUs; // in the overflow bucket
+	}
+
+	uint64_t count() const { return total; }
+	int64_t max() const { return maxUs; }
+
+private:
+	std::vector<uint64_t> buckets;
+	uint64_t total = 0;
+	int64_t maxUs = 0;
+};
+
+// Decodes the stream like a GUI would and timestamps every spike on arrival.
+class BenchClient {
+public:
+	std::atomic<uint64_t> events{0};
+	std::atomic<uint64_t> bytes{0};
+	BenchLatencyHistogram latency; // read after join()
+
+	bool connectTo(int port, SpikeStreamMode mode) {
+		this->mode = mode;
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		sockaddr_in addr{};
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(static_cast<uint16_t>(port));
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+			perror("bench client connect");
+			return false;
+		}
+		std::string hello = std::string("MODE ") + spikeStreamModeName(mode) + "\n";
+		sendAll(fd, reinterpret_cast<const uint8_t *>(hello.data()), hello.size());
+		thread = std::thread(&BenchClient::run, this);
+		return true;
+	}
+
+	void join() {
+		shutdown(fd, SHUT_RDWR);
+		thread.join();
+		close(fd);
+	}
+
+private:
+	int fd = -1;
+	SpikeStreamMode mode = SPIKE_STREAM_TEXT;
+	std::thread thread;
+	std::vector<uint8_t> pending;
+
+	void run() {
+		uint8_t buf[1 << 16];
+		for (;;) {
+			ssize_t len = recv(fd, buf, sizeof(buf), 0);
+			if (len <= 0) {
+				if (len < 0 && errno == EINTR) continue;
+				break;
+			}
+			int64_t now = benchNowUs();
+			bytes.fetch_add(static_cast<uint64_t>(len), std::memory_order_relaxed);
+			pending.insert(pending.end(), buf, buf + len);
+			size_t used = (mode == SPIKE_STREAM_TEXT) ? decodeText(now) : decodeFrames(now);
+			pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(used));
+		}
+	}
+
+	void record(int64_t now, int64_t ts) {
+		latency.add(now - ts, 1);
+		events.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	size_t decodeText(int64_t now) {
+		size_t start = 0;
+		for (size_t i = 0; i < pending.size(); i++) {
+			if (pending[i] != '\n') {
+				continue;
+			}
+			int64_t ts = 0;
+			for (size_t j = start; j < i && pending[j] != ' '; j++) {
+				ts = ts * 10 + (pending[j] - '0');
+			}
+			record(now, ts);
+			start = i + 1;
+		}
+		return start;
+	}
+
+	static uint64_t readVarint(const uint8_t *&p) {
+		uint64_t value = 0;
+		int shift = 0;
+		while (*p & 0x80) {
+			value |= static_cast<uint64_t>(*p++ & 0x7F) << shift;
+			shift += 7;
+		}
+		return value | (static_cast<uint64_t>(*p++) << shift);
+	}
+
+	size_t decodeFrames(int64_t now) {
+		size_t offset = 0;
+		while (pending.size() - offset >= sizeof(SpikeFrameHeader)) {
+			SpikeFrameHeader header;
+			memcpy(&header, pending.data() + offset, sizeof(header));
+			if (pending.size() - offset < sizeof(header) + header.payloadBytes) {
+				break;
+			}
+			const uint8_t *p = pending.data() + offset + sizeof(header);
+			if (header.encoding == SPIKE_STREAM_BINARY) {
+				for (uint32_t i = 0; i < header.eventCount; i++, p += sizeof(SpikeRecordFixed)) {
+					SpikeRecordFixed rec;
+					memcpy(&rec, p, sizeof(rec));
+					record(now, rec.timestamp);
+				}
+			}
+			else {
+				int64_t ts = header.firstTimestamp;
+				for (uint32_t i = 0; i < header.eventCount; i++) {
+					uint64_t zigzag = readVarint(p);
+					ts += static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+					readVarint(p); // address
+					record(now, ts);
+				}
+			}
+			offset += sizeof(header) + header.payloadBytes;
+		}
+		return offset;
+	}
+};
+
+struct StepResult {
+	uint64_t generated = 0, containers = 0;
+	double sourceLagMs = 0; // how far the source fell behind its own schedule
+};
+
+// Stands in for readSpikes(): one container per slot, handed over through the ring.
+static void runSource(const BenchConfig &config, double rate, SpscRing<caerEventPacketContainer> &ring,
+	SpikeRingStats &ringStats, SpikeServer &server, const std::atomic_bool &stop, StepResult &result) {
+	std::mt19937_64 rng(config.seed);
+	std::uniform_int_distribution<int> address(0, 4 * 4 * 256 - 1);
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+	auto start = std::chrono::steady_clock::now();
+	int64_t slotCount = static_cast<int64_t>(config.duration * 1e6 / config.slotUs);
+	double periodUs = config.burstPeriodMs * 1000;
+
+	for (int64_t slot = 0; slot < slotCount && !stop.load(std::memory_order_relaxed); slot++) {
+		auto slotEnd = start + std::chrono::microseconds((slot + 1) * config.slotUs);
+		std::this_thread::sleep_until(slotEnd);
+		double lagMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - slotEnd).count();
+		result.sourceLagMs = std::max(result.sourceLagMs, lagMs);
+
+		int64_t slotEndUs = benchNowUs();
+		int64_t slotStartUs = slotEndUs - config.slotUs;
+		double slotRate = rate;
+		if (config.burst) {
+			// Same mean rate, concentrated in the first burstDuty of every period.
+			bool on = std::fmod(static_cast<double>(slot * config.slotUs), periodUs) < config.burstDuty * periodUs;
+			slotRate = on ? rate / config.burstDuty : 0;
+		}
+		if (slotRate <= 0) {
+			continue;
+		}
+
+		// Exponential inter-arrival times give a Poisson process within the slot.
+		std::vector<int64_t> arrivals;
+		for (double t = -std::log(1.0 - unit(rng)) * 1e6 / slotRate; t < config.slotUs;
+			 t += -std::log(1.0 - unit(rng)) * 1e6 / slotRate) {
+			arrivals.push_back(slotStartUs + static_cast<int64_t>(t));
+		}
+		if (arrivals.empty()) {
+			continue;
+		}
+
+		int32_t n = static_cast<int32_t>(arrivals.size());
+		caerSpikeEventPacket packet = caerSpikeEventPacketAllocate(n, 0, 0);
+		for (int32_t i = 0; i < n; i++) {
+			int a = address(rng);
+			caerSpikeEvent event = caerSpikeEventPacketGetEvent(packet, i);
+			caerSpikeEventSetTimestamp(event, static_cast<int32_t>(arrivals[static_cast<size_t>(i)]));
+			caerSpikeEventSetNeuronID(event, static_cast<uint32_t>(a & 0xFF));
+			caerSpikeEventSetSourceCoreID(event, static_cast<uint8_t>((a >> 8) & 0x03));
+			caerSpikeEventSetChipID(event, benchChips[a >> 10]);
+			caerSpikeEventValidate(event, packet);
+		}
+		caerEventPacketContainer packetContainer = caerEventPacketContainerAllocate(1);
+		caerEventPacketContainerSetEventPacket(packetContainer, 0, (caerEventPacketHeader) packet);
+
+		if (!ringPush(ring, packetContainer, RING_POLICY_DROP, ringStats, stop)) {
+			ringStats.droppedEvents.fetch_add(static_cast<uint64_t>(n), std::memory_order_relaxed);
+			caerEventPacketContainerFree(packetContainer);
+		}
+		else if (ring.occupancy() == 1) {
+			server.wake();
+		}
+		result.generated += static_cast<uint64_t>(n);
+		result.containers++;
+	}
+}
+
+// The socket fan-out of sendSpikes() in dynapse_simple_v1.cpp: drain the ring in
+// batches, publish, poll. Left out per packet: the rate engine and rate stream,
+// bias sweeps, device clock and spike counters, the shared-memory publish, the
+// recorder and the latency histograms, so the sender CPU reported here is a
+// lower bound for the server's.
+static void runSender(SpscRing<caerEventPacketContainer> &ring, SpikeServer &server, const std::atomic_bool &done,
+	double &cpuSeconds) {
+	double cpuStart = threadCpuSeconds();
+	caerEventPacketContainer packetContainer;
+	for (;;) {
+		bool finished = done.load(std::memory_order_acquire);
+		int drained = 0;
+		while (drained < BENCH_SEND_BATCH && ring.tryPop(packetContainer)) {
+			drained++;
+			caerEventPacketHeader packetHeader = caerEventPacketContainerGetEventPacket(packetContainer, 0);
+			server.publish((caerSpikeEventPacket) packetHeader);
+			caerEventPacketContainerFree(packetContainer);
+		}
+		if (finished && drained < BENCH_SEND_BATCH) {
+			break;
+		}
+		server.poll(drained == BENCH_SEND_BATCH ? 0 : 100);
+	}
+	cpuSeconds = threadCpuSeconds() - cpuStart;
+}
+
+static void runStep(const BenchConfig &config, double rate, SpikeServer &server) {
+	SpscRing<caerEventPacketContainer> ring(SPIKE_RING_CAPACITY);
+	SpikeRingStats ringStats;
+	std::atomic_bool stop(false), sourceDone(false);
+	uint64_t bytesBefore = server.bytesSent.load(), framesDroppedBefore = server.framesDropped.load();
+
+	std::vector<BenchClient *> clients;
+	for (int i = 0; i < config.clients; i++) {
+		BenchClient *client = new BenchClient();
+		if (!client->connectTo(config.port, config.mode)) {
+			delete client;
+			continue;
+		}
+		clients.push_back(client);
+	}
+
+	double senderCpu = 0;
+	std::thread sender(runSender, std::ref(ring), std::ref(server), std::cref(sourceDone), std::ref(senderCpu));
+	// Let the server accept the clients and read their MODE lines first.
+	std::this_thread::sleep_for(std::chrono::milliseconds(SPIKE_STREAM_HELLO_MS + 100));
+
+	StepResult result;
+	double processCpuStart = processCpuSeconds();
+	auto wallStart = std::chrono::steady_clock::now();
+	runSource(config, rate, ring, ringStats, server, stop, result);
+	sourceDone.store(true, std::memory_order_release);
+	sender.join();
+
+	// The sender has exited: flush what it queued last and let the clients catch up.
+	uint64_t delivered = result.generated - ringStats.droppedEvents.load();
+	auto drainDeadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+	for (;;) {
+		uint64_t received = 0;
+		for (BenchClient *client : clients) received += client->events.load();
+		if (received >= delivered * clients.size() || std::chrono::steady_clock::now() > drainDeadline) break;
+		server.poll(10);
+	}
+	double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+	double processCpu = processCpuSeconds() - processCpuStart;
+
+	BenchLatencyHistogram latency;
+	uint64_t received = 0, clientBytes = 0;
+	for (BenchClient *client : clients) {
+		client->join();
+		latency.merge(client->latency);
+		received += client->events.load();
+		clientBytes += client->bytes.load();
+		delete client;
+	}
+	server.poll(0); // reap the closed connections
+
+	double millions = result.generated / 1e6;
+	bool sustained = ringStats.droppedContainers.load() == 0 && server.framesDropped.load() == framesDroppedBefore
+		&& received >= delivered * clients.size() && result.sourceLagMs < 10 * config.slotUs / 1000.0;
+
+	fprintf(benchResults, "{\"target_rate\": %.0f, \"mode\": \"%s\", \"pattern\": \"%s\", \"clients\": %zu, \"duration_s\": %.3f, "
+		   "\"events_generated\": %llu, \"events_received\": %llu, \"events_per_s\": %.0f, \"bytes_per_s\": %.0f, "
+		   "\"server_bytes_sent\": %llu, \"ring_dropped_events\": %llu, \"frames_dropped\": %llu, "
+		   "\"latency_us\": {\"p50\": %lld, \"p99\": %lld, \"p99.9\": %lld, \"max\": %lld}, "
+		   "\"sender_cpu_ms_per_million_events\": %.2f, \"process_cpu_ms_per_million_events\": %.2f, "
+		   "\"source_max_lag_ms\": %.3f, \"sustained\": %s}\n",
+		rate, spikeStreamModeName(config.mode), config.burst ? "burst" : "poisson", clients.size(), config.duration,
+		(unsigned long long) result.generated, (unsigned long long) received,
+		clients.empty() ? 0.0 : received / static_cast<double>(clients.size()) / config.duration,
+		clientBytes / config.duration, (unsigned long long) (server.bytesSent.load() - bytesBefore),
+		(unsigned long long) ringStats.droppedEvents.load(),
+		(unsigned long long) (server.framesDropped.load() - framesDroppedBefore), (long long) latency.percentile(50),
+		(long long) latency.percentile(99), (long long) latency.percentile(99.9), (long long) latency.max(),
+		millions > 0 ? senderCpu * 1e3 / millions : 0.0, millions > 0 ? processCpu * 1e3 / millions : 0.0,
+		result.sourceLagMs, sustained ? "true" : "false");
+	fflush(benchResults);
+	fprintf(stderr, "%.0f ev/s: received %llu/%llu per client in %.1f s, p99 %lld us%s\n", rate,
+		(unsigned long long) (clients.empty() ? 0 : received / clients.size()), (unsigned long long) delivered, wall,
+		(long long) latency.percentile(99), sustained ? "" : " (not sustained)");
+}
+
+static bool parseArgs(int argc, char *argv[], BenchConfig &config) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg(argv[i]);
+		size_t eq = arg.find('=');
+		std::string key = arg.substr(0, eq), value = (eq == std::string::npos) ? "" : arg.substr(eq + 1);
+
+		if (key == "--rates") {
+			config.rates.clear();
+			std::stringstream ss(value);
+			std::string rate;
+			while (std::getline(ss, rate, ',')) {
+				config.rates.push_back(atof(rate.c_str()));
+			}
+		}
+		else if (key == "--duration") config.duration = atof(value.c_str());
+		else if (key == "--mode") {
+			if (value == "text") config.mode = SPIKE_STREAM_TEXT;
+			else if (value == "binary") config.mode = SPIKE_STREAM_BINARY;
+			else if (value == "delta") config.mode = SPIKE_STREAM_BINARY_DELTA;
+			else return false;
+		}
+		else if (key == "--clients") config.clients = atoi(value.c_str());
+		else if (key == "--pattern") {
+			if (value != "poisson" && value != "burst") return false;
+			config.burst = (value == "burst");
+		}
+		else if (key == "--burst-period-ms") config.burstPeriodMs = atof(value.c_str());
+		else if (key == "--burst-duty") config.burstDuty = atof(value.c_str());
+		else if (key == "--slot-us") config.slotUs = atoi(value.c_str());
+		else if (key == "--port") config.port = atoi(value.c_str());
+		else if (key == "--seed") config.seed = static_cast<unsigned>(atoi(value.c_str()));
+		else return false;
+	}
+	return !config.rates.empty() && config.duration > 0 && config.clients > 0 && config.slotUs > 0
+		&& config.burstDuty > 0 && config.burstDuty <= 1;
+}
+
+int main(int argc, char *argv[]) {
+	BenchConfig config;
+	if (!parseArgs(argc, argv, config)) {
+		fprintf(stderr, "Usage: %s [--rates=r1,r2,...] [--duration=s] [--mode=text|binary|delta] [--clients=n]\n"
+						"       [--pattern=poisson|burst] [--burst-period-ms=ms] [--burst-duty=0..1] [--slot-us=us]\n"
+						"       [--port=p] [--seed=n]\n",
+			argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// Results keep the real stdout; everything SpikeServer prints goes to stderr.
+	benchResults = fdopen(dup(STDOUT_FILENO), "w");
+	dup2(STDERR_FILENO, STDOUT_FILENO);
+
+	benchEpoch = std::chrono::steady_clock::now();
+	SpikeServer server;
+	if (!server.start(config.port)) {
+		return EXIT_FAILURE;
+	}
+
+	for (double rate : config.rates) {
+		runStep(config, rate, server);
+	}
+
+	server.shutdown();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,122 @@
+/*
+ * Lock-free single-producer/single-consumer ring used to hand packet
+ * containers from the USB acquisition thread to the network sender thread.
+ *
+ * The producer never waits on the network: when the ring is full the
+ * configured policy either drops the newest container (RING_POLICY_DROP) or
+ * waits for the consumer (RING_POLICY_BLOCK). Both paths are counted in
+ * SpikeRingStats so the cost of a slow client is visible.
+ */
+
+#ifndef DYNAPSE_SPIKE_RING_H_
+#define DYNAPSE_SPIKE_RING_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#define SPIKE_RING_CAPACITY 1024 // containers, must be a power of two
+
+enum SpikeRingPolicy : uint8_t {
+    RING_POLICY_DROP = 0,
+    RING_POLICY_BLOCK = 1,
+};
+
+struct SpikeRingStats {
+    std::atomic<uint64_t> pushed{0};
+    std::atomic<uint64_t> droppedContainers{0};
+    std::atomic<uint64_t> droppedEvents{0};
+    std::atomic<uint64_t> stallNs{0};        // producer time spent waiting for space
+    std::atomic<uint64_t> maxOccupancy{0};
+
+    void print(size_t occupancy, size_t capacity) const {
+        printf("Ring: occupancy %zu/%zu (max %llu), pushed %llu, dropped %llu containers / %llu events, "
+               "stalled %.3f ms.\n",
+               occupancy, capacity, (unsigned long long) maxOccupancy.load(),
+               (unsigned long long) pushed.load(), (unsigned long long) droppedContainers.load(),
+               (unsigned long long) droppedEvents.load(), stallNs.load() / 1e6);
+    }
+};
+
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity) : mask(capacity - 1), slots(capacity) {}
+
+    size_t capacity() const { return slots.size(); }
+
+    size_t occupancy() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    // Producer side.
+    bool tryPush(const T &item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= slots.size()) {
+            return false;
+        }
+        slots[h & mask] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side.
+    bool tryPop(T &item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = slots[t & mask];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    const size_t mask;
+    std::vector<T> slots;
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
+
+// Push according to policy. Returns false if the item was dropped, in which
+// case the caller still owns it. 'stop' aborts a blocking wait on shutdown.
+template <typename T>
+static inline bool ringPush(SpscRing<T> &ring, const T &item, SpikeRingPolicy policy,
+                            SpikeRingStats &stats, const std::atomic_bool &stop) {
+    if (!ring.tryPush(item)) {
+        if (policy == RING_POLICY_DROP) {
+            stats.droppedContainers.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        auto stallStart = std::chrono::steady_clock::now();
+        bool pushed = false;
+        while (!stop.load(std::memory_order_relaxed)) {
+            if (ring.tryPush(item)) {
+                pushed = true;
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        stats.stallNs.fetch_add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                    std::chrono::steady_clock::now() - stallStart).count()),
+                                std::memory_order_relaxed);
+        if (!pushed) {
+            stats.droppedContainers.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+
+    stats.pushed.fetch_add(1, std::memory_order_relaxed);
+    uint64_t occ = ring.occupancy();
+    uint64_t prevMax = stats.maxOccupancy.load(std::memory_order_relaxed);
+    while (occ > prevMax && !stats.maxOccupancy.compare_exchange_weak(prevMax, occ, std::memory_order_relaxed)) {
+    }
+    return true;
+}
+
+#endif /* DYNAPSE_SPIKE_RING_H_ */
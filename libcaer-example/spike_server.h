@@ -0,0 +1,518 @@
+/*
+ * Multi-client spike fan-out server (port 9001).
+ *
+ * A single thread owns the listening socket and all clients and drives them
+ * with epoll. Every spike packet is encoded once per stream mode in use; the
+ * resulting frame is shared by reference count between all clients that use
+ * that mode. Each client has its own bounded queue, so one slow consumer
+ * (a recorder on a busy disk, a stalled GUI) never holds back the others:
+ * it is downsampled, has frames dropped or is disconnected, depending on
+ * the configured SlowClientPolicy.
+ *
+ * Clients may send newline-terminated control lines at any time:
+ *   MODE TEXT | MODE BINARY | MODE BINARY_DELTA
+ *   SUBSCRIBE ... | UNSUBSCRIBE ...  (see spike_stream.h)
+ * A client that sends nothing within SPIKE_STREAM_HELLO_MS is served TEXT.
+ * Subscribed clients only get their spikes: events outside the filter are
+ * skipped while encoding, and clients with the same mode and filter share
+ * the encoded frame.
+ *
+ * The same server carries streams that do not depend on the mode, such as
+ * the rate stream (rate_engine.h): publishFrame() queues a ready-made frame
+ * to every client.
+ */
+
+#ifndef DYNAPSE_SPIKE_SERVER_H_
+#define DYNAPSE_SPIKE_SERVER_H_
+
+#include "latency_stats.h"
+#include "spike_stream.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define SPIKE_CLIENT_QUEUE_BYTES (8 * 1024 * 1024) // per client
+#define SPIKE_CLIENT_MAX_IOV 64
+
+enum SlowClientPolicy : uint8_t {
+    SLOW_CLIENT_DROP = 0,       // drop frames once the queue is full
+    SLOW_CLIENT_DOWNSAMPLE = 1, // thin out frames as the queue fills, drop when full
+    SLOW_CLIENT_DISCONNECT = 2, // close the connection once the queue is full
+};
+
+struct SpikeFrame {
+    std::vector<uint8_t> bytes;
+    uint32_t events = 0;
+};
+
+typedef std::shared_ptr<const SpikeFrame> SpikeFramePtr;
+
+struct SpikeClient {
+    int fd = -1;
+    bool active = false; // stream mode decided, frames are queued
+    SpikeStreamMode mode = SPIKE_STREAM_TEXT;
+    std::shared_ptr<const SpikeFilter> filter; // NULL: every spike
+    std::chrono::steady_clock::time_point helloDeadline;
+    std::string rxBuffer;
+
+    std::deque<SpikeFramePtr> queue;
+    size_t queuedBytes = 0;
+    size_t headOffset = 0; // bytes of queue.front() already sent
+    uint64_t framesOffered = 0;
+    uint64_t framesDropped = 0;
+    bool wantWrite = false;
+    std::chrono::steady_clock::time_point blockedSince; // while wantWrite
+};
+
+class SpikeServer {
+public:
+    std::atomic<uint64_t> clientsConnected{0};
+    std::atomic<uint64_t> bytesSent{0};
+    std::atomic<uint64_t> framesSent{0};
+    std::atomic<uint64_t> framesDropped{0};
+    std::atomic<uint64_t> clientsDisconnected{0};
+    std::atomic<uint64_t> sendWouldBlock{0}; // sendmsg() returned EAGAIN
+    std::atomic<uint64_t> sendBlockedNs{0};  // time clients spent waiting for socket space
+    std::atomic<uint8_t> slowClientPolicy{SLOW_CLIENT_DOWNSAMPLE};
+    LatencyHistogram *sendLatency = NULL; // optional, times every sendmsg()
+
+    explicit SpikeServer(const char *name = "Spike") : name(name) {}
+    ~SpikeServer() { shutdown(); }
+
+    bool start(int port) {
+        listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (listenFd < 0) {
+            perror("spike server socket");
+            return false;
+        }
+        int one = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = INADDR_ANY;
+        addr.sin_port = htons(port);
+        if (bind(listenFd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(listenFd, 16) < 0) {
+            perror("spike server bind/listen");
+            return false;
+        }
+
+        epollFd = epoll_create1(0);
+        wakeFd = eventfd(0, EFD_NONBLOCK);
+        if (epollFd < 0 || wakeFd < 0) {
+            perror("spike server epoll/eventfd");
+            return false;
+        }
+        addToEpoll(listenFd, EPOLLIN);
+        addToEpoll(wakeFd, EPOLLIN);
+
+        printf("%s server listening on port %d.\n", name, port);
+        return true;
+    }
+
+    // Thread-safe: wake poll() early, e.g. when new data has been queued for publish().
+    void wake() {
+        uint64_t one = 1;
+        ssize_t r = write(wakeFd, &one, sizeof(one));
+        (void) r;
+    }
+
+    size_t clientCount() const { return clients.size(); }
+
+    // Encode a spike packet once per mode and filter in use and queue it to every client.
+    // Must be called from the thread that calls poll().
+    void publish(caerSpikeEventPacket packet) {
+        encoded.clear();
+        for (auto &entry : clients) {
+            SpikeClient &client = entry.second;
+            if (!client.active || client.fd == -1) {
+                continue;
+            }
+
+            SpikeFramePtr frame;
+            bool found = false;
+            for (const EncodedFrame &done : encoded) {
+                if (done.mode == client.mode && done.filter == client.filter.get()) {
+                    frame = done.frame;
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) {
+                SpikeStreamEncoder &encoder = encoders[client.mode];
+                encoder.setMode(client.mode);
+                size_t len = encoder.encode(packet, client.filter.get());
+                if (len > 0) {
+                    auto bytes = std::make_shared<SpikeFrame>();
+                    bytes->bytes.assign(encoder.data(), encoder.data() + len);
+                    bytes->events = encoder.events();
+                    frame = bytes;
+                }
+                encoded.push_back({client.mode, client.filter.get(), frame});
+            }
+
+            if (frame) {
+                enqueue(client, frame); // nothing to send if no spike passed the filter
+            }
+        }
+    }
+
+    // Queue one frame, the same for every mode, to every client.
+    // Must be called from the thread that calls poll().
+    void publishFrame(const SpikeFramePtr &frame) {
+        for (auto &entry : clients) {
+            if (entry.second.fd != -1) {
+                enqueue(entry.second, frame);
+            }
+        }
+    }
+
+    // One round of I/O: accept, read control lines, flush queues. Returns after
+    // at most timeoutMs, or earlier on socket activity or wake().
+    void poll(int timeoutMs) {
+        flushAll();
+
+        epoll_event events[32];
+        int n = epoll_wait(epollFd, events, 32, pendingHello ? std::min(timeoutMs, 20) : timeoutMs);
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == listenFd) {
+                acceptClients();
+            }
+            else if (fd == wakeFd) {
+                uint64_t value;
+                ssize_t r = read(wakeFd, &value, sizeof(value));
+                (void) r;
+            }
+            else {
+                auto it = clients.find(fd);
+                if (it == clients.end()) {
+                    continue;
+                }
+                if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                    dropClient(it->second, "hung up");
+                    continue;
+                }
+                if ((events[i].events & EPOLLIN) && !readClient(it->second)) {
+                    continue;
+                }
+                if (events[i].events & EPOLLOUT) {
+                    flush(it->second);
+                }
+            }
+        }
+
+        expireHellos();
+        removeClosed();
+    }
+
+    void printStats() const {
+        printf("%s server: %llu clients connected, %llu disconnected, %llu frames / %llu bytes sent, "
+               "%llu frames dropped for slow clients.\n",
+               name, (unsigned long long) clientsConnected.load(), (unsigned long long) clientsDisconnected.load(),
+               (unsigned long long) framesSent.load(), (unsigned long long) bytesSent.load(),
+               (unsigned long long) framesDropped.load());
+    }
+
+    void shutdown() {
+        for (auto &entry : clients) {
+            if (entry.second.fd != -1) close(entry.second.fd);
+        }
+        clients.clear();
+        if (listenFd != -1) close(listenFd);
+        if (epollFd != -1) close(epollFd);
+        if (wakeFd != -1) close(wakeFd);
+        listenFd = epollFd = wakeFd = -1;
+    }
+
+private:
+    const char *name;
+    int listenFd = -1, epollFd = -1, wakeFd = -1;
+    std::map<int, SpikeClient> clients;
+    std::vector<int> closedFds;
+    SpikeStreamEncoder encoders[3];
+    bool pendingHello = false;
+
+    struct EncodedFrame {
+        SpikeStreamMode mode;
+        const SpikeFilter *filter;
+        SpikeFramePtr frame; // NULL: no spike for this filter
+    };
+    std::vector<EncodedFrame> encoded;                         // this publish() call
+    std::vector<std::shared_ptr<const SpikeFilter>> filterPool; // shared by clients with equal filters
+
+    void addToEpoll(int fd, uint32_t events) {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    void setWantWrite(SpikeClient &client, bool want) {
+        if (client.wantWrite == want) {
+            return;
+        }
+        client.wantWrite = want;
+        if (want) {
+            client.blockedSince = std::chrono::steady_clock::now();
+        }
+        else {
+            addBlockedTime(client);
+        }
+        epoll_event ev{};
+        ev.events = EPOLLIN | (want ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+        ev.data.fd = client.fd;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, client.fd, &ev);
+    }
+
+    void addBlockedTime(const SpikeClient &client) {
+        sendBlockedNs.fetch_add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                    std::chrono::steady_clock::now() - client.blockedSince).count()),
+                                std::memory_order_relaxed);
+    }
+
+    void acceptClients() {
+        removeClosed(); // a new connection may reuse a just-closed fd
+        for (;;) {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK);
+            if (fd < 0) {
+                return;
+            }
+            // Frames are already batched per sendmsg(); Nagle would only add delay.
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            SpikeClient &client = clients[fd];
+            client.fd = fd;
+            client.helloDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(SPIKE_STREAM_HELLO_MS);
+            addToEpoll(fd, EPOLLIN);
+            pendingHello = true;
+            clientsConnected.fetch_add(1, std::memory_order_relaxed);
+            printf("%s client %d connected.\n", name, fd);
+        }
+    }
+
+    void activate(SpikeClient &client, SpikeStreamMode mode) {
+        client.mode = mode;
+        if (!client.active) {
+            client.active = true;
+            printf("%s client %d streaming %s.\n", name, client.fd, spikeStreamModeName(mode));
+        }
+    }
+
+    void expireHellos() {
+        if (!pendingHello) {
+            return;
+        }
+        pendingHello = false;
+        auto now = std::chrono::steady_clock::now();
+        for (auto &entry : clients) {
+            SpikeClient &client = entry.second;
+            if (client.active) {
+                continue;
+            }
+            if (now >= client.helloDeadline) {
+                activate(client, SPIKE_STREAM_TEXT);
+            }
+            else {
+                pendingHello = true;
+            }
+        }
+    }
+
+    bool readClient(SpikeClient &client) {
+        char buf[512];
+        for (;;) {
+            ssize_t len = recv(client.fd, buf, sizeof(buf), 0);
+            if (len > 0) {
+                client.rxBuffer.append(buf, static_cast<size_t>(len));
+                continue;
+            }
+            if (len == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                dropClient(client, "disconnected");
+                return false;
+            }
+            break;
+        }
+
+        size_t pos;
+        while ((pos = client.rxBuffer.find('\n')) != std::string::npos) {
+            std::string line = client.rxBuffer.substr(0, pos);
+            client.rxBuffer.erase(0, pos + 1);
+            handleLine(client, line);
+        }
+        if (client.rxBuffer.size() > 4096) {
+            client.rxBuffer.clear(); // not a line protocol, ignore
+        }
+        return true;
+    }
+
+    void handleLine(SpikeClient &client, const std::string &line) {
+        if (line.rfind("MODE", 0) == 0) {
+            activate(client, parseSpikeStreamMode(line));
+        }
+        else if (line.rfind("SUBSCRIBE ALL", 0) == 0) {
+            client.filter.reset();
+            printf("%s client %d subscribed to all spikes.\n", name, client.fd);
+        }
+        else if (line.rfind("SUBSCRIBE ", 0) == 0 || line.rfind("UNSUBSCRIBE ", 0) == 0) {
+            bool on = line[0] == 'S';
+            // A first SUBSCRIBE starts from nothing, a first UNSUBSCRIBE from everything.
+            SpikeFilter filter;
+            if (client.filter) {
+                filter = *client.filter;
+            }
+            else if (!on) {
+                filter.apply("*", true);
+            }
+            if (!filter.apply(line.substr(on ? 10 : 12), on)) {
+                printf("%s client %d: invalid subscription: %s\n", name, client.fd, line.c_str());
+                return;
+            }
+            client.filter = intern(filter);
+            printf("%s client %d subscribed to %zu neurons.\n", name, client.fd, filter.count());
+        }
+    }
+
+    // Clients with equal filters get the same pointer, so they share encoded frames.
+    std::shared_ptr<const SpikeFilter> intern(const SpikeFilter &filter) {
+        filterPool.erase(std::remove_if(filterPool.begin(), filterPool.end(),
+                                        [](const std::shared_ptr<const SpikeFilter> &f) { return f.use_count() == 1; }),
+                         filterPool.end());
+        for (const auto &pooled : filterPool) {
+            if (*pooled == filter) return pooled;
+        }
+        filterPool.push_back(std::make_shared<const SpikeFilter>(filter));
+        return filterPool.back();
+    }
+
+    void enqueue(SpikeClient &client, const SpikeFramePtr &frame) {
+        client.framesOffered++;
+        size_t len = frame->bytes.size();
+        bool full = client.queuedBytes + len > SPIKE_CLIENT_QUEUE_BYTES;
+        SlowClientPolicy policy = static_cast<SlowClientPolicy>(slowClientPolicy.load(std::memory_order_relaxed));
+
+        if (full && policy == SLOW_CLIENT_DISCONNECT) {
+            dropClient(client, "too slow");
+            return;
+        }
+
+        bool drop = full;
+        if (!drop && policy == SLOW_CLIENT_DOWNSAMPLE) {
+            // Above half full keep every 2nd frame, above 3/4 every 4th.
+            size_t fill = client.queuedBytes * 4 / SPIKE_CLIENT_QUEUE_BYTES;
+            if (fill >= 3) drop = (client.framesOffered % 4) != 0;
+            else if (fill >= 2) drop = (client.framesOffered % 2) != 0;
+        }
+
+        if (drop) {
+            client.framesDropped++;
+            framesDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        client.queue.push_back(frame);
+        client.queuedBytes += len;
+    }
+
+    void flushAll() {
+        for (auto &entry : clients) {
+            if (!entry.second.queue.empty()) {
+                flush(entry.second);
+            }
+        }
+        removeClosed();
+    }
+
+    void flush(SpikeClient &client) {
+        while (!client.queue.empty() && client.fd != -1) {
+            iovec iov[SPIKE_CLIENT_MAX_IOV];
+            int iovCount = 0;
+            for (auto it = client.queue.begin(); it != client.queue.end() && iovCount < SPIKE_CLIENT_MAX_IOV; ++it) {
+                size_t skip = (iovCount == 0) ? client.headOffset : 0;
+                iov[iovCount].iov_base = const_cast<uint8_t *>((*it)->bytes.data()) + skip;
+                iov[iovCount].iov_len = (*it)->bytes.size() - skip;
+                iovCount++;
+            }
+
+            msghdr msg{};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = static_cast<size_t>(iovCount);
+            int64_t sendStart = (sendLatency != NULL) ? latencyNowNs() : 0;
+            ssize_t sent = sendmsg(client.fd, &msg, MSG_NOSIGNAL);
+            if (sendLatency != NULL) sendLatency->recordSince(sendStart);
+            if (sent < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    sendWouldBlock.fetch_add(1, std::memory_order_relaxed);
+                    setWantWrite(client, true);
+                    return;
+                }
+                if (errno == EINTR) {
+                    continue;
+                }
+                dropClient(client, "send failed");
+                return;
+            }
+
+            bytesSent.fetch_add(static_cast<uint64_t>(sent), std::memory_order_relaxed);
+            size_t remaining = static_cast<size_t>(sent);
+            while (remaining > 0) {
+                size_t left = client.queue.front()->bytes.size() - client.headOffset;
+                if (remaining < left) {
+                    client.headOffset += remaining;
+                    break;
+                }
+                remaining -= left;
+                client.queuedBytes -= client.queue.front()->bytes.size();
+                client.queue.pop_front();
+                client.headOffset = 0;
+                framesSent.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        if (client.fd != -1) {
+            setWantWrite(client, false);
+        }
+    }
+
+    void dropClient(SpikeClient &client, const char *reason) {
+        if (client.fd == -1) {
+            return;
+        }
+        printf("%s client %d %s (%llu frames dropped).\n", name, client.fd, reason,
+               (unsigned long long) client.framesDropped);
+        if (client.wantWrite) {
+            addBlockedTime(client);
+        }
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, client.fd, nullptr);
+        close(client.fd);
+        closedFds.push_back(client.fd);
+        client.fd = -1;
+        client.queue.clear();
+        client.queuedBytes = 0;
+        clientsDisconnected.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void removeClosed() {
+        for (int fd : closedFds) {
+            clients.erase(fd);
+        }
+        closedFds.clear();
+    }
+};
+
+#endif /* DYNAPSE_SPIKE_SERVER_H_ */
@@ -0,0 +1,283 @@
+/*
+ * Shared-memory spike transport for consumers on the same host.
+ *
+ * The server publishes every spike as a fixed 16-byte record into a POSIX
+ * shared-memory ring (/dev/shm/<name>). Any number of readers can map the
+ * ring and consume it without a syscall per batch: the writer only bumps two
+ * sequence counters, readers poll them.
+ *
+ * The writer never waits for readers. A reader that falls more than
+ * 'capacity' records behind loses the oldest records; SpikeShmReader detects
+ * this from the sequence numbers and reports it through lost().
+ *
+ * Reader usage (header only, link with -lrt on older glibc; define
+ * SPIKE_SHM_READER_ONLY to use it without libcaer):
+ *
+ *   SpikeShmReader reader;
+ *   if (reader.open(SPIKE_SHM_DEFAULT_NAME)) {
+ *       SpikeShmRecord batch[4096];
+ *       while (reader.waitForData(100)) {
+ *           size_t n = reader.read(batch, 4096);
+ *           ...
+ *       }
+ *   }
+ */
+
+#ifndef DYNAPSE_SPIKE_SHM_H_
+#define DYNAPSE_SPIKE_SHM_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef SPIKE_SHM_READER_ONLY
+#include <libcaer/libcaer.h>
+#include <libcaer/devices/dynapse.h>
+#endif
+
+#define SPIKE_SHM_DEFAULT_NAME "/dynapse_spikes"
+#define SPIKE_SHM_DEFAULT_CAPACITY (1 << 20) // records, must be a power of two
+#define SPIKE_SHM_MAGIC 0x4D485344           // "DSHM"
+#define SPIKE_SHM_VERSION 1
+
+#if ATOMIC_LLONG_LOCK_FREE != 2
+#error "spike_shm.h needs lock-free 64-bit atomics to share them between processes"
+#endif
+
+struct SpikeShmRecord {
+    int64_t timestamp; // 64-bit device timestamp [us]
+    uint16_t neuronId;
+    uint8_t coreId;
+    uint8_t chipId;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(SpikeShmRecord) == 16, "SpikeShmRecord must stay 16 bytes");
+
+struct SpikeShmHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    uint64_t writerPid;
+    // Highest sequence the writer may be touching; records below
+    // writeClaim - capacity can no longer be trusted.
+    alignas(64) std::atomic<uint64_t> writeClaim;
+    // Records below writeSeq are complete.
+    alignas(64) std::atomic<uint64_t> writeSeq;
+    // SpikeShmRecord[capacity] follows the header.
+};
+
+static inline size_t spikeShmSize(uint64_t capacity) {
+    return sizeof(SpikeShmHeader) + capacity * sizeof(SpikeShmRecord);
+}
+
+#ifndef SPIKE_SHM_READER_ONLY
+
+class SpikeShmWriter {
+public:
+    ~SpikeShmWriter() { close(); }
+
+    bool open(const std::string &shmName = SPIKE_SHM_DEFAULT_NAME, uint64_t capacity = SPIKE_SHM_DEFAULT_CAPACITY) {
+        if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+            fprintf(stderr, "Shared memory capacity must be a power of two.\n");
+            return false;
+        }
+
+        int fd = shm_open(shmName.c_str(), O_CREAT | O_RDWR, 0644);
+        if (fd < 0) {
+            perror("shm_open");
+            return false;
+        }
+        size = spikeShmSize(capacity);
+        if (ftruncate(fd, static_cast<off_t>(size)) < 0) {
+            perror("ftruncate");
+            ::close(fd);
+            return false;
+        }
+        void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mem == MAP_FAILED) {
+            perror("mmap");
+            return false;
+        }
+
+        header = static_cast<SpikeShmHeader *>(mem);
+        header->magic = 0; // readers ignore the ring until it is fully set up
+        header->version = SPIKE_SHM_VERSION;
+        header->capacity = capacity;
+        header->writerPid = static_cast<uint64_t>(getpid());
+        header->writeClaim.store(0, std::memory_order_relaxed);
+        header->writeSeq.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        header->magic = SPIKE_SHM_MAGIC;
+
+        records = reinterpret_cast<SpikeShmRecord *>(header + 1);
+        mask = capacity - 1;
+        name = shmName;
+        printf("Spike shared memory %s ready (%llu records).\n", name.c_str(), (unsigned long long) capacity);
+        return true;
+    }
+
+    bool isOpen() const { return header != nullptr; }
+
+    // Append one batch (one spike packet) and publish it with a single store.
+    void publish(caerSpikeEventPacket packet) {
+        int32_t num = caerEventPacketHeaderGetEventNumber(&packet->packetHeader);
+        if (header == nullptr || num <= 0) {
+            return;
+        }
+
+        uint64_t seq = header->writeSeq.load(std::memory_order_relaxed);
+        header->writeClaim.store(seq + static_cast<uint64_t>(num), std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        CAER_SPIKE_ITERATOR_VALID_START(packet)
+            SpikeShmRecord &rec = records[seq & mask];
+            rec.timestamp = caerSpikeEventGetTimestamp64(caerSpikeIteratorElement, packet);
+            rec.neuronId = static_cast<uint16_t>(caerSpikeEventGetNeuronID(caerSpikeIteratorElement));
+            rec.coreId = caerSpikeEventGetSourceCoreID(caerSpikeIteratorElement);
+            rec.chipId = caerSpikeEventGetChipID(caerSpikeIteratorElement);
+            rec.reserved = 0;
+            seq++;
+        CAER_SPIKE_ITERATOR_VALID_END
+
+        header->writeClaim.store(seq, std::memory_order_relaxed);
+        header->writeSeq.store(seq, std::memory_order_release);
+    }
+
+    void close() {
+        if (header != nullptr) {
+            munmap(header, size);
+            shm_unlink(name.c_str());
+            header = nullptr;
+        }
+    }
+
+private:
+    SpikeShmHeader *header = nullptr;
+    SpikeShmRecord *records = nullptr;
+    uint64_t mask = 0;
+    size_t size = 0;
+    std::string name;
+};
+
+#endif /* SPIKE_SHM_READER_ONLY */
+
+class SpikeShmReader {
+public:
+    ~SpikeShmReader() { close(); }
+
+    // Attach to a running server. Starts reading at the current write position.
+    bool open(const std::string &shmName = SPIKE_SHM_DEFAULT_NAME) {
+        int fd = shm_open(shmName.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            perror("shm_open");
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(SpikeShmHeader)) {
+            fprintf(stderr, "Spike shared memory %s is not initialized.\n", shmName.c_str());
+            ::close(fd);
+            return false;
+        }
+        size = static_cast<size_t>(st.st_size);
+        void *mem = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mem == MAP_FAILED) {
+            perror("mmap");
+            return false;
+        }
+
+        header = static_cast<const SpikeShmHeader *>(mem);
+        if (header->magic != SPIKE_SHM_MAGIC || header->version != SPIKE_SHM_VERSION
+            || spikeShmSize(header->capacity) > size) {
+            fprintf(stderr, "Spike shared memory %s has an unknown layout.\n", shmName.c_str());
+            close();
+            return false;
+        }
+
+        records = reinterpret_cast<const SpikeShmRecord *>(header + 1);
+        capacity = header->capacity;
+        readSeq = header->writeSeq.load(std::memory_order_acquire);
+        lostRecords = 0;
+        return true;
+    }
+
+    // Records published but not yet read (may exceed capacity after an overrun).
+    uint64_t available() const {
+        return header->writeSeq.load(std::memory_order_acquire) - readSeq;
+    }
+
+    // Copy up to maxRecords new records into out. Never blocks, no syscalls.
+    size_t read(SpikeShmRecord *out, size_t maxRecords) {
+        uint64_t writeSeq = header->writeSeq.load(std::memory_order_acquire);
+        if (writeSeq - readSeq > capacity) {
+            lostRecords += writeSeq - capacity - readSeq;
+            readSeq = writeSeq - capacity;
+        }
+
+        size_t n = static_cast<size_t>(std::min<uint64_t>(maxRecords, writeSeq - readSeq));
+        size_t first = static_cast<size_t>(std::min<uint64_t>(n, capacity - (readSeq & (capacity - 1))));
+        memcpy(out, records + (readSeq & (capacity - 1)), first * sizeof(SpikeShmRecord));
+        memcpy(out + first, records, (n - first) * sizeof(SpikeShmRecord));
+
+        // Anything the writer started to overwrite while we copied is discarded.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t claim = header->writeClaim.load(std::memory_order_relaxed);
+        uint64_t validFrom = (claim > capacity) ? claim - capacity : 0;
+        if (readSeq < validFrom) {
+            size_t stale = static_cast<size_t>(std::min<uint64_t>(n, validFrom - readSeq));
+            memmove(out, out + stale, (n - stale) * sizeof(SpikeShmRecord));
+            lostRecords += stale;
+            readSeq += stale;
+            n -= stale;
+        }
+
+        readSeq += n;
+        return n;
+    }
+
+    // Poll for new data with a short spin, then sleep in small steps.
+    bool waitForData(int timeoutMs) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+        for (int spin = 0; available() == 0; spin++) {
+            if (spin < 256) {
+                continue;
+            }
+            if (std::chrono::steady_clock::now() >= deadline) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        return true;
+    }
+
+    uint64_t lost() const { return lostRecords; }
+
+    void close() {
+        if (header != nullptr) {
+            munmap(const_cast<SpikeShmHeader *>(header), size);
+            header = nullptr;
+        }
+    }
+
+private:
+    const SpikeShmHeader *header = nullptr;
+    const SpikeShmRecord *records = nullptr;
+    uint64_t capacity = 0;
+    uint64_t readSeq = 0;
+    uint64_t lostRecords = 0;
+    size_t size = 0;
+};
+
+#endif /* DYNAPSE_SPIKE_SHM_H_ */
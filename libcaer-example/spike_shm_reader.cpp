@@ -0,0 +1,57 @@
+/*
+ * Example consumer of the shared-memory spike stream of dynapse_simple_v1 --shm.
+ * Prints the spike rate per chip once a second.
+ *
+ * Linux: g++ -std=c++11 -O2 -o spike_shm_reader spike_shm_reader.cpp -lrt
+ */
+
+#define SPIKE_SHM_READER_ONLY
+#include "spike_shm.h"
+
+#include <csignal>
+#include <map>
+
+static std::atomic_bool globalShutdown(false);
+
+static void globalShutdownSignalHandler(int signal) {
+	if (signal == SIGTERM || signal == SIGINT) {
+		globalShutdown.store(true);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	signal(SIGTERM, &globalShutdownSignalHandler);
+	signal(SIGINT, &globalShutdownSignalHandler);
+
+	const char *name = (argc > 1) ? argv[1] : SPIKE_SHM_DEFAULT_NAME;
+	SpikeShmReader reader;
+	if (!reader.open(name)) {
+		return EXIT_FAILURE;
+	}
+	printf("Reading spikes from %s...\n", name);
+
+	static SpikeShmRecord batch[8192];
+	std::map<int, uint64_t> spikesPerChip;
+	auto lastReport = std::chrono::steady_clock::now();
+
+	while (!globalShutdown.load()) {
+		if (reader.waitForData(100)) {
+			size_t n = reader.read(batch, 8192);
+			for (size_t i = 0; i < n; i++) {
+				spikesPerChip[batch[i].chipId]++;
+			}
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		if (now - lastReport >= std::chrono::seconds(1)) {
+			for (const auto &entry : spikesPerChip) {
+				printf("chip %d: %llu spikes/s  ", entry.first, (unsigned long long) entry.second);
+			}
+			printf("(lost %llu)\n", (unsigned long long) reader.lost());
+			spikesPerChip.clear();
+			lastReport = now;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,309 @@
+/*
+ * Spike stream encoding for the GUI socket (port 9001).
+ *
+ * Two wire formats are supported, selected by the client right after connect:
+ *
+ *   TEXT   - legacy format, one "ts neuronId coreId chipId\n" line per spike.
+ *   BINARY - one length-prefixed frame per caerSpikeEventPacket:
+ *              SpikeFrameHeader (24 bytes, little endian)
+ *              eventCount records, either
+ *                FIXED: SpikeRecordFixed (8 bytes)
+ *                DELTA: zigzag LEB128 timestamp delta to the previous spike,
+ *                       LEB128 address (neuronId << 11 | coreId << 6 | chipId)
+ *
+ * A client selects a format by sending "MODE TEXT", "MODE BINARY" or
+ * "MODE BINARY_DELTA" (newline terminated) within SPIKE_STREAM_HELLO_MS of
+ * connecting. Clients that send nothing get TEXT, so old GUIs keep working.
+ *
+ * Clients may also narrow what they receive (newline terminated, any time):
+ *   SUBSCRIBE <chip> [<core> [<neuron>[-<neuron>]]]
+ *   UNSUBSCRIBE <chip> [<core> [<neuron>[-<neuron>]]]
+ *   SUBSCRIBE ALL
+ * with chip U0-U3 (or its chip id 0/8/4/12) or '*', core 0-3 or '*', neurons
+ * 0-255. The first SUBSCRIBE replaces "everything" with just what it names;
+ * later ones add to it. The selection is a SpikeFilter bitset over the 4096
+ * chip/core/neuron addresses, applied while encoding.
+ */
+
+#ifndef DYNAPSE_SPIKE_STREAM_H_
+#define DYNAPSE_SPIKE_STREAM_H_
+
+#include <libcaer/libcaer.h>
+#include <libcaer/devices/dynapse.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+
+#define SPIKE_FRAME_MAGIC 0x50535944 // "DYSP" on the wire
+#define SPIKE_FRAME_VERSION 1
+#define SPIKE_STREAM_HELLO_MS 200
+#define SPIKE_ADDRESSES (4 * 4 * 256) // chips x cores x neurons
+
+enum SpikeStreamMode : uint8_t {
+    SPIKE_STREAM_TEXT = 0,
+    SPIKE_STREAM_BINARY = 1,
+    SPIKE_STREAM_BINARY_DELTA = 2,
+};
+
+#pragma pack(push, 1)
+struct SpikeFrameHeader {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t encoding;       // SPIKE_STREAM_BINARY or SPIKE_STREAM_BINARY_DELTA
+    uint16_t reserved;
+    uint32_t payloadBytes;  // bytes following this header
+    uint32_t eventCount;
+    int64_t firstTimestamp; // 64-bit timestamp of the first spike [us]
+};
+
+struct SpikeRecordFixed {
+    int32_t timestamp;
+    uint16_t neuronId;
+    uint8_t coreId;
+    uint8_t chipId;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(SpikeFrameHeader) == 24, "SpikeFrameHeader must stay 24 bytes");
+static_assert(sizeof(SpikeRecordFixed) == 8, "SpikeRecordFixed must stay 8 bytes");
+
+static inline const char *spikeStreamModeName(SpikeStreamMode mode) {
+    switch (mode) {
+        case SPIKE_STREAM_BINARY: return "BINARY";
+        case SPIKE_STREAM_BINARY_DELTA: return "BINARY_DELTA";
+        default: return "TEXT";
+    }
+}
+
+// Parse a client "MODE ..." control line. Unknown modes fall back to TEXT.
+static inline SpikeStreamMode parseSpikeStreamMode(const std::string &line) {
+    if (line.rfind("MODE BINARY_DELTA", 0) == 0) return SPIKE_STREAM_BINARY_DELTA;
+    if (line.rfind("MODE BINARY", 0) == 0) return SPIKE_STREAM_BINARY;
+    return SPIKE_STREAM_TEXT;
+}
+
+// Index of a spike source: chip slot (chip id 0/4/8/12 → 0-3) * 1024 + core * 256
+// + neuron, -1 for an unknown chip id.
+static inline int spikeAddressIndex(uint8_t chipId, uint8_t coreId, uint16_t neuronId) {
+    if (chipId > 12 || (chipId & 0x03) != 0 || coreId > 3 || neuronId > 255) return -1;
+    return (chipId >> 2) * 1024 + coreId * 256 + neuronId;
+}
+
+// Set of spike sources a client wants.
+struct SpikeFilter {
+    uint64_t bits[SPIKE_ADDRESSES / 64] = {};
+
+    bool test(uint8_t chipId, uint8_t coreId, uint16_t neuronId) const {
+        int index = spikeAddressIndex(chipId, coreId, neuronId);
+        return index >= 0 && (bits[index >> 6] >> (index & 63)) & 1;
+    }
+
+    void set(int index, bool on) {
+        if (on) bits[index >> 6] |= 1ull << (index & 63);
+        else bits[index >> 6] &= ~(1ull << (index & 63));
+    }
+
+    size_t count() const {
+        size_t n = 0;
+        for (uint64_t word : bits) {
+            n += static_cast<size_t>(__builtin_popcountll(word));
+        }
+        return n;
+    }
+
+    bool operator==(const SpikeFilter &other) const { return memcmp(bits, other.bits, sizeof(bits)) == 0; }
+
+    // Adds (or removes) "<chip> [<core> [<neuron>[-<neuron>]]]". Returns false on a malformed selection.
+    bool apply(const std::string &selection, bool on) {
+        char chip[8] = "", core[8] = "*";
+        int first = 0, last = 255, fields = sscanf(selection.c_str(), "%7s %7s %d-%d", chip, core, &first, &last);
+        if (fields < 1) return false;
+        if (fields == 3) last = first;
+        if (first < 0 || last > 255 || first > last) return false;
+
+        int chipSlot = -1, coreId = -1;
+        char *end;
+        if (chip[0] == 'U' && chip[1] >= '0' && chip[1] <= '3' && chip[2] == '\0') {
+            static const int slots[4] = {0, 2, 1, 3}; // U1 is chip id 8, U2 is 4
+            chipSlot = slots[chip[1] - '0'];
+        }
+        else if (strcmp(chip, "*") != 0) {
+            long chipId = strtol(chip, &end, 10);
+            if (end == chip || *end != '\0' || chipId < 0 || chipId > 12 || (chipId & 0x03) != 0) return false;
+            chipSlot = static_cast<int>(chipId >> 2);
+        }
+        if (strcmp(core, "*") != 0) {
+            coreId = static_cast<int>(strtol(core, &end, 10));
+            if (end == core || *end != '\0' || coreId < 0 || coreId > 3) return false;
+        }
+        for (int slot = 0; slot < 4; slot++) {
+            if (chipSlot >= 0 && slot != chipSlot) continue;
+            for (int c = 0; c < 4; c++) {
+                if (coreId >= 0 && c != coreId) continue;
+                for (int neuron = first; neuron <= last; neuron++) {
+                    set(slot * 1024 + c * 256 + neuron, on);
+                }
+            }
+        }
+        return true;
+    }
+};
+
+// send() until everything is out. Returns false when the peer is gone.
+static inline bool sendAll(int fd, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        ssize_t sent = send(fd, data, len, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += sent;
+        len -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+// Encodes a whole spike packet into one contiguous buffer, so it can be sent
+// with a single syscall. The buffer is reused between packets.
+class SpikeStreamEncoder {
+public:
+    explicit SpikeStreamEncoder(SpikeStreamMode mode = SPIKE_STREAM_TEXT) : mode(mode) {}
+
+    SpikeStreamMode getMode() const { return mode; }
+    void setMode(SpikeStreamMode m) { mode = m; }
+
+    const uint8_t *data() const { return buffer.data(); }
+    size_t size() const { return buffer.size(); }
+    uint32_t events() const { return eventCount; }
+
+    // Returns the number of bytes ready in data(), 0 if the packet had no valid
+    // spikes (in filter, if given).
+    size_t encode(caerSpikeEventPacket packet, const SpikeFilter *filter = NULL) {
+        buffer.clear();
+        eventCount = 0;
+        this->filter = filter;
+
+        int32_t num = caerEventPacketHeaderGetEventNumber(&packet->packetHeader);
+        if (num <= 0) {
+            return 0;
+        }
+
+        if (mode == SPIKE_STREAM_TEXT) {
+            buffer.reserve(static_cast<size_t>(num) * 32);
+            encodeText(packet);
+        }
+        else {
+            size_t perEvent = (mode == SPIKE_STREAM_BINARY) ? sizeof(SpikeRecordFixed) : 8;
+            buffer.reserve(sizeof(SpikeFrameHeader) + static_cast<size_t>(num) * perEvent);
+            buffer.resize(sizeof(SpikeFrameHeader));
+            int64_t firstTs = (mode == SPIKE_STREAM_BINARY) ? encodeFixed(packet) : encodeDelta(packet);
+
+            SpikeFrameHeader header{};
+            header.magic = SPIKE_FRAME_MAGIC;
+            header.version = SPIKE_FRAME_VERSION;
+            header.encoding = mode;
+            header.payloadBytes = static_cast<uint32_t>(buffer.size() - sizeof(SpikeFrameHeader));
+            header.eventCount = eventCount;
+            header.firstTimestamp = firstTs;
+            memcpy(buffer.data(), &header, sizeof(header));
+        }
+
+        return (eventCount > 0) ? buffer.size() : 0;
+    }
+
+private:
+    SpikeStreamMode mode;
+    std::vector<uint8_t> buffer;
+    uint32_t eventCount = 0;
+    const SpikeFilter *filter = NULL;
+
+    bool wanted(caerSpikeEventConst event) const {
+        return filter == NULL
+            || filter->test(caerSpikeEventGetChipID(event), caerSpikeEventGetSourceCoreID(event),
+                            static_cast<uint16_t>(caerSpikeEventGetNeuronID(event)));
+    }
+
+    void appendDecimal(uint64_t value) {
+        char tmp[20];
+        int n = 0;
+        do {
+            tmp[n++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        while (n > 0) {
+            buffer.push_back(static_cast<uint8_t>(tmp[--n]));
+        }
+    }
+
+    void appendVarint(uint64_t value) {
+        while (value >= 0x80) {
+            buffer.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        buffer.push_back(static_cast<uint8_t>(value));
+    }
+
+    // Every event, valid or not, as the former "%llu %llu %llu %llu\n" formatting sent them.
+    void encodeText(caerSpikeEventPacket packet) {
+        CAER_SPIKE_ITERATOR_ALL_START(packet)
+            if (!wanted(caerSpikeIteratorElement)) continue;
+            appendDecimal(static_cast<uint64_t>(caerSpikeEventGetTimestamp(caerSpikeIteratorElement)));
+            buffer.push_back(' ');
+            appendDecimal(caerSpikeEventGetNeuronID(caerSpikeIteratorElement));
+            buffer.push_back(' ');
+            appendDecimal(caerSpikeEventGetSourceCoreID(caerSpikeIteratorElement));
+            buffer.push_back(' ');
+            appendDecimal(caerSpikeEventGetChipID(caerSpikeIteratorElement));
+            buffer.push_back('\n');
+            eventCount++;
+        CAER_SPIKE_ITERATOR_ALL_END
+    }
+
+    int64_t encodeFixed(caerSpikeEventPacket packet) {
+        int64_t firstTs = 0;
+        CAER_SPIKE_ITERATOR_VALID_START(packet)
+            if (!wanted(caerSpikeIteratorElement)) continue;
+            if (eventCount == 0) {
+                firstTs = caerSpikeEventGetTimestamp64(caerSpikeIteratorElement, packet);
+            }
+            SpikeRecordFixed rec;
+            rec.timestamp = caerSpikeEventGetTimestamp(caerSpikeIteratorElement);
+            rec.neuronId = static_cast<uint16_t>(caerSpikeEventGetNeuronID(caerSpikeIteratorElement));
+            rec.coreId = caerSpikeEventGetSourceCoreID(caerSpikeIteratorElement);
+            rec.chipId = caerSpikeEventGetChipID(caerSpikeIteratorElement);
+            const uint8_t *raw = reinterpret_cast<const uint8_t *>(&rec);
+            buffer.insert(buffer.end(), raw, raw + sizeof(rec));
+            eventCount++;
+        CAER_SPIKE_ITERATOR_VALID_END
+        return firstTs;
+    }
+
+    int64_t encodeDelta(caerSpikeEventPacket packet) {
+        int64_t firstTs = 0, lastTs = 0;
+        CAER_SPIKE_ITERATOR_VALID_START(packet)
+            if (!wanted(caerSpikeIteratorElement)) continue;
+            int64_t ts = caerSpikeEventGetTimestamp64(caerSpikeIteratorElement, packet);
+            if (eventCount == 0) {
+                firstTs = lastTs = ts;
+            }
+            int64_t delta = ts - lastTs;
+            lastTs = ts;
+            appendVarint(static_cast<uint64_t>((delta << 1) ^ (delta >> 63)));
+
+            uint64_t address = (static_cast<uint64_t>(caerSpikeEventGetNeuronID(caerSpikeIteratorElement)) << 11)
+                | (static_cast<uint64_t>(caerSpikeEventGetSourceCoreID(caerSpikeIteratorElement)) << 6)
+                | caerSpikeEventGetChipID(caerSpikeIteratorElement);
+            appendVarint(address);
+            eventCount++;
+        CAER_SPIKE_ITERATOR_VALID_END
+        return firstTs;
+    }
+};
+
+#endif /* DYNAPSE_SPIKE_STREAM_H_ */
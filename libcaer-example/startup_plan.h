@@ -0,0 +1,188 @@
+/*
+ * Declarative startup sequence.
+ *
+ * main() lists what the board needs, phase by phase: FPGA registers, bias
+ * files and per-chip settings. Before anything is sent the plan is optimized:
+ *   - a write that repeats the value already written to the same target since
+ *     the last barrier (CHIP_RUN) is dropped, as is a bias file loaded again
+ *     on a chip that already got it;
+ *   - within a phase, board-wide writes go first and per-chip steps are
+ *     grouped by chip, starting with the chip the previous phase ended on, so
+ *     every phase costs at most one CHIP_ID switch per chip. The phase with
+ *     the last per-chip step instead ends on the chip that step was declared
+ *     for, so the plan leaves the same chip selected as the declared order
+ *     (config clients that skip CHIP_ID rely on it).
+ * Phases stay in the declared order, and so do the steps of one chip inside a
+ * phase; a CHIP_RUN therefore belongs at the start of its phase. run() prints
+ * the time of every phase.
+ */
+
+#ifndef DYNAPSE_STARTUP_PLAN_H_
+#define DYNAPSE_STARTUP_PLAN_H_
+
+#include "device_shadow.h"
+#include "dynapse_device.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#define STARTUP_ALL_CHIPS -1 // board-wide step (FPGA register, no CHIP_ID needed)
+
+struct StartupStep {
+    int phase;
+    int chipId; // DYNAPSE_CONFIG_DYNAPSE_U*, or STARTUP_ALL_CHIPS
+    int8_t modAddr;
+    uint8_t paramAddr;
+    uint32_t param;
+    std::string biasFile; // set: load this bias file instead of a configSet
+};
+
+struct StartupPlanReport {
+    size_t declared = 0;
+    size_t executed = 0;
+    size_t chipSwitches = 0;
+    double us = 0;
+};
+
+// Loads a bias file onto the selected chip.
+typedef bool (*StartupBiasLoader)(DynapseDevice *handle, const std::string &biasFile);
+
+class StartupPlan {
+public:
+    // Starts a new phase; following steps belong to it.
+    void phase(const std::string &name) { phases.push_back(name); }
+
+    void set(int8_t modAddr, uint8_t paramAddr, uint32_t param) {
+        add(STARTUP_ALL_CHIPS, modAddr, paramAddr, param, "");
+    }
+
+    void setChip(int chipId, int8_t modAddr, uint8_t paramAddr, uint32_t param) {
+        add(chipId, modAddr, paramAddr, param, "");
+    }
+
+    void loadBiases(int chipId, const std::string &biasFile) { add(chipId, 0, 0, 0, biasFile); }
+
+    size_t size() const { return steps.size(); }
+
+    // Drops redundant steps and orders each phase by chip. Returns the number of steps dropped.
+    size_t optimize() {
+        std::map<std::tuple<int, int, int>, uint32_t> written;
+        std::map<int, std::string> biasFiles;
+        std::vector<StartupStep> kept;
+        for (const StartupStep &step : steps) {
+            if (!step.biasFile.empty()) {
+                auto last = biasFiles.find(step.chipId);
+                if (last != biasFiles.end() && last->second == step.biasFile) continue;
+                biasFiles[step.chipId] = step.biasFile;
+            }
+            else {
+                auto key = std::make_tuple(step.chipId, static_cast<int>(step.modAddr), static_cast<int>(step.paramAddr));
+                auto last = written.find(key);
+                if (last != written.end() && last->second == step.param) continue;
+                if (isBarrier(step)) {
+                    written.clear();
+                    biasFiles.clear();
+                }
+                written[key] = step.param;
+            }
+            kept.push_back(step);
+        }
+        size_t dropped = steps.size() - kept.size();
+
+        int lastChip = STARTUP_ALL_CHIPS, lastChipPhase = -1;
+        for (const StartupStep &step : steps) {
+            if (step.chipId != STARTUP_ALL_CHIPS) {
+                lastChip = step.chipId;
+                lastChipPhase = step.phase;
+            }
+        }
+
+        int current = -1;
+        for (size_t first = 0; first < kept.size();) {
+            size_t last = first;
+            while (last < kept.size() && kept[last].phase == kept[first].phase) last++;
+            // Board-wide first, then chips in slot order rotated to begin with the selected one,
+            // or, in the phase that ends the chip steps, to end with the chip declared last.
+            int start = (current < 0) ? 0 : shadowChipSlot(static_cast<uint32_t>(current));
+            if (kept[first].phase == lastChipPhase) {
+                start = (shadowChipSlot(static_cast<uint32_t>(lastChip)) + 1) % SHADOW_CHIPS;
+            }
+            std::stable_sort(kept.begin() + first, kept.begin() + last,
+                             [start](const StartupStep &a, const StartupStep &b) {
+                                 return chipRank(a.chipId, start) < chipRank(b.chipId, start);
+                             });
+            for (size_t i = first; i < last; i++) {
+                if (kept[i].chipId != STARTUP_ALL_CHIPS) current = kept[i].chipId;
+            }
+            first = last;
+        }
+        steps.swap(kept);
+        return dropped;
+    }
+
+    bool run(DynapseDevice *handle, StartupBiasLoader loadBiasFile, StartupPlanReport &report) const {
+        auto begin = std::chrono::steady_clock::now();
+        report = StartupPlanReport();
+        report.declared = declared;
+        int selected = -1;
+        bool ok = true;
+        for (size_t first = 0; first < steps.size();) {
+            int phase = steps[first].phase;
+            auto phaseBegin = std::chrono::steady_clock::now();
+            size_t last = first;
+            for (; last < steps.size() && steps[last].phase == phase; last++) {
+                const StartupStep &step = steps[last];
+                if (step.chipId != STARTUP_ALL_CHIPS && step.chipId != selected) {
+                    ok = handle->configSet(DYNAPSE_CONFIG_CHIP, DYNAPSE_CONFIG_CHIP_ID, step.chipId) && ok;
+                    selected = step.chipId;
+                    report.chipSwitches++;
+                }
+                if (!step.biasFile.empty()) {
+                    if (!loadBiasFile(handle, step.biasFile)) {
+                        fprintf(stderr, "Startup: cannot load %s\n", step.biasFile.c_str());
+                        return false;
+                    }
+                }
+                else {
+                    ok = handle->configSet(step.modAddr, step.paramAddr, step.param) && ok;
+                }
+                report.executed++;
+            }
+            printf("Startup phase %s: %zu steps in %.1f ms.\n", phases[phase].c_str(), last - first,
+                   std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - phaseBegin).count());
+            first = last;
+        }
+        report.us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+        return ok;
+    }
+
+private:
+    std::vector<std::string> phases;
+    std::vector<StartupStep> steps;
+    size_t declared = 0;
+
+    void add(int chipId, int8_t modAddr, uint8_t paramAddr, uint32_t param, const std::string &biasFile) {
+        if (phases.empty()) phase("startup");
+        StartupStep step = {static_cast<int>(phases.size()) - 1, chipId, modAddr, paramAddr, param, biasFile};
+        steps.push_back(step);
+        declared++;
+    }
+
+    // Starting or stopping the chips resets them: what was written before no longer counts.
+    static bool isBarrier(const StartupStep &step) {
+        return step.biasFile.empty() && step.modAddr == DYNAPSE_CONFIG_CHIP && step.paramAddr == DYNAPSE_CONFIG_CHIP_RUN;
+    }
+
+    static int chipRank(int chipId, int start) {
+        if (chipId == STARTUP_ALL_CHIPS) return -1;
+        return (shadowChipSlot(static_cast<uint32_t>(chipId)) - start + SHADOW_CHIPS) % SHADOW_CHIPS;
+    }
+};
+
+#endif /* DYNAPSE_STARTUP_PLAN_H_ */
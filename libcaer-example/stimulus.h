@@ -0,0 +1,525 @@
+/*
+ * Stimulus stream (port 9005): input spikes from the host into the chips.
+ *
+ * Clients send timestamped spike trains; the stimulus thread queues them by
+ * due time and hands them to the FPGA spike generator in batches: one SRAM
+ * transfer holding the spikes of the next window with their ISIs, then a
+ * generator run, so the FPGA and not the host keeps the spacing inside a
+ * batch. Batches alternate between two halves of the generator SRAM, and a
+ * new run only starts once the previous one has played out. The generator
+ * has a single destination chip, so a batch holds the spikes of one chip.
+ *
+ * Times are either relative (microseconds after the frame arrives) or device
+ * time (the 64-bit timestamps of the spike stream). Device time is mapped to
+ * the host clock with DeviceClock, which the sender thread feeds with the
+ * arrival of every spike packet. A batch is written "lead" microseconds before
+ * its first spike is due, to cover the USB transfer (AUTO: 1.5 x the mean
+ * transfer time); spikes more than maxLate behind are dropped.
+ *
+ * A frame may instead carry Poisson rates (STIMULUS_POISSON_RATES): they are
+ * applied on arrival as one batch (poisson_rates.h), so a whole input
+ * population switches pattern with a single frame.
+ *
+ * Wire format (little endian):
+ *   client → server: StimulusFrameHeader, then spikes x StimulusSpike
+ *                    (or x StimulusRate with STIMULUS_POISSON_RATES)
+ *   server → client: one StimulusAck per frame, once all its spikes are sent
+ * The ack gives the device time at which the first spike of the frame was
+ * injected, to be matched against the spike stream for spike-in → spike-out
+ * loop times, and the host-to-chip latency (frame received → last USB write
+ * done).
+ */
+
+#ifndef DYNAPSE_STIMULUS_H_
+#define DYNAPSE_STIMULUS_H_
+
+#include "device_shadow.h"
+#include "dynapse_device.h"
+#include "latency_stats.h"
+#include "poisson_rates.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <queue>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define STIMULUS_PORT 9005
+#define STIMULUS_FRAME_MAGIC 0x54535944 // "DYST" on the wire
+#define STIMULUS_ACK_MAGIC 0x41535944   // "DYSA" on the wire
+#define STIMULUS_VERSION 1
+#define STIMULUS_MAX_FRAME_SPIKES 65536
+#define STIMULUS_MAX_BATCH 1024 // spikes per generator run
+#define STIMULUS_SRAM_BASE 0    // two halves of STIMULUS_MAX_BATCH spikes each
+#define STIMULUS_MAX_WINDOW_US 60000 // ISIs must fit a 16-bit word
+#define STIMULUS_CLOCK_WINDOW_NS 1000000000LL
+
+enum StimulusFlags : uint8_t {
+    STIMULUS_DEVICE_TIME = 1,   // spike times are device timestamps, not delays
+    STIMULUS_POISSON_RATES = 2, // the frame holds StimulusRate entries
+};
+
+#pragma pack(push, 1)
+struct StimulusFrameHeader {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t flags;  // StimulusFlags
+    uint16_t reserved;
+    uint32_t sequence; // echoed in the ack
+    uint32_t spikes;
+};
+
+struct StimulusSpike {
+    int64_t time;      // [us], delay or device timestamp; <= 0 with a delay: as soon as possible
+    uint8_t chipId;    // DYNAPSE_CONFIG_DYNAPSE_U*
+    uint8_t core;      // source core of the virtual spike
+    uint8_t neuron;    // source neuron within the core
+    uint8_t destCores; // destination core mask, 0 = all four
+};
+
+struct StimulusRate {
+    float rateHz;
+    uint8_t chipId; // DYNAPSE_CONFIG_DYNAPSE_U*, the same for the whole frame
+    uint8_t core;
+    uint8_t neuron;
+    uint8_t reserved;
+};
+
+struct StimulusAck {
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t injected;
+    uint32_t dropped;      // invalid, late, or not schedulable yet (device time before any spike)
+    int64_t deviceTime;    // first spike injected [us], -1 if none
+    uint32_t hostToChipUs; // frame received → last USB write done
+    uint32_t reserved;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(StimulusFrameHeader) == 16, "StimulusFrameHeader must stay 16 bytes");
+static_assert(sizeof(StimulusSpike) == 12, "StimulusSpike must stay 12 bytes");
+static_assert(sizeof(StimulusRate) == 8, "StimulusRate must stay 8 bytes");
+static_assert(sizeof(StimulusAck) == 32, "StimulusAck must stay 32 bytes");
+
+// Device timestamps ↔ host steady clock. Keeps the smallest host - device
+// offset seen (the packet that waited least on the way), renewed every second
+// so drift is followed.
+class DeviceClock {
+public:
+    // Sender thread: a spike stamped deviceUs was fetched from USB at hostNs.
+    void observe(int64_t deviceUs, int64_t hostNs) {
+        int64_t offset = hostNs - deviceUs * 1000;
+        if (!synced() || offset < offsetNs.load(std::memory_order_relaxed)
+            || hostNs - sinceNs > STIMULUS_CLOCK_WINDOW_NS) {
+            offsetNs.store(offset, std::memory_order_relaxed);
+            sinceNs = hostNs;
+            valid.store(true, std::memory_order_release);
+        }
+    }
+
+    bool synced() const { return valid.load(std::memory_order_acquire); }
+    int64_t toHostNs(int64_t deviceUs) const { return deviceUs * 1000 + offsetNs.load(std::memory_order_relaxed); }
+    int64_t toDeviceUs(int64_t hostNs) const { return (hostNs - offsetNs.load(std::memory_order_relaxed)) / 1000; }
+
+private:
+    std::atomic<bool> valid{false};
+    std::atomic<int64_t> offsetNs{0};
+    int64_t sinceNs = 0; // sender thread only
+};
+
+class StimulusServer {
+public:
+    DeviceClock clock;
+    // Set from the config thread, picked up at the next batch.
+    std::atomic<int64_t> leadUs{-1}; // -1 = AUTO
+    std::atomic<uint32_t> windowUs{2000};
+    std::atomic<uint32_t> maxLateUs{10000};
+
+    std::atomic<uint64_t> framesReceived{0};
+    std::atomic<uint64_t> spikesReceived{0};
+    std::atomic<uint64_t> spikesInjected{0};
+    std::atomic<uint64_t> spikesDropped{0};
+    std::atomic<uint64_t> batches{0};
+    std::atomic<uint64_t> writeFailures{0};
+    std::atomic<uint64_t> clientsConnected{0};
+    LatencyHistogram *writeLatency = NULL; // optional: USB write of a batch
+    LatencyHistogram *lateness = NULL;     // optional: generator run started after the first spike was due
+    LatencyHistogram *hostToChip = NULL;   // optional: per frame, as in the ack
+    PoissonRateTable *poissonRates = NULL; // rate frames are rejected without it
+
+    ~StimulusServer() { stop(); }
+
+    // Spike generator writes go to device from the stimulus thread only.
+    bool start(int port, DynapseDevice *dynapse) {
+        listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (listenFd < 0) {
+            perror("stimulus socket");
+            return false;
+        }
+        int one = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = INADDR_ANY;
+        addr.sin_port = htons(port);
+        if (bind(listenFd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(listenFd, 4) < 0) {
+            perror("stimulus bind/listen");
+            close(listenFd);
+            listenFd = -1;
+            return false;
+        }
+        device = dynapse;
+        int16_t logicClock = device->info().logicClock;
+        isiBase = (logicClock > 0) ? static_cast<uint32_t>(logicClock) : 1; // ISI unit: 1 us
+        device->configSet(DYNAPSE_CONFIG_SPIKEGEN, DYNAPSE_CONFIG_SPIKEGEN_VARMODE, true);
+        device->configSet(DYNAPSE_CONFIG_SPIKEGEN, DYNAPSE_CONFIG_SPIKEGEN_ISIBASE, isiBase);
+        device->configSet(DYNAPSE_CONFIG_SPIKEGEN, DYNAPSE_CONFIG_SPIKEGEN_REPEAT, false);
+        running.store(true);
+        thread = std::thread(&StimulusServer::serve, this);
+        printf("Stimulus stream on port %d\n", port);
+        return true;
+    }
+
+    void stop() {
+        if (!running.exchange(false)) return;
+        thread.join();
+        for (auto &entry : clients) {
+            close(entry.first);
+        }
+        clients.clear();
+        close(listenFd);
+        listenFd = -1;
+    }
+
+    void printStats() const {
+        int64_t lead = leadUs.load();
+        printf("Stimulus: %llu frames with %llu spikes received, %llu injected in %llu batches, %llu dropped, "
+               "%llu write failures, lead %s%lld us, window %u us.\n",
+               (unsigned long long) framesReceived.load(), (unsigned long long) spikesReceived.load(),
+               (unsigned long long) spikesInjected.load(), (unsigned long long) batches.load(),
+               (unsigned long long) spikesDropped.load(), (unsigned long long) writeFailures.load(),
+               lead < 0 ? "AUTO " : "", (long long) (lead < 0 ? autoLeadNs.load() / 1000 : lead), windowUs.load());
+    }
+
+private:
+    struct QueuedSpike {
+        int64_t dueNs;
+        uint64_t order; // keeps spikes due at the same time in arrival order
+        uint32_t frame;
+        uint8_t chipId, core, neuron, destCores;
+
+        bool operator>(const QueuedSpike &other) const {
+            return dueNs != other.dueNs ? dueNs > other.dueNs : order > other.order;
+        }
+    };
+
+    struct PendingFrame {
+        int fd;
+        uint32_t sequence;
+        uint32_t remaining = 0, injected = 0, dropped = 0;
+        int64_t receivedNs, firstInjectNs = -1, lastWriteNs = -1;
+    };
+
+    struct BatchSpike {
+        uint32_t frame;
+        int64_t offsetUs; // after the generator run starts
+    };
+
+    int listenFd = -1;
+    std::atomic<bool> running{false};
+    std::thread thread;
+    DynapseDevice *device = NULL;
+    uint32_t isiBase = 1;
+
+    // Stimulus thread only.
+    std::map<int, std::vector<uint8_t>> clients; // fd → bytes of an incomplete frame
+    std::set<int> closing;                        // closed after this round
+    std::map<uint32_t, PendingFrame> frames;
+    std::priority_queue<QueuedSpike, std::vector<QueuedSpike>, std::greater<QueuedSpike>> queue;
+    std::vector<uint16_t> words;
+    std::vector<BatchSpike> batch;
+    std::vector<PoissonRate> rates;
+    uint32_t nextFrame = 0;
+    uint64_t nextOrder = 0;
+    int64_t busyUntilNs = 0; // the generator plays the previous batch until then
+    int currentChip = -1;
+    int sramHalf = 0;
+    int64_t writeAverageNs = 0;
+    std::atomic<int64_t> autoLeadNs{500000};
+
+    int64_t currentLeadNs() const {
+        int64_t lead = leadUs.load(std::memory_order_relaxed);
+        return (lead < 0) ? autoLeadNs.load(std::memory_order_relaxed) : lead * 1000;
+    }
+
+    void serve() {
+        std::vector<struct pollfd> fds;
+        while (running.load()) {
+            fds.clear();
+            fds.push_back({listenFd, POLLIN, 0});
+            for (auto &entry : clients) {
+                fds.push_back({entry.first, POLLIN, 0});
+            }
+
+            // Wake for the next batch, or at the latest after 100 ms to check for shutdown.
+            int64_t now = latencyNowNs(), wake = now + 100000000;
+            if (!queue.empty()) {
+                wake = std::min(wake, std::max(queue.top().dueNs - currentLeadNs(), busyUntilNs));
+            }
+            int64_t waitNs = std::max<int64_t>(0, wake - now);
+            struct timespec timeout = {static_cast<time_t>(waitNs / 1000000000), static_cast<long>(waitNs % 1000000000)};
+            if (ppoll(fds.data(), fds.size(), &timeout, NULL) > 0) {
+                if (fds[0].revents & POLLIN) {
+                    accept();
+                }
+                for (size_t i = 1; i < fds.size(); i++) {
+                    if (fds[i].revents & (POLLIN | POLLERR | POLLHUP)) {
+                        receive(fds[i].fd);
+                    }
+                }
+            }
+            dispatch();
+            // disconnect() erases from closing: walk a copy.
+            std::set<int> toClose;
+            toClose.swap(closing);
+            for (int fd : toClose) {
+                disconnect(fd);
+            }
+        }
+    }
+
+    void accept() {
+        int fd = ::accept4(listenFd, NULL, NULL, SOCK_NONBLOCK);
+        if (fd < 0) return;
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        clients[fd].clear();
+        clientsConnected.fetch_add(1, std::memory_order_relaxed);
+        printf("Stimulus client connected.\n");
+    }
+
+    void disconnect(int fd) {
+        if (clients.erase(fd) == 0) return;
+        close(fd);
+        closeLater(fd);
+        closing.erase(fd);
+        printf("Stimulus client disconnected.\n");
+    }
+
+    // Pending frames of the client are still injected, with nobody to ack.
+    void closeLater(int fd) {
+        closing.insert(fd);
+        for (auto &entry : frames) {
+            if (entry.second.fd == fd) entry.second.fd = -1;
+        }
+    }
+
+    void receive(int fd) {
+        std::vector<uint8_t> &inbox = clients[fd];
+        uint8_t buffer[65536];
+        ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            if (received < 0 && (errno == EAGAIN || errno == EINTR)) return;
+            disconnect(fd);
+            return;
+        }
+        int64_t receivedNs = latencyNowNs();
+        inbox.insert(inbox.end(), buffer, buffer + received);
+
+        size_t used = 0;
+        while (inbox.size() - used >= sizeof(StimulusFrameHeader)) {
+            StimulusFrameHeader header;
+            memcpy(&header, inbox.data() + used, sizeof(header));
+            if (header.magic != STIMULUS_FRAME_MAGIC || header.version != STIMULUS_VERSION
+                || header.spikes > STIMULUS_MAX_FRAME_SPIKES) {
+                fprintf(stderr, "Invalid stimulus frame, closing the connection.\n");
+                disconnect(fd);
+                return;
+            }
+            bool rates = (header.flags & STIMULUS_POISSON_RATES) != 0;
+            size_t bytes = sizeof(header) + header.spikes * (rates ? sizeof(StimulusRate) : sizeof(StimulusSpike));
+            if (inbox.size() - used < bytes) break;
+            if (rates) {
+                applyRates(fd, header, inbox.data() + used + sizeof(header), receivedNs);
+            }
+            else {
+                addFrame(fd, header, inbox.data() + used + sizeof(header), receivedNs);
+            }
+            used += bytes;
+        }
+        inbox.erase(inbox.begin(), inbox.begin() + used);
+    }
+
+    void addFrame(int fd, const StimulusFrameHeader &header, const uint8_t *data, int64_t receivedNs) {
+        uint32_t id = nextFrame++;
+        PendingFrame &frame = frames[id];
+        frame.fd = closing.count(fd) ? -1 : fd;
+        frame.sequence = header.sequence;
+        frame.receivedNs = receivedNs;
+        bool deviceTime = (header.flags & STIMULUS_DEVICE_TIME) != 0;
+        for (uint32_t i = 0; i < header.spikes; i++) {
+            StimulusSpike spike;
+            memcpy(&spike, data + i * sizeof(spike), sizeof(spike));
+            if (shadowChipSlot(spike.chipId) < 0 || spike.core > 3 || (deviceTime && !clock.synced())) {
+                frame.dropped++;
+                continue;
+            }
+            int64_t dueNs = deviceTime ? clock.toHostNs(spike.time) : receivedNs + std::max<int64_t>(0, spike.time) * 1000;
+            QueuedSpike queued = {dueNs, nextOrder++, id, spike.chipId, spike.core, spike.neuron,
+                                  static_cast<uint8_t>(spike.destCores ? spike.destCores : 0x0F)};
+            queue.push(queued);
+            frame.remaining++;
+        }
+        framesReceived.fetch_add(1, std::memory_order_relaxed);
+        spikesReceived.fetch_add(header.spikes, std::memory_order_relaxed);
+        spikesDropped.fetch_add(frame.dropped, std::memory_order_relaxed);
+        if (frame.remaining == 0) {
+            finish(id);
+        }
+    }
+
+    // A rate frame is one Poisson batch, written and acked right away.
+    void applyRates(int fd, const StimulusFrameHeader &header, const uint8_t *data, int64_t receivedNs) {
+        uint32_t id = nextFrame++;
+        PendingFrame &frame = frames[id];
+        frame.fd = closing.count(fd) ? -1 : fd;
+        frame.sequence = header.sequence;
+        frame.receivedNs = receivedNs;
+        rates.clear();
+        for (uint32_t i = 0; i < header.spikes; i++) {
+            StimulusRate entry;
+            memcpy(&entry, data + i * sizeof(entry), sizeof(entry));
+            PoissonRate rate;
+            if (makePoissonRate(entry.chipId, entry.core, entry.neuron, entry.rateHz, rate)) rates.push_back(rate);
+            else frame.dropped++;
+        }
+        PoissonProgramReport report;
+        const char *error = "no Poisson generator";
+        if (poissonRates != NULL && poissonRates->program(device, rates, report, &error)) {
+            frame.injected = static_cast<uint32_t>(rates.size());
+            frame.lastWriteNs = latencyNowNs();
+            frame.firstInjectNs = clock.synced() ? frame.lastWriteNs : -1;
+        }
+        else {
+            fprintf(stderr, "Stimulus rates rejected: %s.\n", error);
+            frame.dropped += static_cast<uint32_t>(rates.size());
+        }
+        framesReceived.fetch_add(1, std::memory_order_relaxed);
+        finish(id);
+    }
+
+    // Sends the next batch if it is due and the generator is free.
+    void dispatch() {
+        int64_t now = latencyNowNs();
+        int64_t lead = currentLeadNs(), maxLateNs = static_cast<int64_t>(maxLateUs.load()) * 1000;
+        if (now < busyUntilNs) return;
+        while (!queue.empty() && queue.top().dueNs - lead <= now && now + lead - queue.top().dueNs > maxLateNs) {
+            settle(queue.top().frame, false, 0, now);
+            spikesDropped.fetch_add(1, std::memory_order_relaxed);
+            queue.pop();
+        }
+        if (queue.empty() || queue.top().dueNs - lead > now) return;
+
+        // One chip, one window, ISIs relative to when the run is expected to start.
+        int64_t runAt = now + lead, firstDueNs = queue.top().dueNs;
+        int64_t windowEnd = std::max(firstDueNs, runAt)
+            + static_cast<int64_t>(std::min<uint32_t>(windowUs.load(), STIMULUS_MAX_WINDOW_US)) * 1000;
+        uint8_t chipId = queue.top().chipId;
+        int64_t offsetUs = 0;
+        words.clear();
+        batch.clear();
+        while (!queue.empty() && batch.size() < STIMULUS_MAX_BATCH && queue.top().chipId == chipId
+               && queue.top().dueNs <= windowEnd) {
+            const QueuedSpike &spike = queue.top();
+            int64_t at = std::max(offsetUs, (spike.dueNs - runAt) / 1000);
+            words.push_back(static_cast<uint16_t>(at - offsetUs));
+            words.push_back(spikeGenAddressWord(spike.core, spike.neuron, spike.destCores));
+            batch.push_back({spike.frame, at});
+            offsetUs = at;
+            queue.pop();
+        }
+
+        uint32_t base = STIMULUS_SRAM_BASE + sramHalf * STIMULUS_MAX_BATCH * SPIKEGEN_WORDS_PER_SPIKE;
+        sramHalf ^= 1;
+        bool ok = device->writeSramWords(words.data(), base, words.size());
+        if (ok && chipId != currentChip) {
+            ok = device->configSet(DYNAPSE_CONFIG_SPIKEGEN, DYNAPSE_CONFIG_SPIKEGEN_CHIPID, chipId);
+            currentChip = ok ? chipId : -1;
+        }
+        ok = ok && device->configSet(DYNAPSE_CONFIG_SPIKEGEN, DYNAPSE_CONFIG_SPIKEGEN_BASEADDR, base)
+            && device->configSet(DYNAPSE_CONFIG_SPIKEGEN, DYNAPSE_CONFIG_SPIKEGEN_STIMCOUNT,
+                                 static_cast<uint32_t>(batch.size()))
+            && device->configSet(DYNAPSE_CONFIG_SPIKEGEN, DYNAPSE_CONFIG_SPIKEGEN_RUN, false)
+            && device->configSet(DYNAPSE_CONFIG_SPIKEGEN, DYNAPSE_CONFIG_SPIKEGEN_RUN, true);
+        int64_t doneNs = latencyNowNs();
+
+        if (writeLatency != NULL) writeLatency->record(static_cast<uint64_t>(doneNs - now));
+        if (lateness != NULL) lateness->record(static_cast<uint64_t>(std::max<int64_t>(0, doneNs - firstDueNs)));
+        // AUTO lead: 1.5 x the moving average of the write time.
+        writeAverageNs += (doneNs - now - writeAverageNs) / 8;
+        autoLeadNs.store(std::max<int64_t>(50000, writeAverageNs * 3 / 2), std::memory_order_relaxed);
+
+        batches.fetch_add(1, std::memory_order_relaxed);
+        (ok ? spikesInjected : spikesDropped).fetch_add(batch.size(), std::memory_order_relaxed);
+        if (!ok) {
+            writeFailures.fetch_add(1, std::memory_order_relaxed);
+            currentChip = -1;
+        }
+        busyUntilNs = ok ? doneNs + offsetUs * 1000 : doneNs;
+        for (const BatchSpike &spike : batch) {
+            settle(spike.frame, ok, doneNs + spike.offsetUs * 1000, doneNs);
+        }
+    }
+
+    // One spike of a frame was injected at injectNs, or dropped.
+    void settle(uint32_t id, bool injected, int64_t injectNs, int64_t writeNs) {
+        auto it = frames.find(id);
+        if (it == frames.end()) return;
+        PendingFrame &frame = it->second;
+        if (injected) {
+            frame.injected++;
+            if (frame.firstInjectNs < 0 || injectNs < frame.firstInjectNs) frame.firstInjectNs = injectNs;
+            frame.lastWriteNs = writeNs;
+        }
+        else {
+            frame.dropped++;
+        }
+        if (--frame.remaining == 0) {
+            finish(id);
+        }
+    }
+
+    void finish(uint32_t id) {
+        auto it = frames.find(id);
+        const PendingFrame &frame = it->second;
+        int64_t hostToChipNs = (frame.lastWriteNs < 0) ? 0 : frame.lastWriteNs - frame.receivedNs;
+        if (hostToChip != NULL && frame.injected > 0) {
+            hostToChip->record(static_cast<uint64_t>(hostToChipNs));
+        }
+        if (frame.fd >= 0) {
+            StimulusAck ack = {STIMULUS_ACK_MAGIC, frame.sequence, frame.injected, frame.dropped,
+                               frame.firstInjectNs < 0 ? -1 : clock.toDeviceUs(frame.firstInjectNs),
+                               static_cast<uint32_t>(hostToChipNs / 1000), 0};
+            // A client that does not read its acks loses the connection rather than stalling injection.
+            if (send(frame.fd, &ack, sizeof(ack), MSG_NOSIGNAL | MSG_DONTWAIT) != static_cast<ssize_t>(sizeof(ack))) {
+                fprintf(stderr, "Stimulus client does not read its acks, closing the connection.\n");
+                closeLater(frame.fd);
+            }
+        }
+        frames.erase(it);
+    }
+};
+
+#endif /* DYNAPSE_STIMULUS_H_ */